@@ -24,6 +24,27 @@ distribution.
 #include "tinyxml2.h"
 
 #include <new>		// yes, this one new style header, is in the Android SDK.
+#include <float.h>	// FLT_EVAL_METHOD
+#include <math.h>	// ldexp, HUGE_VAL
+#include <fcntl.h>	// open flags
+#include <sys/stat.h>
+#if defined(_WIN32)
+#   include <io.h>		// _write, _read, _wopen
+#   include <share.h>
+#else
+#   include <unistd.h>	// write, read
+#   include <errno.h>
+#endif
+#if !defined(TINYXML2_NO_THREADS) && ( __cplusplus >= 201103L || ( defined(_MSC_VER) && _MSC_VER >= 1700 ) )
+#   include <thread>	// PrintParallel
+#   include <vector>
+#   include <typeinfo>
+#   define TIXML_THREADS
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#   include <emmintrin.h>
+#   define TIXML_SSE2
+#endif
 #if defined(ANDROID_NDK) || defined(__QNXNTO__)
 #   include <stddef.h>
 #   include <stdarg.h>
@@ -143,9 +164,9 @@ distribution.
 	// GCC version 3 and higher
 	//#warning( "Using sn* functions." )
 	#define TIXML_SNPRINTF	snprintf
-	#define TIXML_SNWPRINTF	snwprintf
+	#define TIXML_SNWPRINTF	swprintf
 	#define TIXML_VSNPRINTF	vsnprintf
-	#define TIXML_VSNWPRINTF	vsnwprintf
+	#define TIXML_VSNWPRINTF	vswprintf
 	static int TIXML_VSCPRINTF( const char* format, va_list va )
 	{
 		int len = vsnprintf( 0, 0, format, va );
@@ -154,9 +175,19 @@ distribution.
 	}
 	static int TIXML_VSCWPRINTF( const wchar_t* format, va_list va )
 	{
-		int len = vsnwprintf( 0, 0, format, va );
-		TIXMLASSERT( len >= 0 );
-		return len;
+		// vswprintf() can't measure its output, so try larger buffers.
+		for ( int len = 512; len <= 1<<24; len *= 2 ) {
+			wchar_t* str = new wchar_t[len];
+			va_list copy;
+			va_copy( copy, va );
+			const int required = vswprintf( str, len, format, copy );
+			va_end( copy );
+			delete[] str;
+			if ( required >= 0 ) {
+				return required;
+			}
+		}
+		return 0;
 	}
 	#define TIXML_SSCANF   sscanf
 	#define TIXML_SWSCANF   swscanf
@@ -232,12 +263,194 @@ static const Entity entities[NUM_ENTITIES] = {
     { "gt",	2,		'>'	 }
 };
 
+// --------- Name characters ----------- //
+/*
+	The NameStartChar and NameChar productions of XML 1.0 (Fifth Edition)
+	for the Basic Multilingual Plane, in three stages: the high byte of the
+	code point picks a row, the next 4 bits a leaf, and the leaf holds 2 bits
+	for each of 16 code points. Everything in U+10000..U+EFFFF may start a name.
+*/
+static const int NAME_CHAR = 1;
+static const int NAME_START_CHAR = 2;		// always set with NAME_CHAR
+
+static const unsigned char nameRows[256] = {
+    2, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    4, 5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 6, 7, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 8, 1, 9,
+};
+
+static const unsigned char nameLeafIndex[10][16] = {
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 },
+    {  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1 },
+    {  0,  0,  2,  3,  4,  5,  4,  6,  0,  0,  0,  7,  1,  8,  1,  8 },
+    {  9,  9,  9,  9,  9,  9,  9, 10,  1,  1,  1,  1,  1,  1,  1,  1 },
+    { 11,  0,  0, 12, 13,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,  1 },
+    {  1,  1,  1,  1,  1,  1,  1,  1,  1,  0,  0,  0,  0,  0,  0,  0 },
+    {  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  0 },
+    {  4,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1 },
+    {  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  0,  0,  1 },
+    {  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1, 14 },
+};
+
+static const unsigned char nameLeaves[15][4] = {
+    { 0x00, 0x00, 0x00, 0x00 },
+    { 0xff, 0xff, 0xff, 0xff },
+    { 0x00, 0x00, 0x00, 0x14 },
+    { 0x55, 0x55, 0x35, 0x00 },
+    { 0xfc, 0xff, 0xff, 0xff },
+    { 0xff, 0xff, 0x3f, 0xc0 },
+    { 0xff, 0xff, 0x3f, 0x00 },
+    { 0x00, 0x40, 0x00, 0x00 },
+    { 0xff, 0x3f, 0xff, 0xff },
+    { 0x55, 0x55, 0x55, 0x55 },
+    { 0xff, 0xff, 0xff, 0xcf },
+    { 0x00, 0x00, 0x00, 0x0f },
+    { 0x00, 0x00, 0x00, 0x40 },
+    { 0x01, 0x00, 0x00, 0x00 },
+    { 0xff, 0xff, 0xff, 0x0f },
+};
+
+static inline int NameClass( unsigned long c )
+{
+    if ( c >= 0x10000 ) {
+        return ( c < 0xF0000 ) ? ( NAME_START_CHAR | NAME_CHAR ) : 0;
+    }
+    const unsigned char leaf = nameLeafIndex[nameRows[c >> 8]][( c >> 4 ) & 15];
+    return ( nameLeaves[leaf][( c >> 2 ) & 3] >> ( ( c & 3 ) * 2 ) ) & 3;
+}
+
+// The length in units of the name character at p, or 0 if there is none
+// there. UTF-8 is decoded inline; overlong forms and surrogates are not
+// characters and end the name.
+static inline int NameCharLength( const char* p, int need )
+{
+    const unsigned char* u = reinterpret_cast<const unsigned char*>( p );
+    if ( u[0] < 0x80 ) {
+        const bool ok = ( need == NAME_START_CHAR ) ? XMLUtilT<char>::IsASCIINameStartChar( u[0] )
+                                                    : XMLUtilT<char>::IsASCIINameChar( u[0] );
+        return ok ? 1 : 0;
+    }
+    int length = 0;
+    unsigned long c = 0;
+    unsigned long least = 0;
+    if ( u[0] < 0xC2 ) {
+        return 0;
+    }
+    else if ( u[0] < 0xE0 ) {
+        length = 2;
+        c = u[0] & 0x1F;
+        least = 0x80;
+    }
+    else if ( u[0] < 0xF0 ) {
+        length = 3;
+        c = u[0] & 0x0F;
+        least = 0x800;
+    }
+    else if ( u[0] < 0xF4 ) {
+        length = 4;
+        c = u[0] & 0x07;
+        least = 0x10000;
+    }
+    else {
+        return 0;
+    }
+    // A null terminator fails the continuation test, so this never reads past it.
+    for( int i=1; i<length; ++i ) {
+        if ( ( u[i] & 0xC0 ) != 0x80 ) {
+            return 0;
+        }
+        c = ( c << 6 ) | ( u[i] & 0x3F );
+    }
+    if ( c < least ) {
+        return 0;
+    }
+    return ( NameClass( c ) & need ) ? length : 0;
+}
+
+// UTF-16 pairs surrogates; UTF-32 holds the code point.
+template<typename xchar>
+static inline int NameCharLength( const xchar* p, int need )
+{
+    unsigned long c = static_cast<unsigned long>( *p );
+    if ( c < 0x80 ) {
+        const bool ok = ( need == NAME_START_CHAR ) ? XMLUtilT<xchar>::IsASCIINameStartChar( c )
+                                                    : XMLUtilT<xchar>::IsASCIINameChar( c );
+        return ok ? 1 : 0;
+    }
+    int length = 1;
+    if ( sizeof( xchar ) == 2 && c >= 0xD800 && c <= 0xDBFF ) {
+        const unsigned long low = static_cast<unsigned long>( p[1] );
+        if ( low < 0xDC00 || low > 0xDFFF ) {
+            return 0;
+        }
+        c = 0x10000 + ( ( c - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+        length = 2;
+    }
+    return ( NameClass( c ) & need ) ? length : 0;
+}
+
+template< >
+bool XMLUtilT<char>::IsNameStartCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_START_CHAR ) != 0;
+}
+
+template< >
+bool XMLUtilT<char>::IsNameCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_CHAR ) != 0;
+}
+
+template< >
+bool XMLUtilT<wchar_t>::IsNameStartCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_START_CHAR ) != 0;
+}
+
+template< >
+bool XMLUtilT<wchar_t>::IsNameCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_CHAR ) != 0;
+}
+
+#ifdef TINYXML2_CHAR16
+template< >
+bool XMLUtilT<char16_t>::IsNameStartCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_START_CHAR ) != 0;
+}
+
+template< >
+bool XMLUtilT<char16_t>::IsNameCodePoint( unsigned long codePoint )
+{
+    return ( NameClass( codePoint ) & NAME_CHAR ) != 0;
+}
+#endif
+
+
 template<typename xchar>
 StrPairT<xchar>::~StrPairT()
 {
     Reset();
 }
 
+template<typename xchar>
+bool StrPairT<xchar>::Empty() const
+{
+    if ( _flags & INLINE ) {
+        return _u._inline[0] == 0;
+    }
+    if ( _flags & ( NEEDS_DELETE | INTERNED | CLONED ) ) {
+        return *Pointer() == 0;
+    }
+    return _u._span._length == 0;
+}
+
 template<typename xchar>
 void StrPairT<xchar>::TransferTo( StrPairT<xchar>* other )
 {
@@ -247,38 +460,60 @@ void StrPairT<xchar>::TransferTo( StrPairT<xchar>* other )
     // This in effect implements the assignment operator by "moving"
     // ownership (as in auto_ptr).
 
-    TIXMLASSERT( other->_flags == 0 );
-    TIXMLASSERT( other->_start == 0 );
-    TIXMLASSERT( other->_end == 0 );
+    TIXMLASSERT( other->_flags == INLINE );
+    TIXMLASSERT( other->_u._inline[0] == 0 );
 
     other->Reset();
 
     other->_flags = _flags;
-    other->_start = _start;
-    other->_end = _end;
+    other->_u = _u;
 
-    _flags = 0;
-    _start = 0;
-    _end = 0;
+    _flags = INLINE;
+    _u._span._offset = 0;
+    _u._span._length = 0;
 }
 
 template<typename xchar>
 void StrPairT<xchar>::Reset()
 {
     if ( _flags & NEEDS_DELETE ) {
-        delete [] _start;
+        delete [] Pointer();
+    }
+    else if ( _flags & CLONED ) {
+        ReleaseClone();
+    }
+    _flags = INLINE;
+    _u._span._offset = 0;
+    _u._span._length = 0;
+}
+
+template<typename xchar>
+void StrPairT<xchar>::ReleaseClone()
+{
+    xchar* str = Pointer();
+    size_t offset = 0;
+    memcpy( &offset, str - CLONE_WORD, sizeof( offset ) );
+    xchar* block = str - offset;
+    size_t count = 0;
+    memcpy( &count, block, sizeof( count ) );
+    TIXMLASSERT( count > 0 );
+    if ( --count == 0 ) {
+        delete [] block;
+    }
+    else {
+        memcpy( block, &count, sizeof( count ) );
     }
-    _flags = 0;
-    _start = 0;
-    _end = 0;
 }
 
 template<typename xchar>
-inline void StrPairT<xchar>::Set( xchar* start, xchar* end, int flags )
+inline void StrPairT<xchar>::Set( xchar* base, xchar* start, xchar* end, int flags )
 {
+    TIXMLASSERT( base && base <= start && start <= end );
+    // Documents are limited to UINT_MAX characters; see XMLDocument::Parse().
+    TIXMLASSERT( (size_t)( end - base ) < (size_t)UINT_MAX );
     Reset();
-    _start  = start;
-    _end    = end;
+    _u._span._offset = (unsigned)( start - base );
+    _u._span._length = (unsigned)( end - start );
     _flags  = flags | NEEDS_FLUSH;
 }
 
@@ -286,7 +521,8 @@ template<typename xchar>
 inline void StrPairT<xchar>::SetInternedStr( const xchar* str )
 {
     Reset();
-    _start = const_cast<xchar*>(str);
+    SetPointer( str );
+    _flags = INTERNED;
 }
 
 template<typename xchar>
@@ -294,15 +530,58 @@ void StrPairT<xchar>::SetStr( const xchar* str, int flags )
 {
     Reset();
     size_t len = strlen( str );
-    TIXMLASSERT( _start == 0 );
-    _start = new xchar[ len+1 ];
-    memcpy( _start, str, ( len+1 ) * sizeof(xchar));
-    _end = _start + len;
+    if ( len < INLINE_SIZE ) {
+        memcpy( _u._inline, str, ( len+1 ) * sizeof(xchar));
+        _flags = flags | INLINE;
+        return;
+    }
+    xchar* copy = new xchar[ len+1 ];
+    memcpy( copy, str, ( len+1 ) * sizeof(xchar));
+    SetPointer( copy );
     _flags = flags | NEEDS_DELETE;
 }
 
 template<typename xchar>
-xchar* StrPairT<xchar>::ParseText( xchar* p, const xchar* endTag, int strFlags )
+size_t StrPairT<xchar>::CloneSize( const xchar* str )
+{
+    // Short strings are copied inline instead.
+    const size_t len = strlen( str );
+    return ( len < INLINE_SIZE ) ? 0 : CLONE_WORD + len + 1;
+}
+
+template<typename xchar>
+void StrPairT<xchar>::NewCloneBlock( CloneBlock* block, size_t size, size_t strings )
+{
+    if ( size == 0 ) {
+        block->start = block->next = 0;
+        return;
+    }
+    block->start = new xchar[CLONE_WORD + size];
+    memcpy( block->start, &strings, sizeof( strings ) );
+    block->next = block->start + CLONE_WORD;
+}
+
+template<typename xchar>
+void StrPairT<xchar>::SetClonedStr( const xchar* str, CloneBlock* block )
+{
+    const size_t len = strlen( str );
+    if ( len < INLINE_SIZE ) {
+        SetStr( str );
+        return;
+    }
+    Reset();
+    // Each string is preceded by its offset, to find the count.
+    xchar* copy = block->next + CLONE_WORD;
+    const size_t offset = copy - block->start;
+    memcpy( block->next, &offset, sizeof( offset ) );
+    memcpy( copy, str, ( len+1 ) * sizeof(xchar) );
+    block->next = copy + len + 1;
+    SetPointer( copy );
+    _flags = CLONED;
+}
+
+template<typename xchar>
+xchar* StrPairT<xchar>::ParseText( xchar* base, xchar* p, const xchar* endTag, int strFlags )
 {
     TIXMLASSERT( endTag && *endTag );
 
@@ -313,7 +592,7 @@ xchar* StrPairT<xchar>::ParseText( xchar* p, const xchar* endTag, int strFlags )
     // Inner loop of text parsing.
     while ( *p ) {
         if ( *p == endChar && strncmp( p, endTag, length ) == 0 ) {
-            Set( start, p, strFlags );
+            Set( base, start, p, strFlags );
             return p + length;
         }
         ++p;
@@ -322,68 +601,70 @@ xchar* StrPairT<xchar>::ParseText( xchar* p, const xchar* endTag, int strFlags )
 }
 
 template<typename xchar>
-xchar* StrPairT<xchar>::ParseName( xchar* p )
+xchar* StrPairT<xchar>::ParseName( xchar* base, xchar* p )
 {
     if ( !p || !(*p) ) {
         return 0;
     }
-    if ( !XMLUtilT<xchar>::IsNameStartChar( *p ) ) {
+    int length = NameCharLength( p, NAME_START_CHAR );
+    if ( !length ) {
         return 0;
     }
 
     xchar* const start = p;
-    ++p;
-    while ( *p && XMLUtilT<xchar>::IsNameChar( *p ) ) {
-        ++p;
-    }
+    do {
+        p += length;
+        length = NameCharLength( p, NAME_CHAR );
+    } while ( length );
 
-    Set( start, p, 0 );
+    Set( base, start, p, 0 );
     return p;
 }
 
 template<typename xchar>
-void StrPairT<xchar>::CollapseWhitespace()
+const xchar* StrPairT<xchar>::GetStr( xchar* base )
 {
-    // Adjusting _start would cause undefined behavior on delete[]
-    TIXMLASSERT( ( _flags & NEEDS_DELETE ) == 0 );
-    // Trim leading space.
-    _start = XMLUtilT<xchar>::SkipWhiteSpace( _start );
-
-    if ( *_start ) {
-        xchar* p = _start;	// the read pointer
-        xchar* q = _start;	// the write pointer
-
-        while( *p ) {
-            if ( XMLUtilT<xchar>::IsWhiteSpace( *p )) {
-                p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-                if ( *p == 0 ) {
-                    break;    // don't write to q; this trims the trailing space.
-                }
-                *q = xchar(' ');
-                ++q;
-            }
-            *q = *p;
-            ++q;
-            ++p;
-        }
-        *q = 0;
+    if ( _flags & INLINE ) {
+        return _u._inline;
     }
-}
-
-template<typename xchar>
-const xchar* StrPairT<xchar>::GetStr()
-{
-    TIXMLASSERT( _start );
-    TIXMLASSERT( _end );
+    if ( _flags & ( NEEDS_DELETE | INTERNED | CLONED ) ) {
+        return Pointer();
+    }
+    TIXMLASSERT( base );
+    xchar* start = base + _u._span._offset;
     if ( _flags & NEEDS_FLUSH ) {
-        *_end = 0;
+        xchar* end = start + _u._span._length;
+        *end = 0;
         _flags ^= NEEDS_FLUSH;
 
         if ( _flags ) {
-            xchar* p = _start;	// the read pointer
-            xchar* q = _start;	// the write pointer
-
-            while( p < _end ) {
+            xchar* p = start;	// the read pointer
+            xchar* q = start;	// the write pointer
+
+            // Whitespace is collapsed in the same pass. A run of it, newlines
+            // included, is held back and written as one space only when more
+            // text follows, which also trims both ends.
+            const bool collapse = ( _flags & NEEDS_WHITESPACE_COLLAPSING ) != 0;
+            bool space = false;
+            // Attribute values turn literal (but not referenced) newlines into spaces.
+            const xchar newline = ( _flags & NEEDS_ATTRIBUTE_NORMALIZATION ) ? xchar(' ') : xchar(LF);
+
+            while( p < end ) {
+                bool spaceWritten = false;
+                if ( collapse ) {
+                    if ( XMLUtilT<xchar>::IsWhiteSpace( *p ) ) {
+                        space = true;
+                        ++p;
+                        continue;
+                    }
+                    if ( space ) {
+                        if ( q != start ) {
+                            *q++ = xchar(' ');
+                            spaceWritten = true;
+                        }
+                        space = false;
+                    }
+                }
                 if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
                     // CR-LF pair becomes LF
                     // CR alone becomes LF
@@ -394,7 +675,7 @@ const xchar* StrPairT<xchar>::GetStr()
                     else {
                         ++p;
                     }
-                    *q++ = LF;
+                    *q++ = newline;
                 }
                 else if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == LF ) {
                     if ( *(p+1) == CR ) {
@@ -403,7 +684,11 @@ const xchar* StrPairT<xchar>::GetStr()
                     else {
                         ++p;
                     }
-                    *q++ = LF;
+                    *q++ = newline;
+                }
+                else if ( (_flags & NEEDS_ATTRIBUTE_NORMALIZATION) && ( *p == '\t' || *p == CR || *p == LF ) ) {
+                    *q++ = xchar(' ');
+                    ++p;
                 }
                 else if ( (_flags & NEEDS_ENTITY_PROCESSING) && *p == '&' ) {
                     // Entities handled by tinyXML2:
@@ -421,6 +706,14 @@ const xchar* StrPairT<xchar>::GetStr()
                             ++p;
                             ++q;
                         }
+                        else if ( collapse && len == 1 && XMLUtilT<xchar>::IsWhiteSpace( buf[0] ) ) {
+                            // A reference to whitespace joins the run around it.
+                            if ( spaceWritten ) {
+                                --q;
+                            }
+                            space = true;
+                            p = adjusted;
+                        }
                         else {
                             TIXMLASSERT( 0 <= len && len <= buflen );
                             TIXMLASSERT( q + len <= adjusted );
@@ -445,6 +738,7 @@ const xchar* StrPairT<xchar>::GetStr()
                         }
                         if ( !entityFound ) {
                             // fixme: treat as error?
+                            *q = *p;
                             ++p;
                             ++q;
                         }
@@ -457,16 +751,11 @@ const xchar* StrPairT<xchar>::GetStr()
                 }
             }
             *q = 0;
+            _u._span._length = (unsigned)( q - start );
         }
-        // The loop below has plenty going on, and this
-        // is a less useful mode. Break it out.
-        if ( _flags & NEEDS_WHITESPACE_COLLAPSING ) {
-            CollapseWhitespace();
-        }
-        _flags = (_flags & NEEDS_DELETE);
+        _flags = 0;
     }
-    TIXMLASSERT( _start );
-    return _start;
+    return base + _u._span._offset;
 }
 
 
@@ -545,6 +834,26 @@ void XMLUtilT<xchar>::ConvertUTF32ToUTF8( unsigned long input, xchar* output, in
     }
 }
 
+// Store the character 'ucs' of a reference in the document encoding:
+// UTF-8 for char, UTF-16 for 16 bit units and the code point for UTF-32.
+template<typename xchar>
+static void PutCharacterRef( unsigned long ucs, xchar* value, int* length )
+{
+    if ( sizeof( xchar ) == 1 ) {
+        XMLUtilT<xchar>::ConvertUTF32ToUTF8( ucs, value, length );
+    }
+    else if ( sizeof( xchar ) == 2 && ucs >= 0x10000 ) {
+        ucs -= 0x10000;
+        value[0] = static_cast<xchar>( 0xD800 + ( ucs >> 10 ) );
+        value[1] = static_cast<xchar>( 0xDC00 + ( ucs & 0x3FF ) );
+        *length = 2;
+    }
+    else {
+        value[0] = static_cast<xchar>( ucs );
+        *length = 1;
+    }
+}
+
 template<typename xchar>
 const xchar* XMLUtilT<xchar>::GetCharacterRef( const xchar* p, xchar* value, int* length )
 {
@@ -552,2159 +861,6048 @@ const xchar* XMLUtilT<xchar>::GetCharacterRef( const xchar* p, xchar* value, int
     *length = 0;
 
     if ( *(p+1) == xchar('#') && *(p+2) ) {
+        // Digits are read left to right. Past U+10FFFF the value stops
+        // growing, so it can't overflow, and is rejected below.
         unsigned long ucs = 0;
-        TIXMLASSERT( sizeof( ucs ) >= 4 );
-        ptrdiff_t delta = 0;
-        unsigned mult = 1;
-        static const xchar SEMICOLON = xchar(';');
-
-        if ( *(p+2) == xchar('x') ) {
+        const xchar* q = p+2;
+        const xchar* digits = q;
+        if ( *q == xchar('x') ) {
             // Hexadecimal.
-            const xchar* q = p+3;
-            if ( !(*q) ) {
-                return 0;
-            }
-
-            q = strchr( q, SEMICOLON );
-
-            if ( !q ) {
-                return 0;
-            }
-            TIXMLASSERT( *q == SEMICOLON );
-
-            delta = q-p;
-            --q;
-
-            while ( *q != xchar('x') ) {
-                unsigned int digit = 0;
-
-                if ( *q >= xchar('0') && *q <= xchar('9') ) {
-                    digit = *q - xchar('0');
-                }
-                else if ( *q >= xchar('a') && *q <= xchar('f') ) {
-                    digit = *q - xchar('a') + 10;
-                }
-                else if ( *q >= xchar('A') && *q <= xchar('F') ) {
-                    digit = *q - xchar('A') + 10;
+            digits = ++q;
+            for( ;; ++q ) {
+                const unsigned long c = static_cast<unsigned long>( *q );
+                unsigned long digit = c - '0';
+                if ( digit > 9 ) {
+                    digit = ( c | 0x20 ) - 'a';
+                    if ( digit > 5 ) {
+                        break;
+                    }
+                    digit += 10;
                 }
-                else {
-                    return 0;
+                if ( ucs <= 0x10FFFF ) {
+                    ucs = ucs * 16 + digit;
                 }
-                TIXMLASSERT( digit >= 0 && digit < 16);
-                TIXMLASSERT( digit == 0 || mult <= UINT_MAX / digit );
-                const unsigned int digitScaled = mult * digit;
-                TIXMLASSERT( ucs <= ULONG_MAX - digitScaled );
-                ucs += digitScaled;
-                TIXMLASSERT( mult <= UINT_MAX / 16 );
-                mult *= 16;
-                --q;
             }
         }
         else {
             // Decimal.
-            const xchar* q = p+2;
-            if ( !(*q) ) {
-                return 0;
+            for( ;; ++q ) {
+                const unsigned long digit = static_cast<unsigned long>( *q ) - '0';
+                if ( digit > 9 ) {
+                    break;
+                }
+                if ( ucs <= 0x10FFFF ) {
+                    ucs = ucs * 10 + digit;
+                }
             }
+        }
+        if ( q == digits || *q != xchar(';') ) {
+            return 0;
+        }
+        if ( ucs == 0 || ucs > 0x10FFFF || ( ucs >= 0xD800 && ucs <= 0xDFFF ) ) {
+            // Not a character.
+            return 0;
+        }
+        PutCharacterRef( ucs, value, length );
+        return q + 1;
+    }
+    return p+1;
+}
 
-            q = strchr( q, SEMICOLON );
+// --------- Number formatting ----------- //
+/*
+	ToStr() of a number is a very tricky topic.
+	https://github.com/leethomason/tinyxml2/issues/106
 
-            if ( !q ) {
-                return 0;
-            }
-            TIXMLASSERT( *q == SEMICOLON );
+	Floating point values are written with the shortest digit string that
+	reads back to the same value, using Grisu2 (Florian Loitsch, "Printing
+	Floating-Point Numbers Quickly and Accurately with Integers", 2010), and
+	laid out the way printf's %g would. Integers are written two digits at a
+	time. Neither goes through the C library, so the output is also
+	independent of the current locale.
+*/
 
-            delta = q-p;
-            --q;
+// A floating point value f * 2^e with a 64 bit significand.
+struct DiyFp {
+    unsigned long long f;
+    int e;
+};
 
-            while ( *q != xchar('#') ) {
-                if ( *q >= xchar('0') && *q <= xchar('9') ) {
-                    const unsigned int digit = *q - xchar('0');
-                    TIXMLASSERT( digit >= 0 && digit < 10);
-                    TIXMLASSERT( digit == 0 || mult <= UINT_MAX / digit );
-                    const unsigned int digitScaled = mult * digit;
-                    TIXMLASSERT( ucs <= ULONG_MAX - digitScaled );
-                    ucs += digitScaled;
-                }
-                else {
-                    return 0;
-                }
-                TIXMLASSERT( mult <= UINT_MAX / 10 );
-                mult *= 10;
-                --q;
-            }
+static inline DiyFp MakeDiyFp( unsigned long long f, int e )
+{
+    DiyFp r = { f, e };
+    return r;
+}
+
+// 64x64 bit product, keeping the (rounded) upper 64 bits.
+static inline DiyFp DiyFpMul( const DiyFp& x, const DiyFp& y )
+{
+    static const unsigned long long M32 = 0xFFFFFFFFULL;
+    const unsigned long long a = x.f >> 32;
+    const unsigned long long b = x.f & M32;
+    const unsigned long long c = y.f >> 32;
+    const unsigned long long d = y.f & M32;
+    const unsigned long long ac = a * c;
+    const unsigned long long bc = b * c;
+    const unsigned long long ad = a * d;
+    const unsigned long long bd = b * d;
+    unsigned long long tmp = ( bd >> 32 ) + ( ad & M32 ) + ( bc & M32 );
+    tmp += 1ULL << 31;
+    return MakeDiyFp( ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ), x.e + y.e + 64 );
+}
+
+static inline DiyFp DiyFpNormalize( DiyFp x )
+{
+    TIXMLASSERT( x.f != 0 );
+    while ( ( x.f & 0x8000000000000000ULL ) == 0 ) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+// Normalized 10^k for k = -348, -340, ... 340.
+static const DiyFp cachedPowers[] = {
+    { 0xfa8fd5a0081c0288ULL, -1220 }, { 0xbaaee17fa23ebf76ULL, -1193 }, { 0x8b16fb203055ac76ULL, -1166 },
+    { 0xcf42894a5dce35eaULL, -1140 }, { 0x9a6bb0aa55653b2dULL, -1113 }, { 0xe61acf033d1a45dfULL, -1087 },
+    { 0xab70fe17c79ac6caULL, -1060 }, { 0xff77b1fcbebcdc4fULL, -1034 }, { 0xbe5691ef416bd60cULL, -1007 },
+    { 0x8dd01fad907ffc3cULL,  -980 }, { 0xd3515c2831559a83ULL,  -954 }, { 0x9d71ac8fada6c9b5ULL,  -927 },
+    { 0xea9c227723ee8bcbULL,  -901 }, { 0xaecc49914078536dULL,  -874 }, { 0x823c12795db6ce57ULL,  -847 },
+    { 0xc21094364dfb5637ULL,  -821 }, { 0x9096ea6f3848984fULL,  -794 }, { 0xd77485cb25823ac7ULL,  -768 },
+    { 0xa086cfcd97bf97f4ULL,  -741 }, { 0xef340a98172aace5ULL,  -715 }, { 0xb23867fb2a35b28eULL,  -688 },
+    { 0x84c8d4dfd2c63f3bULL,  -661 }, { 0xc5dd44271ad3cdbaULL,  -635 }, { 0x936b9fcebb25c996ULL,  -608 },
+    { 0xdbac6c247d62a584ULL,  -582 }, { 0xa3ab66580d5fdaf6ULL,  -555 }, { 0xf3e2f893dec3f126ULL,  -529 },
+    { 0xb5b5ada8aaff80b8ULL,  -502 }, { 0x87625f056c7c4a8bULL,  -475 }, { 0xc9bcff6034c13053ULL,  -449 },
+    { 0x964e858c91ba2655ULL,  -422 }, { 0xdff9772470297ebdULL,  -396 }, { 0xa6dfbd9fb8e5b88fULL,  -369 },
+    { 0xf8a95fcf88747d94ULL,  -343 }, { 0xb94470938fa89bcfULL,  -316 }, { 0x8a08f0f8bf0f156bULL,  -289 },
+    { 0xcdb02555653131b6ULL,  -263 }, { 0x993fe2c6d07b7facULL,  -236 }, { 0xe45c10c42a2b3b06ULL,  -210 },
+    { 0xaa242499697392d3ULL,  -183 }, { 0xfd87b5f28300ca0eULL,  -157 }, { 0xbce5086492111aebULL,  -130 },
+    { 0x8cbccc096f5088ccULL,  -103 }, { 0xd1b71758e219652cULL,   -77 }, { 0x9c40000000000000ULL,   -50 },
+    { 0xe8d4a51000000000ULL,   -24 }, { 0xad78ebc5ac620000ULL,     3 }, { 0x813f3978f8940984ULL,    30 },
+    { 0xc097ce7bc90715b3ULL,    56 }, { 0x8f7e32ce7bea5c70ULL,    83 }, { 0xd5d238a4abe98068ULL,   109 },
+    { 0x9f4f2726179a2245ULL,   136 }, { 0xed63a231d4c4fb27ULL,   162 }, { 0xb0de65388cc8ada8ULL,   189 },
+    { 0x83c7088e1aab65dbULL,   216 }, { 0xc45d1df942711d9aULL,   242 }, { 0x924d692ca61be758ULL,   269 },
+    { 0xda01ee641a708deaULL,   295 }, { 0xa26da3999aef774aULL,   322 }, { 0xf209787bb47d6b85ULL,   348 },
+    { 0xb454e4a179dd1877ULL,   375 }, { 0x865b86925b9bc5c2ULL,   402 }, { 0xc83553c5c8965d3dULL,   428 },
+    { 0x952ab45cfa97a0b3ULL,   455 }, { 0xde469fbd99a05fe3ULL,   481 }, { 0xa59bc234db398c25ULL,   508 },
+    { 0xf6c69a72a3989f5cULL,   534 }, { 0xb7dcbf5354e9beceULL,   561 }, { 0x88fcf317f22241e2ULL,   588 },
+    { 0xcc20ce9bd35c78a5ULL,   614 }, { 0x98165af37b2153dfULL,   641 }, { 0xe2a0b5dc971f303aULL,   667 },
+    { 0xa8d9d1535ce3b396ULL,   694 }, { 0xfb9b7cd9a4a7443cULL,   720 }, { 0xbb764c4ca7a44410ULL,   747 },
+    { 0x8bab8eefb6409c1aULL,   774 }, { 0xd01fef10a657842cULL,   800 }, { 0x9b10a4e5e9913129ULL,   827 },
+    { 0xe7109bfba19c0c9dULL,   853 }, { 0xac2820d9623bf429ULL,   880 }, { 0x80444b5e7aa7cf85ULL,   907 },
+    { 0xbf21e44003acdd2dULL,   933 }, { 0x8e679c2f5e44ff8fULL,   960 }, { 0xd433179d9c8cb841ULL,   986 },
+    { 0x9e19db92b4e31ba9ULL,  1013 }, { 0xeb96bf6ebadf77d9ULL,  1039 }, { 0xaf87023b9bf0ee6bULL,  1066 },
+};
+
+// Finds c = 10^-K such that the product of c and a normalized value with
+// binary exponent 'e' has its binary exponent in [-60, -32].
+static inline DiyFp CachedPower( int e, int* K )
+{
+    const double dk = ( -61 - e ) * 0.30102999566398114 + 347;	// log10(2)
+    int k = static_cast<int>( dk );
+    if ( dk - k > 0.0 ) {
+        ++k;
+    }
+    const int index = ( k >> 3 ) + 1;
+    TIXMLASSERT( index >= 0 && index < (int)( sizeof( cachedPowers ) / sizeof( cachedPowers[0] ) ) );
+    *K = -( -348 + ( index << 3 ) );
+    return cachedPowers[index];
+}
+
+static const unsigned pow10Table[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static inline void GrisuRound( char* digits, int len, unsigned long long delta, unsigned long long rest,
+                               unsigned long long tenKappa, unsigned long long distance )
+{
+    while ( rest < distance && delta - rest >= tenKappa
+            && ( rest + tenKappa < distance || distance - rest > rest + tenKappa - distance ) ) {
+        --digits[len - 1];
+        rest += tenKappa;
+    }
+}
+
+static void GrisuDigits( const DiyFp& w, const DiyFp& mp, unsigned long long delta, char* digits, int* len, int* K )
+{
+    const DiyFp one = MakeDiyFp( 1ULL << -mp.e, mp.e );
+    const unsigned long long distance = mp.f - w.f;
+    unsigned p1 = static_cast<unsigned>( mp.f >> -one.e );
+    unsigned long long p2 = mp.f & ( one.f - 1 );
+
+    int kappa = 1;
+    while ( kappa < 10 && p1 >= pow10Table[kappa] ) {
+        ++kappa;
+    }
+    *len = 0;
+    while ( kappa > 0 ) {
+        const unsigned div = pow10Table[kappa - 1];
+        const unsigned d = p1 / div;
+        p1 %= div;
+        if ( d || *len ) {
+            digits[(*len)++] = static_cast<char>( '0' + d );
+        }
+        --kappa;
+        const unsigned long long rest = ( static_cast<unsigned long long>( p1 ) << -one.e ) + p2;
+        if ( rest <= delta ) {
+            *K += kappa;
+            GrisuRound( digits, *len, delta, rest, static_cast<unsigned long long>( pow10Table[kappa] ) << -one.e, distance );
+            return;
         }
-        // convert the UCS to UTF-8
-        ConvertUTF32ToUTF8( ucs, value, length );
-        return p + delta + 1;
     }
-    return p+1;
+    for( ;; ) {
+        p2 *= 10;
+        delta *= 10;
+        const char d = static_cast<char>( p2 >> -one.e );
+        if ( d || *len ) {
+            digits[(*len)++] = static_cast<char>( '0' + d );
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if ( p2 < delta ) {
+            *K += kappa;
+            const int index = -kappa;
+            GrisuRound( digits, *len, delta, p2, one.f, distance * ( index < 10 ? pow10Table[index] : 0 ) );
+            return;
+        }
+    }
+}
+
+// Shortest digits of the positive value f * 2^e, where the next smaller
+// value is half as far away if 'lowerCloser' (f is a power of two).
+// Writes at most 17 digits; the value is digits * 10^K.
+static void Grisu2( unsigned long long f, int e, bool lowerCloser, char* digits, int* len, int* K )
+{
+    const DiyFp v = DiyFpNormalize( MakeDiyFp( f, e ) );
+    const DiyFp plus = DiyFpNormalize( MakeDiyFp( ( f << 1 ) + 1, e - 1 ) );
+    DiyFp minus = lowerCloser ? MakeDiyFp( ( f << 2 ) - 1, e - 2 ) : MakeDiyFp( ( f << 1 ) - 1, e - 1 );
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+    TIXMLASSERT( v.e == plus.e );
+
+    const DiyFp c = CachedPower( plus.e, K );
+    const DiyFp w = DiyFpMul( v, c );
+    DiyFp wp = DiyFpMul( plus, c );
+    DiyFp wm = DiyFpMul( minus, c );
+    ++wm.f;
+    --wp.f;
+    GrisuDigits( w, wp, wp.f - wm.f, digits, len, K );
+}
+
+static int FormatExponent( int exp, char* out )
+{
+    int n = 0;
+    out[n++] = 'e';
+    if ( exp < 0 ) {
+        out[n++] = '-';
+        exp = -exp;
+    }
+    else {
+        out[n++] = '+';
+    }
+    if ( exp >= 100 ) {
+        out[n++] = static_cast<char>( '0' + exp / 100 );
+        exp %= 100;
+    }
+    out[n++] = static_cast<char>( '0' + exp / 10 );
+    out[n++] = static_cast<char>( '0' + exp % 10 );
+    return n;
+}
+
+// Lays out digits * 10^K like %g with the given precision: fixed notation
+// when the decimal exponent is in [-4, precision), exponential otherwise.
+static int FormatDigits( const char* digits, int len, int K, int precision, char* out )
+{
+    const int exp = len + K - 1;
+    int n = 0;
+    if ( exp < -4 || exp >= precision ) {
+        out[n++] = digits[0];
+        if ( len > 1 ) {
+            out[n++] = '.';
+            memcpy( out + n, digits + 1, len - 1 );
+            n += len - 1;
+        }
+        return n + FormatExponent( exp, out + n );
+    }
+    if ( exp < 0 ) {
+        out[n++] = '0';
+        out[n++] = '.';
+        for( int i=exp+1; i<0; ++i ) {
+            out[n++] = '0';
+        }
+        memcpy( out + n, digits, len );
+        return n + len;
+    }
+    if ( exp >= len - 1 ) {
+        memcpy( out, digits, len );
+        n = len;
+        for( int i=len; i<=exp; ++i ) {
+            out[n++] = '0';
+        }
+        return n;
+    }
+    memcpy( out, digits, exp + 1 );
+    n = exp + 1;
+    out[n++] = '.';
+    memcpy( out + n, digits + exp + 1, len - exp - 1 );
+    return n + len - exp - 1;
+}
+
+// Handles the sign, zero, infinity and NaN; returns 0 if the value is finite
+// and non-zero, leaving the sign in 'out'.
+static int FormatSpecial( bool negative, bool zero, bool infinite, bool nan, char* out, int* n )
+{
+    *n = 0;
+    if ( nan ) {
+        memcpy( out, "nan", 3 );
+        return 3;
+    }
+    if ( negative ) {
+        out[(*n)++] = '-';
+    }
+    if ( zero ) {
+        out[(*n)++] = '0';
+        return *n;
+    }
+    if ( infinite ) {
+        memcpy( out + *n, "inf", 3 );
+        return *n + 3;
+    }
+    return 0;
+}
+
+static int FormatDouble( double v, char* out )
+{
+    unsigned long long bits = 0;
+    memcpy( &bits, &v, sizeof( bits ) );
+    const unsigned long long F = bits & 0x000FFFFFFFFFFFFFULL;
+    const int E = static_cast<int>( ( bits >> 52 ) & 0x7FF );
+
+    int n = 0;
+    const int special = FormatSpecial( ( bits >> 63 ) != 0, E == 0 && F == 0, E == 0x7FF && F == 0, E == 0x7FF && F != 0, out, &n );
+    if ( special ) {
+        return special;
+    }
+    char digits[20];
+    int len = 0;
+    int K = 0;
+    if ( E == 0 ) {
+        Grisu2( F, 1 - 1075, false, digits, &len, &K );
+    }
+    else {
+        Grisu2( F | 0x0010000000000000ULL, E - 1075, F == 0 && E > 1, digits, &len, &K );
+    }
+    return n + FormatDigits( digits, len, K, 17, out + n );
+}
+
+static int FormatFloat( float v, char* out )
+{
+    unsigned bits = 0;
+    memcpy( &bits, &v, sizeof( bits ) );
+    const unsigned F = bits & 0x007FFFFFU;
+    const int E = static_cast<int>( ( bits >> 23 ) & 0xFF );
+
+    int n = 0;
+    const int special = FormatSpecial( ( bits >> 31 ) != 0, E == 0 && F == 0, E == 0xFF && F == 0, E == 0xFF && F != 0, out, &n );
+    if ( special ) {
+        return special;
+    }
+    char digits[20];
+    int len = 0;
+    int K = 0;
+    if ( E == 0 ) {
+        Grisu2( F, 1 - 150, false, digits, &len, &K );
+    }
+    else {
+        Grisu2( F | 0x00800000U, E - 150, F == 0 && E > 1, digits, &len, &K );
+    }
+    return n + FormatDigits( digits, len, K, 8, out + n );
+}
+
+static const char digitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static int FormatInteger( unsigned long long v, bool negative, char* out )
+{
+    char tmp[24];
+    char* p = tmp + sizeof( tmp );
+    while ( v >= 100 ) {
+        const unsigned i = static_cast<unsigned>( v % 100 ) * 2;
+        v /= 100;
+        *--p = digitPairs[i + 1];
+        *--p = digitPairs[i];
+    }
+    if ( v >= 10 ) {
+        const unsigned i = static_cast<unsigned>( v ) * 2;
+        *--p = digitPairs[i + 1];
+        *--p = digitPairs[i];
+    }
+    else {
+        *--p = static_cast<char>( '0' + v );
+    }
+    if ( negative ) {
+        *--p = '-';
+    }
+    const int n = static_cast<int>( tmp + sizeof( tmp ) - p );
+    memcpy( out, p, n );
+    return n;
+}
+
+// Widens (if needed) and copies a formatted number, truncating to bufferSize.
+template<typename xchar>
+static void CopyNumber( const char* str, int len, xchar* buffer, int bufferSize )
+{
+    TIXMLASSERT( bufferSize > 0 );
+    if ( len >= bufferSize ) {
+        len = bufferSize - 1;
+    }
+    for( int i=0; i<len; ++i ) {
+        buffer[i] = static_cast<xchar>( str[i] );
+    }
+    buffer[len] = 0;
 }
 
 template< >
 void XMLUtilT<char>::ToStr( int v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%d", v );
+    char str[24];
+    const unsigned long long mag = v < 0 ? 0ULL - static_cast<unsigned long long>( static_cast<long long>( v ) ) : static_cast<unsigned long long>( v );
+    CopyNumber( str, FormatInteger( mag, v < 0, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<wchar_t>::ToStr( int v, wchar_t* buffer, int bufferSize )
 {
-    TIXML_SNWPRINTF( buffer, bufferSize, L"%d", v );
+    char str[24];
+    const unsigned long long mag = v < 0 ? 0ULL - static_cast<unsigned long long>( static_cast<long long>( v ) ) : static_cast<unsigned long long>( v );
+    CopyNumber( str, FormatInteger( mag, v < 0, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<char>::ToStr( unsigned v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%u", v );
+    char str[24];
+    CopyNumber( str, FormatInteger( v, false, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<wchar_t>::ToStr( unsigned v, wchar_t* buffer, int bufferSize )
 {
-    TIXML_SNWPRINTF( buffer, bufferSize, L"%u", v );
+    char str[24];
+    CopyNumber( str, FormatInteger( v, false, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<char>::ToStr( bool v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%d", v ? 1 : 0 );
+    CopyNumber( v ? "1" : "0", 1, buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<wchar_t>::ToStr( bool v, wchar_t* buffer, int bufferSize )
 {
-    TIXML_SNWPRINTF( buffer, bufferSize, L"%d", v ? 1 : 0 );
+    CopyNumber( v ? "1" : "0", 1, buffer, bufferSize );
 }
 
-/*
-	ToStr() of a number is a very tricky topic.
-	https://github.com/leethomason/tinyxml2/issues/106
-*/
 template< >
 void XMLUtilT<char>::ToStr( float v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%.8g", v );
+    char str[32];
+    CopyNumber( str, FormatFloat( v, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<wchar_t>::ToStr( float v, wchar_t* buffer, int bufferSize )
 {
-    TIXML_SNWPRINTF( buffer, bufferSize, L"%.8g", v );
+    char str[32];
+    CopyNumber( str, FormatFloat( v, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<char>::ToStr( double v, char* buffer, int bufferSize )
 {
-    TIXML_SNPRINTF( buffer, bufferSize, "%.17g", v );
+    char str[32];
+    CopyNumber( str, FormatDouble( v, str ), buffer, bufferSize );
 }
 
 template< >
 void XMLUtilT<wchar_t>::ToStr( double v, wchar_t* buffer, int bufferSize )
 {
-    TIXML_SNWPRINTF( buffer, bufferSize, L"%.17g", v );
+    char str[32];
+    CopyNumber( str, FormatDouble( v, str ), buffer, bufferSize );
 }
 
+#ifdef TINYXML2_CHAR16
 template< >
-bool XMLUtilT<char>::ToInt( const char* str, int* value )
+void XMLUtilT<char16_t>::ToStr( int v, char16_t* buffer, int bufferSize )
 {
-    if ( TIXML_SSCANF( str, "%d", value ) == 1 ) {
-        return true;
-    }
-    return false;
+    char str[24];
+    const unsigned long long mag = v < 0 ? 0ULL - static_cast<unsigned long long>( static_cast<long long>( v ) ) : static_cast<unsigned long long>( v );
+    CopyNumber( str, FormatInteger( mag, v < 0, str ), buffer, bufferSize );
 }
 
 template< >
-bool XMLUtilT<wchar_t>::ToInt( const wchar_t* str, int* value )
+void XMLUtilT<char16_t>::ToStr( unsigned v, char16_t* buffer, int bufferSize )
 {
-    if ( TIXML_SWSCANF( str, L"%d", value ) == 1 ) {
-        return true;
-    }
-    return false;
+    char str[24];
+    CopyNumber( str, FormatInteger( v, false, str ), buffer, bufferSize );
 }
 
 template< >
-bool XMLUtilT<char>::ToUnsigned( const char* str, unsigned* value )
+void XMLUtilT<char16_t>::ToStr( bool v, char16_t* buffer, int bufferSize )
 {
-    if ( TIXML_SSCANF( str, "%u", value ) == 1 ) {
-        return true;
-    }
-    return false;
+    CopyNumber( v ? "1" : "0", 1, buffer, bufferSize );
 }
 
 template< >
-bool XMLUtilT<wchar_t>::ToUnsigned( const wchar_t* str, unsigned* value )
+void XMLUtilT<char16_t>::ToStr( float v, char16_t* buffer, int bufferSize )
 {
-    if ( TIXML_SWSCANF( str, L"%u", value ) == 1 ) {
-        return true;
-    }
-    return false;
+    char str[32];
+    CopyNumber( str, FormatFloat( v, str ), buffer, bufferSize );
 }
 
 template< >
-bool XMLUtilT<char>::ToInt8( const char* str, char* value )
+void XMLUtilT<char16_t>::ToStr( double v, char16_t* buffer, int bufferSize )
 {
-    short shortValue = 0;
-    if ( TIXML_SSCANF( str, "%hd", &shortValue ) == 1 ) {
-        *value = (char) shortValue;
-        return true;
-    }
-    return false;
+    char str[32];
+    CopyNumber( str, FormatDouble( v, str ), buffer, bufferSize );
 }
+#endif
 
-template< >
-bool XMLUtilT<wchar_t>::ToInt8( const wchar_t* str, char* value )
+// --------- Number parsing ----------- //
+/*
+	The To*() conversions accept what the previous sscanf() based ones did
+	for well formed input: leading white space, an optional sign, and a
+	number followed by anything. They are independent of the current locale,
+	and reject integers that don't fit the destination type.
+
+	Floating point values with at most 19 significant digits and a small
+	exponent are computed exactly in double arithmetic (Clinger's fast
+	path). Up to 19 digits with any exponent are rounded from a 128 bit
+	product with a power of ten, unless that is too close to call. Those
+	and longer inputs are rounded by exact arithmetic on the decimal
+	digits, shifting them by powers of two until the binary mantissa is
+	an integer. Infinity, NaN and hexadecimal values are read
+	here as well; the C library isn't used, so the locale never matters.
+*/
+
+template<typename xchar>
+static inline bool IsScanSpace( xchar c )
 {
-    short shortValue = 0;
-    if ( TIXML_SWSCANF( str, L"%hd", &shortValue ) == 1 ) {
-        *value = (char) shortValue;
-        return true;
-    }
-    return false;
+    return c == ' ' || ( c >= '\t' && c <= '\r' );
 }
 
-template< >
-bool XMLUtilT<char>::ToUnsigned8( const char* str, unsigned char* value )
+template<typename xchar>
+static inline bool IsScanDigit( xchar c )
 {
-    unsigned short shortValue = 0;
-    if ( TIXML_SSCANF( str, "%hu", &shortValue ) == 1 ) {
-        *value = (unsigned char) shortValue;
-        return true;
-    }
-    return false;
+    return c >= '0' && c <= '9';
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToUnsigned8( const wchar_t* str, unsigned char* value )
+// Reads an optionally signed decimal integer whose magnitude is at most
+// 'negLimit' if negative, or 'posLimit' otherwise.
+template<typename xchar>
+static bool ParseInteger( const xchar* p, unsigned long long negLimit, unsigned long long posLimit,
+                          bool* negative, unsigned long long* magnitude )
 {
-    unsigned short shortValue = 0;
-    if ( TIXML_SWSCANF( str, L"%hu", &shortValue ) == 1 ) {
-        *value = (unsigned char) shortValue;
-        return true;
+    while ( IsScanSpace( *p ) ) {
+        ++p;
     }
-    return false;
+    bool neg = false;
+    if ( *p == '-' || *p == '+' ) {
+        neg = ( *p == '-' );
+        ++p;
+    }
+    if ( !IsScanDigit( *p ) ) {
+        return false;
+    }
+    const unsigned long long limit = neg ? negLimit : posLimit;
+    unsigned long long v = 0;
+    for( ; IsScanDigit( *p ); ++p ) {
+        const unsigned d = static_cast<unsigned>( *p - '0' );
+        if ( d > limit || v > ( limit - d ) / 10 ) {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    *negative = neg;
+    *magnitude = v;
+    return true;
 }
 
-template< >
-bool XMLUtilT<char>::ToInt16( const char* str, short* value )
+template<typename xchar, typename T>
+static bool ParseSigned( const xchar* str, long long minValue, long long maxValue, T* value )
 {
-    if ( TIXML_SSCANF( str, "%hd", value ) == 1 ) {
-        return true;
+    bool negative = false;
+    unsigned long long magnitude = 0;
+    if ( !ParseInteger( str, 0ULL - static_cast<unsigned long long>( minValue ), static_cast<unsigned long long>( maxValue ), &negative, &magnitude ) ) {
+        return false;
     }
-    return false;
+    if ( negative && magnitude ) {
+        // -(magnitude-1)-1 stays in range for the most negative value.
+        *value = static_cast<T>( -static_cast<long long>( magnitude - 1 ) - 1 );
+    }
+    else {
+        *value = static_cast<T>( magnitude );
+    }
+    return true;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToInt16( const wchar_t* str, short* value )
+template<typename xchar, typename T>
+static bool ParseUnsigned( const xchar* str, unsigned long long maxValue, T* value )
 {
-    if ( TIXML_SWSCANF( str, L"%hd", value ) == 1 ) {
-        return true;
+    bool negative = false;
+    unsigned long long magnitude = 0;
+    if ( !ParseInteger( str, 0, maxValue, &negative, &magnitude ) ) {
+        return false;
     }
-    return false;
+    *value = static_cast<T>( magnitude );
+    return true;
 }
 
-template< >
-bool XMLUtilT<char>::ToUnsigned16( const char* str, unsigned short* value )
+// A decimal floating point value: [-] digits * 10^exponent, with the
+// digits also accumulated in 'mantissa' while there are at most 19.
+struct DecimalNumber {
+    enum { MAX_DIGITS = 800 };	// more than enough to round any double correctly
+
+    bool negative;
+    bool truncated;		// nonzero digits past MAX_DIGITS were dropped
+    int count;
+    int exponent;
+    unsigned long long mantissa;
+    char digits[MAX_DIGITS];
+};
+
+// Returns 1 if a decimal number was read, 0 if there is no number, and
+// -1 for the forms (inf, nan, hexadecimal) left to the C library.
+template<typename xchar>
+static int ScanDecimal( const xchar* p, DecimalNumber* number )
 {
-    if ( TIXML_SSCANF( str, "%hu", value ) == 1 ) {
-        return true;
+    while ( IsScanSpace( *p ) ) {
+        ++p;
     }
-    return false;
+    number->negative = false;
+    number->truncated = false;
+    number->count = 0;
+    number->exponent = 0;
+    number->mantissa = 0;
+    if ( *p == '-' || *p == '+' ) {
+        number->negative = ( *p == '-' );
+        ++p;
+    }
+    if ( *p == 'i' || *p == 'I' || *p == 'n' || *p == 'N' || ( p[0] == '0' && ( p[1] == 'x' || p[1] == 'X' ) ) ) {
+        return -1;
+    }
+
+    bool sawDigit = false;
+    for( ; IsScanDigit( *p ); ++p ) {
+        sawDigit = true;
+        if ( number->count == 0 && *p == '0' ) {
+            continue;
+        }
+        if ( number->count < DecimalNumber::MAX_DIGITS ) {
+            number->mantissa = number->mantissa * 10 + static_cast<unsigned>( *p - '0' );
+            number->digits[number->count++] = static_cast<char>( *p );
+        }
+        else {
+            number->truncated = number->truncated || *p != '0';
+            ++number->exponent;
+        }
+    }
+    if ( *p == '.' ) {
+        for( ++p; IsScanDigit( *p ); ++p ) {
+            sawDigit = true;
+            if ( number->count == 0 && *p == '0' ) {
+                --number->exponent;
+                continue;
+            }
+            if ( number->count < DecimalNumber::MAX_DIGITS ) {
+                number->mantissa = number->mantissa * 10 + static_cast<unsigned>( *p - '0' );
+                number->digits[number->count++] = static_cast<char>( *p );
+                --number->exponent;
+            }
+            else {
+                number->truncated = number->truncated || *p != '0';
+            }
+        }
+    }
+    if ( !sawDigit ) {
+        return 0;
+    }
+    if ( ( *p == 'e' || *p == 'E' )
+         && ( IsScanDigit( p[1] ) || ( ( p[1] == '-' || p[1] == '+' ) && IsScanDigit( p[2] ) ) ) ) {
+        ++p;
+        const bool negativeExp = ( *p == '-' );
+        if ( *p == '-' || *p == '+' ) {
+            ++p;
+        }
+        int exp = 0;
+        for( ; IsScanDigit( *p ); ++p ) {
+            if ( exp < 100000 ) {
+                exp = exp * 10 + ( *p - '0' );
+            }
+        }
+        number->exponent += negativeExp ? -exp : exp;
+    }
+    return 1;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToUnsigned16( const wchar_t* str, unsigned short* value )
+static const double exactPowersOf10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Clinger's fast path: exact when both the digits and the power of ten are
+// exactly representable, as long as intermediates aren't kept in extended
+// precision. 'maxMantissa' and 'maxExponent' select the target precision.
+static bool FastDecimal( const DecimalNumber& number, unsigned long long maxMantissa, int maxExponent, double* value )
 {
-    if ( TIXML_SWSCANF( str, L"%hu", value ) == 1 ) {
-        return true;
-    }
+#if defined(FLT_EVAL_METHOD) && ( FLT_EVAL_METHOD != 0 )
     return false;
+#else
+    if ( number.count > 19 || number.mantissa > maxMantissa
+         || number.exponent < -maxExponent || number.exponent > maxExponent ) {
+        return false;
+    }
+    double d = static_cast<double>( number.mantissa );
+    if ( number.exponent < 0 ) {
+        d /= exactPowersOf10[-number.exponent];
+    }
+    else {
+        d *= exactPowersOf10[number.exponent];
+    }
+    *value = number.negative ? -d : d;
+    return true;
+#endif
 }
 
-template< >
-bool XMLUtilT<char>::ToInt64( const char* str, long long* value )
+// The layout of an IEEE binary format, to round into.
+struct BinaryFormat {
+    int mantissaBits;	// stored bits, without the implicit one
+    int exponentBits;
+    int bias;
+};
+static const BinaryFormat doubleFormat = { 52, 11, -1023 };
+static const BinaryFormat floatFormat = { 23, 8, -127 };
+
+// Products with 64 bit factors, done in 32 bit halves to stay portable.
+static void Multiply64( unsigned long long a, unsigned long long b, unsigned long long* high, unsigned long long* low )
+{
+    const unsigned long long mask = 0xFFFFFFFFULL;
+    const unsigned long long ll = ( a & mask ) * ( b & mask );
+    const unsigned long long lh = ( a & mask ) * ( b >> 32 );
+    const unsigned long long hl = ( a >> 32 ) * ( b & mask );
+    const unsigned long long hh = ( a >> 32 ) * ( b >> 32 );
+    const unsigned long long mid = ( ll >> 32 ) + ( lh & mask ) + ( hl & mask );
+    *high = hh + ( lh >> 32 ) + ( hl >> 32 ) + ( mid >> 32 );
+    *low = ( mid << 32 ) | ( ll & mask );
+}
+
+static int LeadingZeros64( unsigned long long v )
+{
+    TIXMLASSERT( v );
+    int n = 0;
+    for( int shift = 32; shift > 0; shift /= 2 ) {
+        if ( !( v >> ( 64 - shift ) ) ) {
+            v <<= shift;
+            n += shift;
+        }
+    }
+    return n;
+}
+
+// (high:low) * 2^exponent times m, truncated to 128 bits with the top bit
+// set. The operand must already be normalized that way.
+static void MultiplyNormalized( unsigned long long* high, unsigned long long* low, unsigned long long m, int* exponent )
+{
+    TIXMLASSERT( ( *high >> 63 ) && m );
+    const int zeros = LeadingZeros64( m );
+    m <<= zeros;
+    unsigned long long h1, l1, h2, l2;
+    Multiply64( *high, m, &h1, &l1 );
+    Multiply64( *low, m, &h2, &l2 );
+    unsigned long long r1 = l1 + h2;
+    unsigned long long r2 = h1 + ( r1 < l1 ? 1 : 0 );
+    // Both factors had their top bit set, so at most one bit is free.
+    int shift = 0;
+    if ( !( r2 >> 63 ) ) {
+        r2 = ( r2 << 1 ) | ( r1 >> 63 );
+        r1 = ( r1 << 1 ) | ( l2 >> 63 );
+        shift = 1;
+    }
+    *high = r2;
+    *low = r1;
+    *exponent += 64 - shift - zeros;
+}
+
+// 10^(19k) for k = -18..16, as (high:low) * 2^exponent, truncated.
+struct PowerOfTen {
+    unsigned long long high;
+    unsigned long long low;
+    int exponent;
+};
+static const PowerOfTen powersOf10[] = {
+    { 0xEEF453D6923BD65AULL, 0x113FAA2906A13B3FULL, -1264 },	// 1e-342
+    { 0x818995CE7AA0E1B2ULL, 0x7343EFEBD1940993ULL, -1200 },	// 1e-323
+    { 0x8C71DCD9BA0B4925ULL, 0x9FF0C08B7F1D0B14ULL, -1137 },	// 1e-304
+    { 0x9845418C345644D6ULL, 0x830A13896B78AAA9ULL, -1074 },	// 1e-285
+    { 0xA5178FFF668AE0B6ULL, 0x626E974DBE39A872ULL, -1011 },	// 1e-266
+    { 0xB2FE3F0B8599EF07ULL, 0x861FA7E6DCB4AA15ULL, -948 },	// 1e-247
+    { 0xC21094364DFB5636ULL, 0x985915FC12F542E4ULL, -885 },	// 1e-228
+    { 0xD267CAA862A12D66ULL, 0xD072DF63C324FD7BULL, -822 },	// 1e-209
+    { 0xE41F3D6A7377EECAULL, 0x20CABA5F1D9E4A93ULL, -759 },	// 1e-190
+    { 0xF7549530E188C128ULL, 0xD12BEE59E68EF47CULL, -696 },	// 1e-171
+    { 0x8613FD0145877585ULL, 0xBD06742CE95F5F36ULL, -632 },	// 1e-152
+    { 0x915E2486EF32CD60ULL, 0x0ACE1474DC1D122EULL, -569 },	// 1e-133
+    { 0x9D9BA7832936EDC0ULL, 0xD54B944B84AA4C0DULL, -506 },	// 1e-114
+    { 0xAAE103B5FCD2A881ULL, 0xD652BDC29F26A119ULL, -443 },	// 1e-95
+    { 0xB94470938FA89BCEULL, 0xF808E40E8D5B3E69ULL, -380 },	// 1e-76
+    { 0xC8DE047564D20A8BULL, 0xF245825A5A445275ULL, -317 },	// 1e-57
+    { 0xD9C7DCED53C72255ULL, 0x96E7BD358C904A21ULL, -254 },	// 1e-38
+    { 0xEC1E4A7DB69561A5ULL, 0x2B31E9E3D06C32E5ULL, -191 },	// 1e-19
+    { 0x8000000000000000ULL, 0x0000000000000000ULL, -127 },	// 1e0
+    { 0x8AC7230489E80000ULL, 0x0000000000000000ULL, -64 },	// 1e19
+    { 0x96769950B50D88F4ULL, 0x1314448000000000ULL, -1 },	// 1e38
+    { 0xA321F2D7226895C7ULL, 0xAFF72D52192B6A0DULL, 62 },	// 1e57
+    { 0xB0DE65388CC8ADA8ULL, 0x3B25A55F43294BCBULL, 125 },	// 1e76
+    { 0xBFC2EF456AE276E8ULL, 0x9E3FEDD8C321A67EULL, 188 },	// 1e95
+    { 0xCFE87F7CEF46FF16ULL, 0xE612641865679A63ULL, 251 },	// 1e114
+    { 0xE16A1DC9D8545E94ULL, 0xF4296DD6FEF3D67AULL, 314 },	// 1e133
+    { 0xF46518C2EF5B8CD1ULL, 0x7EB258665FC25D69ULL, 377 },	// 1e152
+    { 0x847C9B5D7C2E09B7ULL, 0x69956135FEBADA11ULL, 441 },	// 1e171
+    { 0x8FA475791A569D10ULL, 0xF96E017D694487BCULL, 504 },	// 1e190
+    { 0x9BBCC7A142B17CCBULL, 0x88A66076400BB691ULL, 567 },	// 1e209
+    { 0xA8D9D1535CE3B396ULL, 0x7F1839A741A14D0DULL, 630 },	// 1e228
+    { 0xB7118682DBB66A77ULL, 0x3FBC8C33221DC2A1ULL, 693 },	// 1e247
+    { 0xC67BB4597CE2CE48ULL, 0xB143C6053EDCD0D5ULL, 756 },	// 1e266
+    { 0xD732290FBACAF133ULL, 0xA97C177947AD4095ULL, 819 },	// 1e285
+    { 0xE950DF20247C83FDULL, 0x47C6B82EF32A2069ULL, 882 },	// 1e304
+};
+static const unsigned long long smallPowersOf10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL
+};
+
+// Up to 19 digits times any power of ten, from a 128 bit approximation of
+// the product (as in Eisel and Lemire's algorithm). The approximation is
+// never above the exact value and at most a few units of its last bit
+// below, so the rounding is known unless the product lies that close to
+// a half way point. Returns false for those, and for deep subnormals.
+static bool ScaledDecimal( const DecimalNumber& number, const BinaryFormat& format, double* value )
 {
-    if ( TIXML_SSCANF( str, "%lld", value ) == 1 ) {
-        return true;
+    static const unsigned long long SLACK = 32;
+    if ( number.count == 0 || number.count > 19 ) {
+        return false;
     }
-    return false;
+    double d = 0;
+    if ( number.exponent < -342 ) {
+        // Less than half the smallest subnormal.
+        d = 0;
+    }
+    else if ( number.exponent > 308 ) {
+        d = HUGE_VAL;
+    }
+    else {
+        const int index = ( number.exponent + 342 ) / 19;
+        const PowerOfTen& power = powersOf10[index];
+        unsigned long long high = power.high;
+        unsigned long long low = power.low;
+        int exponent = power.exponent;
+        const int rest = number.exponent + 342 - 19 * index;
+        if ( rest ) {
+            MultiplyNormalized( &high, &low, smallPowersOf10[rest], &exponent );
+        }
+        MultiplyNormalized( &high, &low, number.mantissa, &exponent );
+
+        const int minExponent = format.bias + 1;
+        const int maxExponent = format.bias + ( 1 << format.exponentBits ) - 2;
+        // The leading bit is 2^top.
+        const int top = exponent + 127;
+        if ( top > maxExponent ) {
+            d = HUGE_VAL;
+        }
+        else {
+            int keep = format.mantissaBits + 1;
+            if ( top < minExponent ) {
+                keep -= minExponent - top;
+                if ( keep < 1 ) {
+                    return false;
+                }
+            }
+            const int dropped = 64 - keep;
+            unsigned long long mantissa = high >> dropped;
+            const unsigned long long below = high & ( ( 1ULL << dropped ) - 1 );
+            const unsigned long long half = 1ULL << ( dropped - 1 );
+            if ( below > half || ( below == half && low > 0 ) ) {
+                ++mantissa;
+                if ( top == maxExponent && ( mantissa >> keep ) ) {
+                    d = HUGE_VAL;
+                }
+            }
+            else if ( !( below + 1 < half || ( below + 1 == half && low <= ~0ULL - SLACK ) ) ) {
+                return false;
+            }
+            if ( d == 0 ) {
+                d = ldexp( static_cast<double>( mantissa ), top - keep + 1 );
+            }
+        }
+    }
+    *value = number.negative ? -d : d;
+    return true;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToInt64( const wchar_t* str, long long* value )
+// The slow path works on the digits of a DecimalNumber, with the decimal
+// point before digits[point]. Multiplying or dividing by 2^k is exact as
+// long as the digits fit; past MAX_DIGITS only 'truncated' is kept, which
+// is all rounding needs.
+enum { MAX_DECIMAL_SHIFT = 60 };	// keeps the carry in 64 bits
+
+static void TrimDecimal( DecimalNumber* number, int* point )
 {
-    if ( TIXML_SWSCANF( str, L"%lld", value ) == 1 ) {
-        return true;
+    while ( number->count > 0 && number->digits[number->count-1] == '0' ) {
+        --number->count;
+    }
+    if ( number->count == 0 ) {
+        *point = 0;
     }
-    return false;
 }
 
-template< >
-bool XMLUtilT<char>::ToUnsigned64( const char* str, unsigned long long* value )
+static void LeftShiftDecimal( DecimalNumber* number, int* point, unsigned k )
 {
-    if ( TIXML_SSCANF( str, "%llu", value ) == 1 ) {
-        return true;
+    // Written from the end, since the length isn't known up front.
+    char shifted[DecimalNumber::MAX_DIGITS + 20];
+    int w = sizeof( shifted );
+    unsigned long long acc = 0;
+    for( int r = number->count - 1; r >= 0; --r ) {
+        acc += static_cast<unsigned long long>( number->digits[r] - '0' ) << k;
+        shifted[--w] = static_cast<char>( '0' + acc % 10 );
+        acc /= 10;
     }
-    return false;
+    for( ; acc > 0; acc /= 10 ) {
+        shifted[--w] = static_cast<char>( '0' + acc % 10 );
+    }
+    int length = static_cast<int>( sizeof( shifted ) ) - w;
+    *point += length - number->count;
+    for( int i = DecimalNumber::MAX_DIGITS; i < length; ++i ) {
+        number->truncated = number->truncated || shifted[w + i] != '0';
+    }
+    if ( length > DecimalNumber::MAX_DIGITS ) {
+        length = DecimalNumber::MAX_DIGITS;
+    }
+    memcpy( number->digits, shifted + w, length );
+    number->count = length;
+    TrimDecimal( number, point );
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToUnsigned64( const wchar_t* str, unsigned long long* value )
+static void RightShiftDecimal( DecimalNumber* number, int* point, unsigned k )
 {
-    if ( TIXML_SWSCANF( str, L"%llu", value ) == 1 ) {
-        return true;
+    int r = 0;
+    int w = 0;
+    unsigned long long acc = 0;
+    // Read until there is a first digit to write.
+    for( ; ( acc >> k ) == 0; ++r ) {
+        if ( r >= number->count ) {
+            if ( acc == 0 ) {
+                number->count = 0;
+                return;
+            }
+            while ( ( acc >> k ) == 0 ) {
+                acc *= 10;
+                ++r;
+            }
+            break;
+        }
+        acc = acc * 10 + static_cast<unsigned>( number->digits[r] - '0' );
+    }
+    *point -= r - 1;
+
+    const unsigned long long mask = ( 1ULL << k ) - 1;
+    for( ; r < number->count; ++r ) {
+        const unsigned long long digit = acc >> k;
+        acc &= mask;
+        number->digits[w++] = static_cast<char>( '0' + digit );
+        acc = acc * 10 + static_cast<unsigned>( number->digits[r] - '0' );
+    }
+    for( ; acc > 0; acc *= 10 ) {
+        const unsigned long long digit = acc >> k;
+        acc &= mask;
+        if ( w < DecimalNumber::MAX_DIGITS ) {
+            number->digits[w++] = static_cast<char>( '0' + digit );
+        }
+        else if ( digit > 0 ) {
+            number->truncated = true;
+        }
     }
-    return false;
+    number->count = w;
+    TrimDecimal( number, point );
 }
 
-template< >
-bool XMLUtilT<char>::ToBool( const char* str, bool* value )
+// Multiplies by 2^shift, or divides for a negative shift.
+static void ShiftDecimal( DecimalNumber* number, int* point, int shift )
 {
-    int ival = 0;
-    if ( ToInt( str, &ival )) {
-        *value = (ival==0) ? false : true;
-        return true;
+    if ( number->count == 0 ) {
+        return;
     }
-    if ( StringEqual( str, "true" ) ) {
-        *value = true;
-        return true;
+    for( ; shift > MAX_DECIMAL_SHIFT; shift -= MAX_DECIMAL_SHIFT ) {
+        LeftShiftDecimal( number, point, MAX_DECIMAL_SHIFT );
     }
-    else if ( StringEqual( str, "false" ) ) {
-        *value = false;
-        return true;
+    for( ; shift < -MAX_DECIMAL_SHIFT; shift += MAX_DECIMAL_SHIFT ) {
+        RightShiftDecimal( number, point, MAX_DECIMAL_SHIFT );
+    }
+    if ( shift > 0 ) {
+        LeftShiftDecimal( number, point, static_cast<unsigned>( shift ) );
+    }
+    else if ( shift < 0 ) {
+        RightShiftDecimal( number, point, static_cast<unsigned>( -shift ) );
     }
-    return false;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToBool( const wchar_t* str, bool* value )
+// The integer part, rounded half to even.
+static unsigned long long RoundDecimal( const DecimalNumber& number, int point )
 {
-    int ival = 0;
-    if ( ToInt( str, &ival )) {
-        *value = (ival==0) ? false : true;
-        return true;
+    TIXMLASSERT( point <= 20 );
+    unsigned long long n = 0;
+    int i = 0;
+    for( ; i < point && i < number.count; ++i ) {
+        n = n * 10 + static_cast<unsigned>( number.digits[i] - '0' );
     }
-    if ( StringEqual( str, L"true" ) ) {
-        *value = true;
-        return true;
+    for( ; i < point; ++i ) {
+        n *= 10;
     }
-    else if ( StringEqual( str, L"false" ) ) {
-        *value = false;
-        return true;
+    if ( point >= 0 && point < number.count ) {
+        const char next = number.digits[point];
+        if ( next == '5' && point + 1 == number.count && !number.truncated ) {
+            // Exactly half way.
+            n += ( n & 1 );
+        }
+        else if ( next >= '5' ) {
+            ++n;
+        }
     }
-    return false;
+    return n;
 }
 
-template< >
-bool XMLUtilT<char>::ToFloat( const char* str, float* value )
+// Correctly rounded conversion of any decimal number. The digits are
+// scaled into [1/2, 1) by powers of two, then shifted left by the number
+// of mantissa bits and rounded to an integer.
+static double DecimalToBinary( DecimalNumber* number, const BinaryFormat& format )
 {
-    if ( TIXML_SSCANF( str, "%f", value ) == 1 ) {
-        return true;
+    // Shifts that take 1 to 9 decimal digits below 1, without overshooting.
+    static const int powerShifts[] = { 1, 3, 6, 9, 13, 16, 19, 23, 26 };
+    static const int MAX_POWER = sizeof( powerShifts ) / sizeof( powerShifts[0] );
+    const int minExponent = format.bias + 1;
+    const int maxExponent = format.bias + ( 1 << format.exponentBits ) - 2;
+
+    int point = number->count + number->exponent;
+    double d = 0;
+    if ( number->count == 0 || point < -330 ) {
+        d = 0;
     }
-    return false;
+    else if ( point > 310 ) {
+        d = HUGE_VAL;
+    }
+    else {
+        int exponent = 0;
+        while ( point > 0 ) {
+            const int shift = ( point >= MAX_POWER ) ? 27 : powerShifts[point];
+            ShiftDecimal( number, &point, -shift );
+            exponent += shift;
+        }
+        while ( point < 0 || ( point == 0 && number->digits[0] < '5' ) ) {
+            const int shift = ( -point >= MAX_POWER ) ? 27 : powerShifts[-point];
+            ShiftDecimal( number, &point, shift );
+            exponent -= shift;
+        }
+        // Now in [1/2, 1): the leading bit is 2^exponent.
+        --exponent;
+        if ( exponent < minExponent ) {
+            // Subnormal: keep fewer bits.
+            ShiftDecimal( number, &point, exponent - minExponent );
+            exponent = minExponent;
+        }
+        if ( exponent > maxExponent ) {
+            d = HUGE_VAL;
+        }
+        else {
+            ShiftDecimal( number, &point, format.mantissaBits + 1 );
+            unsigned long long mantissa = RoundDecimal( *number, point );
+            if ( mantissa == ( 2ULL << format.mantissaBits ) ) {
+                // Rounding carried into a new bit.
+                mantissa >>= 1;
+                ++exponent;
+            }
+            d = ( exponent > maxExponent ) ? HUGE_VAL : ldexp( static_cast<double>( mantissa ), exponent - format.mantissaBits );
+        }
+    }
+    return number->negative ? -d : d;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToFloat( const wchar_t* str, float* value )
+// Rounds mantissa * 2^exponent, where 'sticky' stands for nonzero bits
+// below the mantissa, half to even.
+static double RoundBinary( unsigned long long mantissa, int exponent, bool sticky, const BinaryFormat& format )
 {
-    if ( TIXML_SWSCANF( str, L"%f", value ) == 1 ) {
-        return true;
+    const int minExponent = format.bias + 1;
+    const int maxExponent = format.bias + ( 1 << format.exponentBits ) - 2;
+    if ( mantissa == 0 ) {
+        return 0;
     }
-    return false;
+    while ( !( mantissa >> 63 ) ) {
+        mantissa <<= 1;
+        --exponent;
+    }
+    // The leading bit is 2^top.
+    const int top = exponent + 63;
+    if ( top > maxExponent ) {
+        return HUGE_VAL;
+    }
+    int keep = format.mantissaBits + 1;
+    if ( top < minExponent ) {
+        keep -= minExponent - top;
+    }
+    if ( keep < 0 ) {
+        return 0;
+    }
+    unsigned long long kept = keep ? ( mantissa >> ( 64 - keep ) ) : 0;
+    const unsigned long long rest = keep ? ( mantissa << keep ) : mantissa;
+    const bool half = ( rest >> 63 ) != 0;
+    const bool above = sticky || ( rest << 1 ) != 0;
+    if ( half && ( above || ( kept & 1 ) ) ) {
+        ++kept;
+        if ( top == maxExponent && ( kept >> keep ) ) {
+            return HUGE_VAL;
+        }
+    }
+    return ldexp( static_cast<double>( kept ), top - keep + 1 );
 }
 
-template< >
-bool XMLUtilT<char>::ToDouble( const char* str, double* value )
+template<typename xchar>
+static inline bool MatchesNoCase( const xchar* p, const char* word )
 {
-    if ( TIXML_SSCANF( str, "%lf", value ) == 1 ) {
-        return true;
+    for( ; *word; ++p, ++word ) {
+        if ( *p != *word && *p != *word - 'a' + 'A' ) {
+            return false;
+        }
     }
-    return false;
+    return true;
 }
 
-template< >
-bool XMLUtilT<wchar_t>::ToDouble( const wchar_t* str, double* value )
+template<typename xchar>
+static inline int HexDigitValue( xchar c )
 {
-    if ( TIXML_SWSCANF( str, L"%lf", value ) == 1 ) {
-        return true;
+    if ( c >= '0' && c <= '9' ) {
+        return c - '0';
     }
-    return false;
+    if ( c >= 'a' && c <= 'f' ) {
+        return c - 'a' + 10;
+    }
+    if ( c >= 'A' && c <= 'F' ) {
+        return c - 'A' + 10;
+    }
+    return -1;
 }
 
-
+// Infinity, NaN and hexadecimal values, as ScanDecimal() leaves them.
 template<typename xchar>
-xchar* XMLDocumentT<xchar>::Identify( xchar* p, XMLNodeT<xchar>** node )
+static bool ScanSpecial( const xchar* p, const BinaryFormat& format, double* value )
 {
-    TIXMLASSERT( node );
-    TIXMLASSERT( p );
-    xchar* const start = p;
-    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-    if( !*p ) {
-        *node = 0;
-        TIXMLASSERT( p );
-        return p;
+    while ( IsScanSpace( *p ) ) {
+        ++p;
     }
-
-    // These strings define the matching patterns:
-    static const xchar xmlHeader[]		= { '<', '?', 0 };
-    static const xchar commentHeader[]	= { '<', '!', '-', '-', 0 };
-    static const xchar cdataHeader[]		= { '<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[', 0 };
-    static const xchar dtdHeader[]		= { '<', '!', 0 };
-    static const xchar elementHeader[]	= { '<', 0 };	// and a header for everything else; check last.
-
-    static const int xmlHeaderLen		= 2;
-    static const int commentHeaderLen	= 4;
-    static const int cdataHeaderLen		= 9;
-    static const int dtdHeaderLen		= 2;
-    static const int elementHeaderLen	= 1;
-
-    TIXMLASSERT( sizeof( XMLComment ) == sizeof( XMLUnknownT<xchar> ) );		// use same memory pool
-    TIXMLASSERT( sizeof( XMLComment ) == sizeof( XMLDeclarationT<xchar> ) );	// use same memory pool
-    XMLNodeT<xchar>* returnNode = 0;
-    if ( XMLUtilT<xchar>::StringEqual( p, xmlHeader, xmlHeaderLen ) ) {
-        TIXMLASSERT( sizeof( XMLDeclaration ) == _commentPool.ItemSize() );
-        returnNode = new (_commentPool.Alloc()) XMLDeclarationT<xchar>( this );
-        returnNode->_memPool = &_commentPool;
-        p += xmlHeaderLen;
-    }
-    else if ( XMLUtilT<xchar>::StringEqual( p, commentHeader, commentHeaderLen ) ) {
-        TIXMLASSERT( sizeof( XMLCommentT<xchar> ) == _commentPool.ItemSize() );
-        returnNode = new (_commentPool.Alloc()) XMLCommentT<xchar>( this );
-        returnNode->_memPool = &_commentPool;
-        p += commentHeaderLen;
+    bool negative = false;
+    if ( *p == '-' || *p == '+' ) {
+        negative = ( *p == '-' );
+        ++p;
     }
-    else if ( XMLUtilT<xchar>::StringEqual( p, cdataHeader, cdataHeaderLen ) ) {
-        TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
-        XMLTextT<xchar>* text = new (_textPool.Alloc()) XMLTextT<xchar>( this );
-        returnNode = text;
-        returnNode->_memPool = &_textPool;
-        p += cdataHeaderLen;
-        text->SetCData( true );
+    double d = 0;
+    if ( MatchesNoCase( p, "inf" ) ) {
+        d = HUGE_VAL;
     }
-    else if ( XMLUtilT<xchar>::StringEqual( p, dtdHeader, dtdHeaderLen ) ) {
-        TIXMLASSERT( sizeof( XMLUnknownT<xchar> ) == _commentPool.ItemSize() );
-        returnNode = new (_commentPool.Alloc()) XMLUnknownT<xchar>( this );
-        returnNode->_memPool = &_commentPool;
-        p += dtdHeaderLen;
+    else if ( MatchesNoCase( p, "nan" ) ) {
+        const double inf = HUGE_VAL;
+        d = inf - inf;
     }
-    else if ( XMLUtilT<xchar>::StringEqual( p, elementHeader, elementHeaderLen ) ) {
-        TIXMLASSERT( sizeof( XMLElementT<xchar> ) == _elementPool.ItemSize() );
-        returnNode = new (_elementPool.Alloc()) XMLElementT<xchar>( this );
-        returnNode->_memPool = &_elementPool;
-        p += elementHeaderLen;
+    else if ( p[0] == '0' && ( p[1] == 'x' || p[1] == 'X' ) ) {
+        // Up to 60 bits of mantissa; later nonzero digits only set 'sticky'.
+        p += 2;
+        unsigned long long mantissa = 0;
+        int exponent = 0;
+        bool sticky = false;
+        bool sawDigit = false;
+        bool fraction = false;
+        for( ;; ++p ) {
+            if ( *p == '.' && !fraction ) {
+                fraction = true;
+                continue;
+            }
+            const int digit = HexDigitValue( *p );
+            if ( digit < 0 ) {
+                break;
+            }
+            sawDigit = true;
+            if ( mantissa >> 56 ) {
+                sticky = sticky || digit != 0;
+                exponent += fraction ? 0 : 4;
+            }
+            else {
+                mantissa = mantissa * 16 + static_cast<unsigned>( digit );
+                exponent -= fraction ? 4 : 0;
+            }
+        }
+        if ( sawDigit && ( *p == 'p' || *p == 'P' )
+             && ( IsScanDigit( p[1] ) || ( ( p[1] == '-' || p[1] == '+' ) && IsScanDigit( p[2] ) ) ) ) {
+            ++p;
+            const bool negativeExp = ( *p == '-' );
+            if ( *p == '-' || *p == '+' ) {
+                ++p;
+            }
+            int exp = 0;
+            for( ; IsScanDigit( *p ); ++p ) {
+                if ( exp < 100000 ) {
+                    exp = exp * 10 + ( *p - '0' );
+                }
+            }
+            exponent += negativeExp ? -exp : exp;
+        }
+        // A bare "0x" is the number 0 followed by text.
+        d = sawDigit ? RoundBinary( mantissa, exponent, sticky, format ) : 0;
     }
     else {
-        TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
-        returnNode = new (_textPool.Alloc()) XMLTextT<xchar>( this );
-        returnNode->_memPool = &_textPool;
-        p = start;	// Back it up, all the text counts.
+        return false;
     }
-
-    TIXMLASSERT( returnNode );
-    TIXMLASSERT( p );
-    *node = returnNode;
-    return p;
+    *value = negative ? -d : d;
+    return true;
 }
 
-
 template<typename xchar>
-bool XMLDocumentT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+static bool ParseDouble( const xchar* str, double* value )
 {
-    TIXMLASSERT( visitor );
-    if ( visitor->VisitEnter( *this ) ) {
-        for ( const XMLNodeT<xchar>* node=FirstChild(); node; node=node->NextSibling() ) {
-            if ( !node->Accept( visitor ) ) {
-                break;
-            }
-        }
+    DecimalNumber number;
+    const int scanned = ScanDecimal( str, &number );
+    if ( scanned < 0 ) {
+        return ScanSpecial( str, doubleFormat, value );
     }
-    return visitor->VisitExit( *this );
+    if ( scanned == 0 ) {
+        return false;
+    }
+    if ( !FastDecimal( number, 1ULL << 53, 22, value ) && !ScaledDecimal( number, doubleFormat, value ) ) {
+        *value = DecimalToBinary( &number, doubleFormat );
+    }
+    return true;
 }
 
-
-// --------- XMLNode ----------- //
 template<typename xchar>
-XMLNodeT<xchar>::XMLNodeT( XMLDocumentT<xchar>* doc ) :
-    _document( doc ),
-    _parent( 0 ),
-    _firstChild( 0 ), _lastChild( 0 ),
-    _prev( 0 ), _next( 0 ),
-    _memPool( 0 )
+static bool ParseFloat( const xchar* str, float* value )
+{
+    DecimalNumber number;
+    const int scanned = ScanDecimal( str, &number );
+    // Exact float operands give a double that rounds to float correctly,
+    // since double has more than twice the precision of float. The other
+    // paths round to float precision, so the result is exact in double.
+    double d = 0;
+    if ( scanned < 0 ) {
+        if ( !ScanSpecial( str, floatFormat, &d ) ) {
+            return false;
+        }
+    }
+    else if ( scanned == 0 ) {
+        return false;
+    }
+    else if ( !FastDecimal( number, 1ULL << 24, 10, &d ) && !ScaledDecimal( number, floatFormat, &d ) ) {
+        d = DecimalToBinary( &number, floatFormat );
+    }
+    *value = static_cast<float>( d );
+    return true;
+}
+
+template< >
+bool XMLUtilT<char>::ToInt( const char* str, int* value )
 {
+    return ParseSigned( str, INT_MIN, INT_MAX, value );
 }
 
-template<typename xchar>
-XMLNodeT<xchar>::~XMLNodeT()
+template< >
+bool XMLUtilT<wchar_t>::ToInt( const wchar_t* str, int* value )
 {
-    DeleteChildren();
-    if ( _parent ) {
-        _parent->Unlink( this );
-    }
+    return ParseSigned( str, INT_MIN, INT_MAX, value );
 }
 
-template<typename xchar>
-const xchar* XMLNodeT<xchar>::Value() const 
+template< >
+bool XMLUtilT<char>::ToUnsigned( const char* str, unsigned* value )
 {
-    // Catch an edge case: XMLDocuments don't have a a Value. Carefully return nullptr.
-    if ( this->ToDocument() )
-        return 0;
-    return _value.GetStr();
+    return ParseUnsigned( str, UINT_MAX, value );
 }
 
-template<typename xchar>
-void XMLNodeT<xchar>::SetValue( const xchar* str, bool staticMem )
+template< >
+bool XMLUtilT<wchar_t>::ToUnsigned( const wchar_t* str, unsigned* value )
 {
-    if ( staticMem ) {
-        _value.SetInternedStr( str );
-    }
-    else {
-        _value.SetStr( str );
-    }
+    return ParseUnsigned( str, UINT_MAX, value );
 }
 
-template<typename xchar>
-void XMLNodeT<xchar>::DeleteChildren()
+template< >
+bool XMLUtilT<char>::ToInt8( const char* str, char* value )
 {
-    while( _firstChild ) {
-        TIXMLASSERT( _lastChild );
-        TIXMLASSERT( _firstChild->_document == _document );
-        XMLNodeT<xchar>* node = _firstChild;
-        Unlink( node );
+    return ParseSigned( str, SCHAR_MIN, SCHAR_MAX, value );
+}
 
-        DeleteNode( node );
-    }
-    _firstChild = _lastChild = 0;
+template< >
+bool XMLUtilT<wchar_t>::ToInt8( const wchar_t* str, char* value )
+{
+    return ParseSigned( str, SCHAR_MIN, SCHAR_MAX, value );
 }
 
-template<typename xchar>
-void XMLNodeT<xchar>::Unlink( XMLNodeT<xchar>* child )
+template< >
+bool XMLUtilT<char>::ToUnsigned8( const char* str, unsigned char* value )
 {
-    TIXMLASSERT( child );
-    TIXMLASSERT( child->_document == _document );
-    TIXMLASSERT( child->_parent == this );
-    if ( child == _firstChild ) {
-        _firstChild = _firstChild->_next;
-    }
-    if ( child == _lastChild ) {
-        _lastChild = _lastChild->_prev;
-    }
+    return ParseUnsigned( str, UCHAR_MAX, value );
+}
 
-    if ( child->_prev ) {
-        child->_prev->_next = child->_next;
-    }
-    if ( child->_next ) {
-        child->_next->_prev = child->_prev;
-    }
-	child->_parent = 0;
+template< >
+bool XMLUtilT<wchar_t>::ToUnsigned8( const wchar_t* str, unsigned char* value )
+{
+    return ParseUnsigned( str, UCHAR_MAX, value );
 }
 
-template<typename xchar>
-void XMLNodeT<xchar>::DeleteChild( XMLNodeT<xchar>* node )
+template< >
+bool XMLUtilT<char>::ToInt16( const char* str, short* value )
 {
-    TIXMLASSERT( node );
-    TIXMLASSERT( node->_document == _document );
-    TIXMLASSERT( node->_parent == this );
-    DeleteNode( node );
+    return ParseSigned( str, SHRT_MIN, SHRT_MAX, value );
 }
 
-template<typename xchar>
-XMLNodeT<xchar>* XMLNodeT<xchar>::InsertEndChild( XMLNodeT<xchar>* addThis )
+template< >
+bool XMLUtilT<wchar_t>::ToInt16( const wchar_t* str, short* value )
 {
-    TIXMLASSERT( addThis );
-    if ( addThis->_document != _document ) {
-        TIXMLASSERT( false );
-        return 0;
-    }
-    InsertChildPreamble( addThis );
+    return ParseSigned( str, SHRT_MIN, SHRT_MAX, value );
+}
 
-    if ( _lastChild ) {
-        TIXMLASSERT( _firstChild );
-        TIXMLASSERT( _lastChild->_next == 0 );
-        _lastChild->_next = addThis;
-        addThis->_prev = _lastChild;
-        _lastChild = addThis;
+template< >
+bool XMLUtilT<char>::ToUnsigned16( const char* str, unsigned short* value )
+{
+    return ParseUnsigned( str, USHRT_MAX, value );
+}
 
-        addThis->_next = 0;
-    }
-    else {
-        TIXMLASSERT( _firstChild == 0 );
-        _firstChild = _lastChild = addThis;
+template< >
+bool XMLUtilT<wchar_t>::ToUnsigned16( const wchar_t* str, unsigned short* value )
+{
+    return ParseUnsigned( str, USHRT_MAX, value );
+}
 
-        addThis->_prev = 0;
-        addThis->_next = 0;
-    }
-    addThis->_parent = this;
-    return addThis;
+template< >
+bool XMLUtilT<char>::ToInt64( const char* str, long long* value )
+{
+    return ParseSigned( str, LLONG_MIN, LLONG_MAX, value );
 }
 
-template<typename xchar>
-XMLNodeT<xchar>* XMLNodeT<xchar>::InsertFirstChild( XMLNodeT<xchar>* addThis )
+template< >
+bool XMLUtilT<wchar_t>::ToInt64( const wchar_t* str, long long* value )
 {
-    TIXMLASSERT( addThis );
-    if ( addThis->_document != _document ) {
-        TIXMLASSERT( false );
-        return 0;
-    }
-    InsertChildPreamble( addThis );
+    return ParseSigned( str, LLONG_MIN, LLONG_MAX, value );
+}
 
-    if ( _firstChild ) {
-        TIXMLASSERT( _lastChild );
-        TIXMLASSERT( _firstChild->_prev == 0 );
+template< >
+bool XMLUtilT<char>::ToUnsigned64( const char* str, unsigned long long* value )
+{
+    return ParseUnsigned( str, ULLONG_MAX, value );
+}
 
-        _firstChild->_prev = addThis;
-        addThis->_next = _firstChild;
-        _firstChild = addThis;
+template< >
+bool XMLUtilT<wchar_t>::ToUnsigned64( const wchar_t* str, unsigned long long* value )
+{
+    return ParseUnsigned( str, ULLONG_MAX, value );
+}
 
-        addThis->_prev = 0;
+template< >
+bool XMLUtilT<char>::ToBool( const char* str, bool* value )
+{
+    int ival = 0;
+    if ( ToInt( str, &ival )) {
+        *value = (ival==0) ? false : true;
+        return true;
     }
-    else {
-        TIXMLASSERT( _lastChild == 0 );
-        _firstChild = _lastChild = addThis;
-
-        addThis->_prev = 0;
-        addThis->_next = 0;
+    if ( StringEqual( str, "true" ) ) {
+        *value = true;
+        return true;
     }
-    addThis->_parent = this;
-    return addThis;
+    else if ( StringEqual( str, "false" ) ) {
+        *value = false;
+        return true;
+    }
+    return false;
 }
 
-template<typename xchar>
-XMLNodeT<xchar>* XMLNodeT<xchar>::InsertAfterChild( XMLNodeT<xchar>* afterThis, XMLNodeT<xchar>* addThis )
+template< >
+bool XMLUtilT<wchar_t>::ToBool( const wchar_t* str, bool* value )
 {
-    TIXMLASSERT( addThis );
-    if ( addThis->_document != _document ) {
-        TIXMLASSERT( false );
-        return 0;
+    int ival = 0;
+    if ( ToInt( str, &ival )) {
+        *value = (ival==0) ? false : true;
+        return true;
     }
-
-    TIXMLASSERT( afterThis );
-
-    if ( afterThis->_parent != this ) {
-        TIXMLASSERT( false );
-        return 0;
+    if ( StringEqual( str, L"true" ) ) {
+        *value = true;
+        return true;
     }
-
-    if ( afterThis->_next == 0 ) {
-        // The last node or the only node.
-        return InsertEndChild( addThis );
+    else if ( StringEqual( str, L"false" ) ) {
+        *value = false;
+        return true;
     }
-    InsertChildPreamble( addThis );
-    addThis->_prev = afterThis;
-    addThis->_next = afterThis->_next;
-    afterThis->_next->_prev = addThis;
-    afterThis->_next = addThis;
-    addThis->_parent = this;
-    return addThis;
+    return false;
 }
 
+template< >
+bool XMLUtilT<char>::ToFloat( const char* str, float* value )
+{
+    return ParseFloat( str, value );
+}
 
-template<typename xchar>
-const XMLElementT<xchar>* XMLNodeT<xchar>::FirstChildElement( const xchar* name ) const
+template< >
+bool XMLUtilT<wchar_t>::ToFloat( const wchar_t* str, float* value )
 {
-    for( const XMLNodeT<xchar>* node = _firstChild; node; node = node->_next ) {
-        const XMLElementT<xchar>* element = node->ToElement();
-        if ( element ) {
-            if ( !name || XMLUtilT<xchar>::StringEqual( element->Name(), name ) ) {
-                return element;
-            }
-        }
-    }
-    return 0;
+    return ParseFloat( str, value );
 }
 
-template<typename xchar>
-const XMLElementT<xchar>* XMLNodeT<xchar>::LastChildElement( const xchar* name ) const
+template< >
+bool XMLUtilT<char>::ToDouble( const char* str, double* value )
 {
-    for( const XMLNodeT<xchar>* node = _lastChild; node; node = node->_prev ) {
-        const XMLElementT<xchar>* element = node->ToElement();
-        if ( element ) {
-            if ( !name || XMLUtilT<xchar>::StringEqual( element->Name(), name ) ) {
-                return element;
-            }
-        }
-    }
-    return 0;
+    return ParseDouble( str, value );
 }
 
-template<typename xchar>
-const XMLElementT<xchar>* XMLNodeT<xchar>::NextSiblingElement( const xchar* name ) const
+template< >
+bool XMLUtilT<wchar_t>::ToDouble( const wchar_t* str, double* value )
 {
-    for( const XMLNodeT<xchar>* node = _next; node; node = node->_next ) {
-        const XMLElementT<xchar>* element = node->ToElement();
-        if ( element
-                && (!name || XMLUtilT<xchar>::StringEqual( name, element->Name() ))) {
-            return element;
-        }
-    }
-    return 0;
+    return ParseDouble( str, value );
 }
 
-template<typename xchar>
-const XMLElementT<xchar>* XMLNodeT<xchar>::PreviousSiblingElement( const xchar* name ) const
+#ifdef TINYXML2_CHAR16
+template< >
+bool XMLUtilT<char16_t>::ToInt( const char16_t* str, int* value )
 {
-    for( const XMLNodeT<xchar>* node = _prev; node; node = node->_prev ) {
-        const XMLElementT<xchar>* element = node->ToElement();
-        if ( element
-                && (!name || XMLUtilT<xchar>::StringEqual( name, element->Name() ))) {
-            return element;
-        }
-    }
-    return 0;
+    return ParseSigned( str, INT_MIN, INT_MAX, value );
 }
 
-template<typename xchar>
-xchar* XMLNodeT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* parentEnd )
+template< >
+bool XMLUtilT<char16_t>::ToUnsigned( const char16_t* str, unsigned* value )
 {
-    // This is a recursive method, but thinking about it "at the current level"
-    // it is a pretty simple flat list:
-    //		<foo/>
-    //		<!-- comment -->
-    //
-    // With a special case:
-    //		<foo>
-    //		</foo>
-    //		<!-- comment -->
-    //
-    // Where the closing element (/foo) *must* be the next thing after the opening
-    // element, and the names must match. BUT the tricky bit is that the closing
-    // element will be read by the child.
-    //
-    // 'endTag' is the end tag for this node, it is returned by a call to a child.
-    // 'parentEnd' is the end tag for the parent, which is filled in and returned.
+    return ParseUnsigned( str, UINT_MAX, value );
+}
 
-    while( p && *p ) {
-        XMLNodeT<xchar>* node = 0;
+template< >
+bool XMLUtilT<char16_t>::ToInt8( const char16_t* str, char* value )
+{
+    return ParseSigned( str, SCHAR_MIN, SCHAR_MAX, value );
+}
 
-        p = _document->Identify( p, &node );
-        if ( node == 0 ) {
-            break;
-        }
+template< >
+bool XMLUtilT<char16_t>::ToUnsigned8( const char16_t* str, unsigned char* value )
+{
+    return ParseUnsigned( str, UCHAR_MAX, value );
+}
 
-        StrPairT<xchar> endTag;
-        p = node->ParseDeep( p, &endTag );
-        if ( !p ) {
-            DeleteNode( node );
-            if ( !_document->Error() ) {
-                _document->SetError( XML_ERROR_PARSING, 0, 0 );
+template< >
+bool XMLUtilT<char16_t>::ToInt16( const char16_t* str, short* value )
+{
+    return ParseSigned( str, SHRT_MIN, SHRT_MAX, value );
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToUnsigned16( const char16_t* str, unsigned short* value )
+{
+    return ParseUnsigned( str, USHRT_MAX, value );
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToInt64( const char16_t* str, long long* value )
+{
+    return ParseSigned( str, LLONG_MIN, LLONG_MAX, value );
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToUnsigned64( const char16_t* str, unsigned long long* value )
+{
+    return ParseUnsigned( str, ULLONG_MAX, value );
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToBool( const char16_t* str, bool* value )
+{
+    int ival = 0;
+    if ( ToInt( str, &ival )) {
+        *value = (ival==0) ? false : true;
+        return true;
+    }
+    if ( StringEqual( str, u"true" ) ) {
+        *value = true;
+        return true;
+    }
+    else if ( StringEqual( str, u"false" ) ) {
+        *value = false;
+        return true;
+    }
+    return false;
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToFloat( const char16_t* str, float* value )
+{
+    return ParseFloat( str, value );
+}
+
+template< >
+bool XMLUtilT<char16_t>::ToDouble( const char16_t* str, double* value )
+{
+    return ParseDouble( str, value );
+}
+#endif
+
+// --------- UTF-8 validation ----------- //
+/*
+	Well formed UTF-8 as in table 3-7 of the Unicode standard: no overlong
+	forms, surrogates or code points past U+10FFFF. ASCII, the bulk of most
+	documents, is skipped 16 bytes at a time.
+*/
+// The first byte of the first invalid sequence in [p, end), or null.
+static const unsigned char* FindInvalidUTF8( const unsigned char* p, const unsigned char* end )
+{
+    while ( p < end ) {
+#ifdef TIXML_SSE2
+        while ( end - p >= 32 ) {
+            const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p + 16 ) );
+            if ( _mm_movemask_epi8( _mm_or_si128( a, b ) ) != 0 ) {
+                break;
             }
+            p += 32;
+        }
+        if ( end - p >= 16 && _mm_movemask_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) ) ) == 0 ) {
+            p += 16;
+            continue;
+        }
+        if ( p == end ) {
             break;
         }
-
-        XMLDeclarationT<xchar>* decl = node->ToDeclaration();
-        if ( decl ) {
-                // A declaration can only be the first child of a document.
-                // Set error, if document already has children.
-                if ( !_document->NoChildren() ) {
-                        _document->SetError( XML_ERROR_PARSING_DECLARATION, decl->Value(), 0);
-                        DeleteNode( decl );
-                        break;
-                }
+#endif
+        const unsigned char lead = *p;
+        if ( lead < 0x80 ) {
+            ++p;
+            continue;
         }
-
-        XMLElementT<xchar>* ele = node->ToElement();
-        if ( ele ) {
-            // We read the end tag. Return it to the parent.
-            if ( ele->ClosingType() == XMLElementT<xchar>::CLOSING ) {
-                if ( parentEnd ) {
-                    ele->_value.TransferTo( parentEnd );
-                }
-                node->_memPool->SetTracked();   // created and then immediately deleted.
-                DeleteNode( node );
-                return p;
+        // The range of the second byte, and the number of bytes after the first.
+        unsigned char lo = 0x80;
+        unsigned char hi = 0xBF;
+        int trail = 0;
+        if ( lead < 0xC2 ) {
+            return p;
+        }
+        else if ( lead < 0xE0 ) {
+            trail = 1;
+        }
+        else if ( lead < 0xF0 ) {
+            trail = 2;
+            if ( lead == 0xE0 ) {
+                lo = 0xA0;
             }
-
-            // Handle an end tag returned to this level.
-            // And handle a bunch of annoying errors.
-            bool mismatch = false;
-            if ( endTag.Empty() ) {
-                if ( ele->ClosingType() == XMLElementT<xchar>::OPEN ) {
-                    mismatch = true;
-                }
+            else if ( lead == 0xED ) {
+                hi = 0x9F;
             }
-            else {
-                if ( ele->ClosingType() != XMLElementT<xchar>::OPEN ) {
-                    mismatch = true;
-                }
-                else if ( !XMLUtilT<xchar>::StringEqual( endTag.GetStr(), ele->Name() ) ) {
-                    mismatch = true;
-                }
+        }
+        else if ( lead < 0xF5 ) {
+            trail = 3;
+            if ( lead == 0xF0 ) {
+                lo = 0x90;
             }
-            if ( mismatch ) {
-                _document->SetError( XML_ERROR_MISMATCHED_ELEMENT, ele->Name(), 0 );
-                DeleteNode( node );
-                break;
+            else if ( lead == 0xF4 ) {
+                hi = 0x8F;
             }
         }
-        InsertEndChild( node );
+        else {
+            return p;
+        }
+        if ( end - p <= trail || p[1] < lo || p[1] > hi ) {
+            return p;
+        }
+        for( int i=2; i<=trail; ++i ) {
+            if ( ( p[i] & 0xC0 ) != 0x80 ) {
+                return p;
+            }
+        }
+        p += trail + 1;
     }
     return 0;
 }
 
+// --------- File paths ----------- //
+/*
+	LoadFile() and SaveFile() open the named file as a descriptor and move
+	the data in large blocks, without stdio buffering. Windows takes wide
+	names as they are; elsewhere names are bytes, and wide names are
+	converted to UTF-8.
+*/
+static int OpenPath( const char* path, bool write, bool binary )
+{
+    TIXMLASSERT( path );
+    int fd = -1;
+#if defined(_WIN32)
+    const int flags = write ? ( _O_WRONLY | _O_CREAT | _O_TRUNC | ( binary ? _O_BINARY : _O_TEXT ) ) : ( _O_RDONLY | _O_BINARY );
+#   if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
+    if ( _sopen_s( &fd, path, flags, _SH_DENYNO, _S_IREAD | _S_IWRITE ) != 0 ) {
+        return -1;
+    }
+#   else
+    fd = _open( path, flags, _S_IREAD | _S_IWRITE );
+#   endif
+#else
+    (void)binary;
+    int flags = write ? ( O_WRONLY | O_CREAT | O_TRUNC ) : O_RDONLY;
+#   ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#   endif
+    do {
+        fd = open( path, flags, 0666 );
+    } while ( fd < 0 && errno == EINTR );
+#endif
+    return fd;
+}
+
+#if defined(_WIN32)
+static int OpenPath( const wchar_t* path, bool write, bool binary )
+{
+    TIXMLASSERT( path );
+    int fd = -1;
+    const int flags = write ? ( _O_WRONLY | _O_CREAT | _O_TRUNC | ( binary ? _O_BINARY : _O_TEXT ) ) : ( _O_RDONLY | _O_BINARY );
+#   if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
+    if ( _wsopen_s( &fd, path, flags, _SH_DENYNO, _S_IREAD | _S_IWRITE ) != 0 ) {
+        return -1;
+    }
+#   else
+    fd = _wopen( path, flags, _S_IREAD | _S_IWRITE );
+#   endif
+    return fd;
+}
+
+#ifdef TINYXML2_CHAR16
+static int OpenPath( const char16_t* path, bool write, bool binary )
+{
+    // wchar_t is UTF-16 on Windows.
+    return OpenPath( reinterpret_cast<const wchar_t*>( path ), write, binary );
+}
+#endif
+
+#else
+// Convert a UTF-16 or UTF-32 path to UTF-8. Fails on units past U+10FFFF.
 template<typename xchar>
-void XMLNodeT<xchar>::DeleteNode( XMLNodeT<xchar>* node )
+static bool NarrowPath( const xchar* path, DynArray<char, 256>* narrow )
 {
-    if ( node == 0 ) {
-        return;
+    for( const xchar* p = path; *p; ++p ) {
+        unsigned long ucs = static_cast<unsigned long>( *p );
+        if ( sizeof( xchar ) == 2 && ucs >= 0xD800 && ucs <= 0xDBFF
+             && static_cast<unsigned long>( p[1] ) >= 0xDC00 && static_cast<unsigned long>( p[1] ) <= 0xDFFF ) {
+            ucs = 0x10000 + ( ( ucs - 0xD800 ) << 10 ) + ( static_cast<unsigned long>( *++p ) - 0xDC00 );
+        }
+        if ( ucs > 0x10FFFF ) {
+            return false;
+        }
+        int length = 0;
+        XMLUtilT<char>::ConvertUTF32ToUTF8( ucs, narrow->PushArr( 4 ), &length );
+        narrow->PopArr( 4 - length );
     }
-    MemPool* pool = node->_memPool;
-    node->~XMLNodeT();
-    pool->Free( node );
+    narrow->Push( 0 );
+    return true;
 }
 
 template<typename xchar>
-void XMLNodeT<xchar>::InsertChildPreamble( XMLNodeT<xchar>* insertThis ) const
+static int OpenPath( const xchar* path, bool write, bool binary )
 {
-    TIXMLASSERT( insertThis );
-    TIXMLASSERT( insertThis->_document == _document );
+    TIXMLASSERT( path );
+    DynArray<char, 256> narrow;
+    if ( !NarrowPath( path, &narrow ) ) {
+        return -1;
+    }
+    return OpenPath( narrow.Mem(), write, binary );
+}
+#endif
 
-    if ( insertThis->_parent )
-        insertThis->_parent->Unlink( insertThis );
-    else
-        insertThis->_memPool->SetTracked();
+// Returns false if the last of the written data couldn't be stored.
+static bool ClosePath( int fd )
+{
+#if defined(_WIN32)
+    return _close( fd ) == 0;
+#else
+    return close( fd ) == 0;
+#endif
 }
 
-// --------- XMLText ---------- //
-template <typename xchar>
-xchar* XMLTextT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+// The size of the file open as 'fd', or -1 if it isn't known.
+static long long PathSize( int fd )
 {
-    const xchar* start = p;
-    if ( this->CData() ) {
-		xchar Tag1[] = {']', ']', '>', 0};
-        p = _value.ParseText( p, Tag1, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
-        if ( !p ) {
-            _document->SetError( XML_ERROR_PARSING_CDATA, start, 0 );
-        }
-        return p;
+#if defined(_WIN32)
+    return _filelengthi64( fd );
+#else
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+        return -1;
     }
-    else {
-        int flags = _document->ProcessEntities() ? StrPairT<xchar>::TEXT_ELEMENT : StrPairT<xchar>::TEXT_ELEMENT_LEAVE_ENTITIES;
-        if ( _document->WhitespaceMode() == COLLAPSE_WHITESPACE ) {
+    return static_cast<long long>( st.st_size );
+#endif
+}
+
+// Read exactly 'size' bytes from 'fp' or, when it is null, from 'fd'.
+static bool ReadFully( FILE* fp, int fd, void* buffer, size_t size )
+{
+    if ( fp ) {
+        return fread( buffer, 1, size, fp ) == size;
+    }
+    char* p = static_cast<char*>( buffer );
+    while ( size ) {
+#if defined(_WIN32)
+        const unsigned chunk = ( size < (size_t)INT_MAX ) ? (unsigned)size : (unsigned)INT_MAX;
+        const int n = _read( fd, p, chunk );
+#else
+        const size_t chunk = ( size < (size_t)INT_MAX ) ? size : (size_t)INT_MAX;
+        const ssize_t n = read( fd, p, chunk );
+        if ( n < 0 && errno == EINTR ) {
+            continue;
+        }
+#endif
+        if ( n <= 0 ) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// --------- Transcoding ----------- //
+/*
+	Wide documents are loaded from UTF-8, UTF-16 or UTF-32 files, or
+	ISO-8859-1 or Windows-1252 if declared, and transcoded to the document
+	encoding: UTF-16 for char16_t and 16 bit wchar_t, UTF-32 otherwise. The
+	encoding comes from the byte order mark, else from the first bytes and
+	the encoding declaration (XML 1.0 appendix F). Invalid sequences become
+	U+FFFD. Narrow documents transcode the two single byte encodings to
+	UTF-8 when they are parsed or loaded.
+
+	Once transcoded, the declaration names the encoding of the document,
+	not the source, so it is rewritten to "UTF-8", whatever the source,
+	and the document can be saved and read back.
+
+	The file is read into the end of a parse buffer sized for the most
+	units it can decode to, and decoded forwards into its start. The
+	worst case output of every input sequence takes at least as many bytes
+	as the sequence (a UTF-32 character may need a UTF-16 pair, so it is
+	counted as two units), and each sequence is read before its output is
+	written, so the output never overtakes the input still to be read.
+*/
+enum {
+    SOURCE_UTF8,
+    SOURCE_LATIN1,
+    SOURCE_WINDOWS1252,
+    SOURCE_UTF16LE,
+    SOURCE_UTF16BE,
+    SOURCE_UTF32LE,
+    SOURCE_UTF32BE
+};
+
+static const unsigned long REPLACEMENT_CHARACTER = 0xFFFD;
+
+// Windows-1252 is ISO-8859-1 except for 0x80..0x9F. The five bytes it
+// leaves undefined map to the C1 controls, as in ISO-8859-1.
+static const unsigned short windows1252[32] = {
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+};
+
+// The table of 0x80..0x9F for a single byte encoding, or null for ISO-8859-1.
+static inline const unsigned short* ControlTable( int encoding )
+{
+    return ( encoding == SOURCE_WINDOWS1252 ) ? windows1252 : 0;
+}
+
+// The encoding family, from the first (up to 4) bytes. XML text can't
+// contain NUL, so zero bytes at the start mean a wide encoding.
+static int SniffEncoding( const unsigned char* p, size_t size )
+{
+    if ( size >= 4 ) {
+        if ( p[0] == 0 && p[1] == 0 ) {
+            return SOURCE_UTF32BE;
+        }
+        if ( p[2] == 0 && p[3] == 0 ) {
+            return SOURCE_UTF32LE;
+        }
+    }
+    if ( size >= 2 ) {
+        if ( ( p[0] == 0xFE && p[1] == 0xFF ) || ( p[0] == 0 && p[1] != 0 ) ) {
+            return SOURCE_UTF16BE;
+        }
+        if ( ( p[0] == 0xFF && p[1] == 0xFE ) || ( p[0] != 0 && p[1] == 0 ) ) {
+            return SOURCE_UTF16LE;
+        }
+    }
+    return SOURCE_UTF8;
+}
+
+template<typename unit>
+static bool EncodingNameIs( const unit* p, size_t length, const char* name )
+{
+    for( size_t i=0; i<length; ++i, ++name ) {
+        const unsigned long u = static_cast<unsigned long>( p[i] );
+        const unsigned long c = ( u >= 'a' && u <= 'z' ) ? u - 'a' + 'A' : u;
+        if ( c != static_cast<unsigned char>( *name ) ) {
+            return false;
+        }
+    }
+    return *name == 0;
+}
+
+// The encoding named by the declaration of an ASCII compatible file.
+// For a single byte encoding, [*nameStart, *nameEnd) is its name.
+static int DeclaredEncoding( const unsigned char* p, size_t size, size_t* nameStart, size_t* nameEnd )
+{
+    if ( size >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF ) {
+        return SOURCE_UTF8;
+    }
+    const unsigned char* end = p + ( size < 256 ? size : 256 );
+    if ( end - p < 5 || memcmp( p, "<?xml", 5 ) != 0 ) {
+        return SOURCE_UTF8;
+    }
+    for( const unsigned char* q = p + 5; end - q > 8 && !( q[0] == '?' && q[1] == '>' ); ++q ) {
+        if ( memcmp( q, "encoding", 8 ) != 0 ) {
+            continue;
+        }
+        for( q += 8; q < end && ( *q == ' ' || *q == '\t' || *q == '\r' || *q == '\n' || *q == '=' ); ++q ) {
+        }
+        if ( q == end || ( *q != '"' && *q != '\'' ) ) {
+            break;
+        }
+        const unsigned char quote = *q++;
+        const unsigned char* name = q;
+        while ( q < end && *q != quote ) {
+            ++q;
+        }
+        const size_t length = q - name;
+        *nameStart = name - p;
+        *nameEnd = q - p;
+        if ( EncodingNameIs( name, length, "ISO-8859-1" ) || EncodingNameIs( name, length, "ISO_8859-1" )
+             || EncodingNameIs( name, length, "LATIN1" ) ) {
+            return SOURCE_LATIN1;
+        }
+        if ( EncodingNameIs( name, length, "WINDOWS-1252" ) || EncodingNameIs( name, length, "CP1252" ) ) {
+            return SOURCE_WINDOWS1252;
+        }
+        break;
+    }
+    return SOURCE_UTF8;
+}
+
+// Make the declaration at the start of the decoded text [p, end) name
+// "UTF-8". The text can't grow, so a shorter name is dropped along with
+// its pseudo-attribute. Returns the new end.
+template<typename xchar>
+static xchar* DeclareUTF8( xchar* p, xchar* end )
+{
+    static const char UTF8_NAME[] = "UTF-8";
+    const int nameLength = sizeof( UTF8_NAME ) - 1;
+    if ( p < end && static_cast<unsigned long>( *p ) == 0xFEFF ) {
+        ++p;
+    }
+    xchar* const limit = ( end - p < 256 ) ? end : p + 256;
+    if ( limit - p < 5 || strncmp( p, "<?xml", 5 ) != 0 ) {
+        return end;
+    }
+    for( xchar* q = p + 5; limit - q > 8 && !( q[0] == '?' && q[1] == '>' ); ++q ) {
+        if ( strncmp( q, "encoding", 8 ) != 0 ) {
+            continue;
+        }
+        xchar* attribute = q;
+        for( q += 8; q < limit && ( *q == ' ' || *q == '\t' || *q == '\r' || *q == '\n' || *q == '=' ); ++q ) {
+        }
+        if ( q == limit || ( *q != '"' && *q != '\'' ) ) {
+            break;
+        }
+        const xchar quote = *q++;
+        xchar* const name = q;
+        while ( q < limit && *q != quote ) {
+            ++q;
+        }
+        if ( q == limit || EncodingNameIs( name, q - name, "UTF-8" ) || EncodingNameIs( name, q - name, "UTF8" ) ) {
+            break;
+        }
+        xchar* to = name + nameLength;
+        xchar* from = q;
+        if ( q - name >= nameLength ) {
+            for( int i=0; i<nameLength; ++i ) {
+                name[i] = static_cast<xchar>( UTF8_NAME[i] );
+            }
+        }
+        else {
+            while ( attribute[-1] == ' ' || attribute[-1] == '\t' || attribute[-1] == '\r' || attribute[-1] == '\n' ) {
+                --attribute;
+            }
+            to = attribute;
+            from = q + 1;
+        }
+        memmove( to, from, ( end - from ) * sizeof( xchar ) );
+        return end - ( from - to );
+    }
+    return end;
+}
+
+// Append 'cp' in the document encoding.
+template<typename xchar>
+static inline xchar* PutCodePoint( xchar* out, unsigned long cp )
+{
+    if ( sizeof( xchar ) == 2 && cp >= 0x10000 ) {
+        cp -= 0x10000;
+        *out++ = static_cast<xchar>( 0xD800 + ( cp >> 10 ) );
+        *out++ = static_cast<xchar>( 0xDC00 + ( cp & 0x3FF ) );
+    }
+    else {
+        *out++ = static_cast<xchar>( cp );
+    }
+    return out;
+}
+
+#ifdef TIXML_SSE2
+// Zero extend 16 bytes to 16 units.
+template<typename xchar>
+static inline void Widen16( __m128i bytes, xchar* out )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8( bytes, zero );
+    const __m128i hi = _mm_unpackhi_epi8( bytes, zero );
+    if ( sizeof( xchar ) == 2 ) {
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), lo );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 8 ), hi );
+    }
+    else {
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), _mm_unpacklo_epi16( lo, zero ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 4 ), _mm_unpackhi_epi16( lo, zero ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 8 ), _mm_unpacklo_epi16( hi, zero ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 12 ), _mm_unpackhi_epi16( hi, zero ) );
+    }
+}
+#endif
+
+template<typename xchar>
+static xchar* DecodeUTF8( const unsigned char* p, const unsigned char* end, xchar* out )
+{
+    while ( p < end ) {
+#ifdef TIXML_SSE2
+        // Runs of ASCII are widened 16 bytes at a time.
+        while ( end - p >= 16 ) {
+            const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            if ( _mm_movemask_epi8( chunk ) != 0 ) {
+                break;
+            }
+            Widen16( chunk, out );
+            p += 16;
+            out += 16;
+        }
+        if ( p == end ) {
+            break;
+        }
+#endif
+        const unsigned lead = *p;
+        if ( lead < 0x80 ) {
+            *out++ = static_cast<xchar>( lead );
+            ++p;
+            continue;
+        }
+        int length = 0;
+        unsigned long cp = 0;
+        unsigned long min = 0;
+        if ( ( lead & 0xE0 ) == 0xC0 ) {
+            length = 2;
+            cp = lead & 0x1F;
+            min = 0x80;
+        }
+        else if ( ( lead & 0xF0 ) == 0xE0 ) {
+            length = 3;
+            cp = lead & 0x0F;
+            min = 0x800;
+        }
+        else if ( ( lead & 0xF8 ) == 0xF0 ) {
+            length = 4;
+            cp = lead & 0x07;
+            min = 0x10000;
+        }
+        else {
+            out = PutCodePoint( out, REPLACEMENT_CHARACTER );
+            ++p;
+            continue;
+        }
+        int i = 1;
+        for( ; i < length && p + i < end && ( p[i] & 0xC0 ) == 0x80; ++i ) {
+            cp = ( cp << 6 ) | ( p[i] & 0x3F );
+        }
+        if ( i < length || cp < min || cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) ) {
+            cp = REPLACEMENT_CHARACTER;
+        }
+        p += i;
+        out = PutCodePoint( out, cp );
+    }
+    return out;
+}
+
+// ISO-8859-1 is the first 256 code points. 'controls', if not null,
+// replaces 0x80..0x9F.
+template<typename xchar>
+static xchar* DecodeSingleByte( const unsigned char* p, const unsigned char* end, const unsigned short* controls, xchar* out )
+{
+    while ( p < end ) {
+#ifdef TIXML_SSE2
+        // Blocks without remapped bytes are widened 16 at a time.
+        const __m128i c1 = _mm_set1_epi8( static_cast<char>( 0x80 ) );
+        const __m128i top3 = _mm_set1_epi8( static_cast<char>( 0xE0 ) );
+        while ( end - p >= 16 ) {
+            const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            if ( controls && _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( chunk, top3 ), c1 ) ) != 0 ) {
+                break;
+            }
+            Widen16( chunk, out );
+            p += 16;
+            out += 16;
+        }
+        // Then up to 16 bytes one by one.
+        const unsigned char* stop = ( end - p > 16 ) ? p + 16 : end;
+#else
+        const unsigned char* stop = end;
+#endif
+        for( ; p < stop; ++p ) {
+            const unsigned c = *p;
+            *out++ = static_cast<xchar>( ( controls && ( c & 0xE0 ) == 0x80 ) ? controls[c - 0x80] : c );
+        }
+    }
+    return out;
+}
+
+// The UTF-8 size of [p, end) in a single byte encoding.
+static size_t SingleByteUTF8Size( const unsigned char* p, const unsigned char* end, const unsigned short* controls )
+{
+    size_t size = end - p;
+    for( ; p < end; ++p ) {
+        const unsigned c = *p;
+        if ( c >= 0x80 ) {
+            ++size;
+            if ( controls && c < 0xA0 && controls[c - 0x80] >= 0x800 ) {
+                ++size;
+            }
+        }
+    }
+    return size;
+}
+
+// Transcode [p, end) in a single byte encoding to UTF-8. Each byte is
+// looked up in 'utf8', which holds the length and bytes of the
+// encoding of each of the upper 128 characters.
+static char* EncodeSingleByte( const unsigned char* p, const unsigned char* end, const char ( *utf8 )[4], char* out )
+{
+    while ( p < end ) {
+#ifdef TIXML_SSE2
+        // ASCII is copied 16 bytes at a time.
+        while ( end - p >= 16 ) {
+            const __m128i chunk = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            if ( _mm_movemask_epi8( chunk ) != 0 ) {
+                break;
+            }
+            _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), chunk );
+            p += 16;
+            out += 16;
+        }
+        if ( p == end ) {
+            break;
+        }
+#endif
+        const unsigned c = *p++;
+        if ( c < 0x80 ) {
+            *out++ = static_cast<char>( c );
+        }
+        else {
+            // Always 3 bytes are copied; the output has room for them.
+            const char* e = utf8[c - 0x80];
+            out[0] = e[1];
+            out[1] = e[2];
+            out[2] = e[3];
+            out += e[0];
+        }
+    }
+    return out;
+}
+
+// Transcode 'size' bytes in a single byte encoding to a new, null
+// terminated UTF-8 buffer, with [nameStart, nameEnd) replaced by "UTF-8".
+static char* SingleByteToUTF8( const unsigned char* p, size_t size, int encoding, size_t nameStart, size_t nameEnd, size_t* length )
+{
+    const unsigned short* controls = ControlTable( encoding );
+    char utf8[128][4];
+    for( int i=0; i<128; ++i ) {
+        const unsigned long cp = ( controls && i < 32 ) ? controls[i] : 0x80 + i;
+        int n = 0;
+        XMLUtilT<char>::ConvertUTF32ToUTF8( cp, utf8[i] + 1, &n );
+        utf8[i][0] = static_cast<char>( n );
+        if ( n < 3 ) {
+            utf8[i][3] = 0;
+        }
+    }
+    static const char UTF8_NAME[] = "UTF-8";
+    const size_t nameLength = sizeof( UTF8_NAME ) - 1;
+    const size_t bytes = nameStart + nameLength + SingleByteUTF8Size( p + nameEnd, p + size, controls );
+    char* buffer = new char[bytes + 1];
+    // The declaration up to the name is ASCII.
+    memcpy( buffer, p, nameStart );
+    memcpy( buffer + nameStart, UTF8_NAME, nameLength );
+    char* out = EncodeSingleByte( p + nameEnd, p + size, utf8, buffer + nameStart + nameLength );
+    TIXMLASSERT( out == buffer + bytes );
+    *out = 0;
+    *length = bytes;
+    return buffer;
+}
+
+static inline unsigned long ReadUnit16( const unsigned char* p, bool bigEndian )
+{
+    return bigEndian ? ( ( p[0] << 8 ) | p[1] ) : ( p[0] | ( p[1] << 8 ) );
+}
+
+template<typename xchar>
+static xchar* DecodeUTF16( const unsigned char* p, const unsigned char* end, bool bigEndian, xchar* out )
+{
+    while ( end - p >= 2 ) {
+#ifdef TIXML_SSE2
+        // Runs without surrogates are converted 8 units at a time.
+        const __m128i zero = _mm_setzero_si128();
+        while ( end - p >= 16 ) {
+            __m128i units = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+            if ( bigEndian ) {
+                units = _mm_or_si128( _mm_slli_epi16( units, 8 ), _mm_srli_epi16( units, 8 ) );
+            }
+            const __m128i surrogates = _mm_cmpeq_epi16( _mm_and_si128( units, _mm_set1_epi16( static_cast<short>( 0xF800 ) ) ),
+                                                        _mm_set1_epi16( static_cast<short>( 0xD800 ) ) );
+            if ( _mm_movemask_epi8( surrogates ) != 0 ) {
+                break;
+            }
+            if ( sizeof( xchar ) == 2 ) {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), units );
+            }
+            else {
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), _mm_unpacklo_epi16( units, zero ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i*>( out + 4 ), _mm_unpackhi_epi16( units, zero ) );
+            }
+            p += 16;
+            out += 8;
+        }
+        if ( end - p < 2 ) {
+            break;
+        }
+#endif
+        unsigned long cp = ReadUnit16( p, bigEndian );
+        p += 2;
+        if ( cp >= 0xD800 && cp <= 0xDBFF && end - p >= 2 ) {
+            const unsigned long low = ReadUnit16( p, bigEndian );
+            if ( low >= 0xDC00 && low <= 0xDFFF ) {
+                cp = 0x10000 + ( ( cp - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                p += 2;
+            }
+        }
+        if ( cp >= 0xD800 && cp <= 0xDFFF ) {
+            cp = REPLACEMENT_CHARACTER;
+        }
+        out = PutCodePoint( out, cp );
+    }
+    if ( p < end ) {
+        out = PutCodePoint( out, REPLACEMENT_CHARACTER );	// odd trailing byte
+    }
+    return out;
+}
+
+template<typename xchar>
+static xchar* DecodeUTF32( const unsigned char* p, const unsigned char* end, bool bigEndian, xchar* out )
+{
+    for( ; end - p >= 4; p += 4 ) {
+        unsigned long cp = bigEndian ? ( ( (unsigned long)p[0] << 24 ) | ( p[1] << 16 ) | ( p[2] << 8 ) | p[3] )
+                                     : ( ( (unsigned long)p[3] << 24 ) | ( p[2] << 16 ) | ( p[1] << 8 ) | p[0] );
+        if ( cp > 0x10FFFF || ( cp >= 0xD800 && cp <= 0xDFFF ) ) {
+            cp = REPLACEMENT_CHARACTER;
+        }
+        out = PutCodePoint( out, cp );
+    }
+    if ( p < end ) {
+        out = PutCodePoint( out, REPLACEMENT_CHARACTER );
+    }
+    return out;
+}
+
+// Read and transcode 'size' bytes of 'fp' into a new null terminated
+// buffer of xchar. With 'validate', UTF-8 input must be well formed.
+template<typename xchar>
+static XMLError ReadTranscoded( FILE* fp, int fd, size_t size, char*& buffer, bool validate, size_t* invalidOffset )
+{
+    unsigned char head[4] = { 0 };
+    const size_t headSize = size < 4 ? size : 4;
+    if ( !ReadFully( fp, fd, head, headSize ) ) {
+        return XML_ERROR_FILE_READ_ERROR;
+    }
+    int encoding = SniffEncoding( head, headSize );
+
+    // The most units the file can decode to. A code point past U+FFFF
+    // takes two 16 bit units.
+    size_t units = size;
+    if ( encoding == SOURCE_UTF16LE || encoding == SOURCE_UTF16BE ) {
+        units = ( size + 1 ) / 2;
+    }
+    else if ( encoding == SOURCE_UTF32LE || encoding == SOURCE_UTF32BE ) {
+        units = ( size + 3 ) / 4;
+        if ( sizeof( xchar ) == 2 ) {
+            units *= 2;
+        }
+    }
+    if ( units >= (size_t)-1 / sizeof( xchar ) - 1 ) {
+        return XML_ERROR_FILE_READ_ERROR;
+    }
+    // Plus the null terminator. The input must fit as well.
+    size_t bytes = ( units + 1 ) * sizeof( xchar );
+    if ( bytes < size ) {
+        bytes = size + sizeof( xchar );
+    }
+    buffer = new char[bytes];
+    unsigned char* in = reinterpret_cast<unsigned char*>( buffer ) + bytes - size;
+    memcpy( in, head, headSize );
+    if ( !ReadFully( fp, fd, in + headSize, size - headSize ) ) {
+        return XML_ERROR_FILE_READ_ERROR;
+    }
+    size_t nameStart = 0;
+    size_t nameEnd = 0;
+    if ( encoding == SOURCE_UTF8 ) {
+        encoding = DeclaredEncoding( in, size, &nameStart, &nameEnd );
+    }
+    if ( validate && encoding == SOURCE_UTF8 ) {
+        const unsigned char* invalid = FindInvalidUTF8( in, in + size );
+        if ( invalid ) {
+            *invalidOffset = invalid - in;
+            return XML_ERROR_INVALID_UTF8;
+        }
+    }
+
+    xchar* const start = reinterpret_cast<xchar*>( buffer );
+    xchar* out = start;
+    const unsigned char* end = in + size;
+    switch( encoding ) {
+        case SOURCE_LATIN1:
+        case SOURCE_WINDOWS1252:
+        {
+            // The declaration up to the name is ASCII, and "UTF-8" is
+            // shorter than the names it replaces.
+            static const char UTF8_NAME[] = "UTF-8";
+            out = DecodeSingleByte( in, in + nameStart, 0, out );
+            for( const char* q = UTF8_NAME; *q; ++q ) {
+                *out++ = static_cast<xchar>( *q );
+            }
+            out = DecodeSingleByte( in + nameEnd, end, ControlTable( encoding ), out );
+            break;
+        }
+        case SOURCE_UTF16LE:	out = DecodeUTF16( in, end, false, out );	break;
+        case SOURCE_UTF16BE:	out = DecodeUTF16( in, end, true, out );	break;
+        case SOURCE_UTF32LE:	out = DecodeUTF32( in, end, false, out );	break;
+        case SOURCE_UTF32BE:	out = DecodeUTF32( in, end, true, out );	break;
+        default:				out = DecodeUTF8( in, end, out );			break;
+    }
+    if ( encoding != SOURCE_LATIN1 && encoding != SOURCE_WINDOWS1252 ) {
+        out = DeclareUTF8( start, out );
+    }
+    *out = 0;
+    if ( static_cast<size_t>( out - start ) >= UINT_MAX ) {
+        // Strings are stored as 32-bit offsets into the buffer.
+        return XML_ERROR_FILE_READ_ERROR;
+    }
+    return XML_NO_ERROR;
+}
+
+// Decode 'length' units of 'str' to wchar_t. 'out' has room for 'length' units.
+static wchar_t* WidenString( const char* str, size_t length, wchar_t* out )
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>( str );
+    return DecodeUTF8( p, p + length, out );
+}
+
+static wchar_t* WidenString( const wchar_t* str, size_t length, wchar_t* out )
+{
+    memcpy( out, str, length * sizeof( wchar_t ) );
+    return out + length;
+}
+
+#ifdef TINYXML2_CHAR16
+static wchar_t* WidenString( const char16_t* str, size_t length, wchar_t* out )
+{
+    const char16_t* end = str + length;
+    while ( str < end ) {
+        unsigned long ch = *str++;
+        if ( sizeof( wchar_t ) > 2 && ch >= 0xD800 && ch <= 0xDBFF && str < end && *str >= 0xDC00 && *str <= 0xDFFF ) {
+            ch = 0x10000 + ( ( ch - 0xD800 ) << 10 ) + ( *str++ - 0xDC00 );
+        }
+        *out++ = static_cast<wchar_t>( ch );
+    }
+    return out;
+}
+#endif
+
+template<typename xchar>
+const wchar_t* XMLDocumentT<xchar>::WideString( const xchar* str ) const
+{
+    if ( !str ) {
+        return 0;
+    }
+    if ( sizeof( xchar ) == sizeof( wchar_t ) ) {
+        // Already wide: wchar_t, or char16_t where wchar_t is UTF-16 too.
+        return reinterpret_cast<const wchar_t*>( str );
+    }
+    if ( _wideCountGeneration != _wideGeneration ) {
+        // The document changed, so no copy handed out before is valid.
+        // Keep the last block for the new generation and free the rest.
+        _wideCount = 0;
+        _wideCountGeneration = _wideGeneration;
+        if ( !_wideBlocks.Empty() ) {
+            wchar_t* last = _wideBlocks.Pop();
+            while ( !_wideBlocks.Empty() ) {
+                delete [] _wideBlocks.Pop();
+            }
+            _wideBlocks.Push( last );
+            _wideNext = last;
+        }
+    }
+
+    // Open addressing with linear probing, on the address of the string.
+    if ( 2 * ( _wideCount + 1 ) > _wideIndex.Size() ) {
+        DynArray< WideEntry, 1 > old;
+        old.Swap( _wideIndex );
+        const int size = old.Size() ? 2 * old.Size() : 64;
+        memset( _wideIndex.PushArr( size ), 0, size * sizeof( WideEntry ) );
+        _wideCount = 0;
+        for( int i=0; i<old.Size(); ++i ) {
+            if ( old[i].generation == _wideGeneration ) {
+                int slot = static_cast<int>( ( reinterpret_cast<size_t>( old[i].key ) >> 2 ) * 2654435761u ) & ( size - 1 );
+                while ( _wideIndex[slot].generation == _wideGeneration ) {
+                    slot = ( slot + 1 ) & ( size - 1 );
+                }
+                _wideIndex[slot] = old[i];
+                ++_wideCount;
+            }
+        }
+    }
+    const int mask = _wideIndex.Size() - 1;
+    int slot = static_cast<int>( ( reinterpret_cast<size_t>( str ) >> 2 ) * 2654435761u ) & mask;
+    for( ; _wideIndex[slot].generation == _wideGeneration; slot = ( slot + 1 ) & mask ) {
+        if ( _wideIndex[slot].key == str ) {
+            return _wideIndex[slot].wide;
+        }
+    }
+
+    const size_t length = strlen( str );
+    wchar_t* wide = AllocWide( length + 1 );
+    *WidenString( str, length, wide ) = 0;
+    WideEntry& entry = _wideIndex[slot];
+    entry.key = str;
+    entry.wide = wide;
+    entry.generation = _wideGeneration;
+    ++_wideCount;
+    return wide;
+}
+
+template<typename xchar>
+wchar_t* XMLDocumentT<xchar>::AllocWide( size_t units ) const
+{
+    // Blocks are never moved, so earlier copies of this generation
+    // stay where they are.
+    static const size_t BLOCK = 4096;
+    if ( units > static_cast<size_t>( _wideEnd - _wideNext ) ) {
+        const size_t size = units > BLOCK ? units : BLOCK;
+        _wideNext = new wchar_t[size];
+        _wideEnd = _wideNext + size;
+        _wideBlocks.Push( _wideNext );
+    }
+    wchar_t* p = _wideNext;
+    _wideNext += units;
+    return p;
+}
+
+template<typename xchar>
+void XMLDocumentT<xchar>::ClearWideStrings()
+{
+    for( int i=0; i<_wideBlocks.Size(); ++i ) {
+        delete [] _wideBlocks[i];
+    }
+    _wideBlocks.Clear();
+    _wideNext = _wideEnd = 0;
+    _wideIndex.Clear();
+    _wideCount = 0;
+    ++_wideGeneration;
+    _wideCountGeneration = _wideGeneration;
+}
+
+template<typename xchar>
+xchar* XMLDocumentT<xchar>::Identify( xchar* p, XMLNodeT<xchar>** node, bool inElement )
+{
+    TIXMLASSERT( node );
+    TIXMLASSERT( p );
+    xchar* const start = p;
+    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+    if( !*p ) {
+        *node = 0;
+        TIXMLASSERT( p );
+        return p;
+    }
+    if ( inElement && p != start && _whitespace == PEDANTIC_WHITESPACE ) {
+        // White space before a tag is text of its own.
+        TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
+        XMLTextT<xchar>* text = new (_textPool.Alloc()) XMLTextT<xchar>( this );
+        text->_memPool = &_textPool;
+        *node = text;
+        return start;
+    }
+
+    // These strings define the matching patterns:
+    static const xchar xmlHeader[]		= { '<', '?', 0 };
+    static const xchar commentHeader[]	= { '<', '!', '-', '-', 0 };
+    static const xchar cdataHeader[]		= { '<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[', 0 };
+    static const xchar dtdHeader[]		= { '<', '!', 0 };
+    static const xchar elementHeader[]	= { '<', 0 };	// and a header for everything else; check last.
+
+    static const int xmlHeaderLen		= 2;
+    static const int commentHeaderLen	= 4;
+    static const int cdataHeaderLen		= 9;
+    static const int dtdHeaderLen		= 2;
+    static const int elementHeaderLen	= 1;
+
+    TIXMLASSERT( sizeof( XMLComment ) == sizeof( XMLUnknownT<xchar> ) );		// use same memory pool
+    TIXMLASSERT( sizeof( XMLComment ) == sizeof( XMLDeclarationT<xchar> ) );	// use same memory pool
+    XMLNodeT<xchar>* returnNode = 0;
+    if ( XMLUtilT<xchar>::StringEqual( p, xmlHeader, xmlHeaderLen ) ) {
+        TIXMLASSERT( sizeof( XMLDeclaration ) == _commentPool.ItemSize() );
+        returnNode = new (_commentPool.Alloc()) XMLDeclarationT<xchar>( this );
+        returnNode->_memPool = &_commentPool;
+        p += xmlHeaderLen;
+    }
+    else if ( XMLUtilT<xchar>::StringEqual( p, commentHeader, commentHeaderLen ) ) {
+        TIXMLASSERT( sizeof( XMLCommentT<xchar> ) == _commentPool.ItemSize() );
+        returnNode = new (_commentPool.Alloc()) XMLCommentT<xchar>( this );
+        returnNode->_memPool = &_commentPool;
+        p += commentHeaderLen;
+    }
+    else if ( XMLUtilT<xchar>::StringEqual( p, cdataHeader, cdataHeaderLen ) ) {
+        TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
+        XMLTextT<xchar>* text = new (_textPool.Alloc()) XMLTextT<xchar>( this );
+        returnNode = text;
+        returnNode->_memPool = &_textPool;
+        p += cdataHeaderLen;
+        text->SetCData( true );
+    }
+    else if ( XMLUtilT<xchar>::StringEqual( p, dtdHeader, dtdHeaderLen ) ) {
+        TIXMLASSERT( sizeof( XMLUnknownT<xchar> ) == _commentPool.ItemSize() );
+        returnNode = new (_commentPool.Alloc()) XMLUnknownT<xchar>( this );
+        returnNode->_memPool = &_commentPool;
+        p += dtdHeaderLen;
+    }
+    else if ( XMLUtilT<xchar>::StringEqual( p, elementHeader, elementHeaderLen ) ) {
+        TIXMLASSERT( sizeof( XMLElementT<xchar> ) == _elementPool.ItemSize() );
+        returnNode = new (_elementPool.Alloc()) XMLElementT<xchar>( this );
+        returnNode->_memPool = &_elementPool;
+        p += elementHeaderLen;
+    }
+    else {
+        TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
+        returnNode = new (_textPool.Alloc()) XMLTextT<xchar>( this );
+        returnNode->_memPool = &_textPool;
+        p = start;	// Back it up, all the text counts.
+    }
+
+    TIXMLASSERT( returnNode );
+    TIXMLASSERT( p );
+    *node = returnNode;
+    return p;
+}
+
+
+template<typename xchar>
+bool XMLDocumentT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+{
+    TIXMLASSERT( visitor );
+    if ( visitor->VisitEnter( *this ) ) {
+        for ( const XMLNodeT<xchar>* node=FirstChild(); node; node=node->NextSibling() ) {
+            if ( !node->Accept( visitor ) ) {
+                break;
+            }
+        }
+    }
+    return visitor->VisitExit( *this );
+}
+
+
+// --------- XMLNode ----------- //
+template<typename xchar>
+XMLNodeT<xchar>::XMLNodeT( XMLDocumentT<xchar>* doc ) :
+    _document( doc ),
+    _parent( 0 ),
+    _firstChild( 0 ), _lastChild( 0 ),
+    _prev( 0 ), _next( 0 ),
+    _memPool( 0 ),
+    _printCacheEntry( -1 ),
+    _unlinkedIndex( -1 )
+{
+}
+
+template<typename xchar>
+XMLNodeT<xchar>::~XMLNodeT()
+{
+    DeleteChildren();
+    if ( _parent ) {
+        _parent->Unlink( this );
+    }
+}
+
+template<typename xchar>
+const xchar* XMLNodeT<xchar>::Value() const 
+{
+    // Catch an edge case: XMLDocuments don't have a a Value. Carefully return nullptr.
+    if ( this->ToDocument() )
+        return 0;
+    return _value.GetStr( CharBuffer() );
+}
+
+template<typename xchar>
+const wchar_t* XMLNodeT<xchar>::ValueW() const
+{
+    return _document->WideString( Value() );
+}
+
+template<typename xchar>
+xchar* XMLNodeT<xchar>::CharBuffer() const
+{
+    return _document->CharBuffer();
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::SetValue( const xchar* str, bool staticMem )
+{
+    MarkDirty();
+    if ( staticMem ) {
+        _value.SetInternedStr( str );
+    }
+    else {
+        _value.SetStr( str );
+    }
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::DeleteChildren()
+{
+    while( _firstChild ) {
+        TIXMLASSERT( _lastChild );
+        TIXMLASSERT( _firstChild->_document == _document );
+        XMLNodeT<xchar>* node = _firstChild;
+        Unlink( node );
+
+        DeleteNode( node );
+    }
+    _firstChild = _lastChild = 0;
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::Unlink( XMLNodeT<xchar>* child )
+{
+    TIXMLASSERT( child );
+    TIXMLASSERT( child->_document == _document );
+    TIXMLASSERT( child->_parent == this );
+    child->MarkDirty();
+    if ( child == _firstChild ) {
+        _firstChild = _firstChild->_next;
+    }
+    if ( child == _lastChild ) {
+        _lastChild = _lastChild->_prev;
+    }
+
+    if ( child->_prev ) {
+        child->_prev->_next = child->_next;
+    }
+    if ( child->_next ) {
+        child->_next->_prev = child->_prev;
+    }
+	child->_parent = 0;
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::DeleteChild( XMLNodeT<xchar>* node )
+{
+    TIXMLASSERT( node );
+    TIXMLASSERT( node->_document == _document );
+    TIXMLASSERT( node->_parent == this );
+    DeleteNode( node );
+}
+
+template<typename xchar>
+XMLNodeT<xchar>* XMLNodeT<xchar>::DeepClone( XMLDocumentT<xchar>* target ) const
+{
+    if ( ToDocument() ) {
+        return 0;
+    }
+    if ( !target ) {
+        target = _document;
+    }
+    typename XMLDocumentT<xchar>::CloneBlock strings;
+    target->PrepareClone( this, &strings );
+    XMLNodeT<xchar>* clone = target->CloneSubtree( this, &strings );
+    target->TrackUnlinked( clone );
+    return clone;
+}
+
+template<typename xchar>
+XMLNodeT<xchar>* XMLNodeT<xchar>::InsertEndChild( XMLNodeT<xchar>* addThis )
+{
+    TIXMLASSERT( addThis );
+    if ( addThis->_document != _document ) {
+        TIXMLASSERT( false );
+        return 0;
+    }
+    InsertChildPreamble( addThis );
+
+    if ( _lastChild ) {
+        TIXMLASSERT( _firstChild );
+        TIXMLASSERT( _lastChild->_next == 0 );
+        _lastChild->_next = addThis;
+        addThis->_prev = _lastChild;
+        _lastChild = addThis;
+
+        addThis->_next = 0;
+    }
+    else {
+        TIXMLASSERT( _firstChild == 0 );
+        _firstChild = _lastChild = addThis;
+
+        addThis->_prev = 0;
+        addThis->_next = 0;
+    }
+    addThis->_parent = this;
+    return addThis;
+}
+
+template<typename xchar>
+XMLNodeT<xchar>* XMLNodeT<xchar>::InsertFirstChild( XMLNodeT<xchar>* addThis )
+{
+    TIXMLASSERT( addThis );
+    if ( addThis->_document != _document ) {
+        TIXMLASSERT( false );
+        return 0;
+    }
+    InsertChildPreamble( addThis );
+
+    if ( _firstChild ) {
+        TIXMLASSERT( _lastChild );
+        TIXMLASSERT( _firstChild->_prev == 0 );
+
+        _firstChild->_prev = addThis;
+        addThis->_next = _firstChild;
+        _firstChild = addThis;
+
+        addThis->_prev = 0;
+    }
+    else {
+        TIXMLASSERT( _lastChild == 0 );
+        _firstChild = _lastChild = addThis;
+
+        addThis->_prev = 0;
+        addThis->_next = 0;
+    }
+    addThis->_parent = this;
+    return addThis;
+}
+
+template<typename xchar>
+XMLNodeT<xchar>* XMLNodeT<xchar>::InsertAfterChild( XMLNodeT<xchar>* afterThis, XMLNodeT<xchar>* addThis )
+{
+    TIXMLASSERT( addThis );
+    if ( addThis->_document != _document ) {
+        TIXMLASSERT( false );
+        return 0;
+    }
+
+    TIXMLASSERT( afterThis );
+
+    if ( afterThis->_parent != this ) {
+        TIXMLASSERT( false );
+        return 0;
+    }
+
+    if ( afterThis->_next == 0 ) {
+        // The last node or the only node.
+        return InsertEndChild( addThis );
+    }
+    InsertChildPreamble( addThis );
+    addThis->_prev = afterThis;
+    addThis->_next = afterThis->_next;
+    afterThis->_next->_prev = addThis;
+    afterThis->_next = addThis;
+    addThis->_parent = this;
+    return addThis;
+}
+
+
+template<typename xchar>
+const XMLElementT<xchar>* XMLNodeT<xchar>::FirstChildElement( const xchar* name ) const
+{
+    for( const XMLNodeT<xchar>* node = _firstChild; node; node = node->_next ) {
+        const XMLElementT<xchar>* element = node->ToElement();
+        if ( element ) {
+            if ( !name || XMLUtilT<xchar>::StringEqual( element->Name(), name ) ) {
+                return element;
+            }
+        }
+    }
+    return 0;
+}
+
+template<typename xchar>
+const XMLElementT<xchar>* XMLNodeT<xchar>::LastChildElement( const xchar* name ) const
+{
+    for( const XMLNodeT<xchar>* node = _lastChild; node; node = node->_prev ) {
+        const XMLElementT<xchar>* element = node->ToElement();
+        if ( element ) {
+            if ( !name || XMLUtilT<xchar>::StringEqual( element->Name(), name ) ) {
+                return element;
+            }
+        }
+    }
+    return 0;
+}
+
+template<typename xchar>
+const XMLElementT<xchar>* XMLNodeT<xchar>::NextSiblingElement( const xchar* name ) const
+{
+    for( const XMLNodeT<xchar>* node = _next; node; node = node->_next ) {
+        const XMLElementT<xchar>* element = node->ToElement();
+        if ( element
+                && (!name || XMLUtilT<xchar>::StringEqual( name, element->Name() ))) {
+            return element;
+        }
+    }
+    return 0;
+}
+
+template<typename xchar>
+const XMLElementT<xchar>* XMLNodeT<xchar>::PreviousSiblingElement( const xchar* name ) const
+{
+    for( const XMLNodeT<xchar>* node = _prev; node; node = node->_prev ) {
+        const XMLElementT<xchar>* element = node->ToElement();
+        if ( element
+                && (!name || XMLUtilT<xchar>::StringEqual( name, element->Name() ))) {
+            return element;
+        }
+    }
+    return 0;
+}
+
+template<typename xchar>
+xchar* XMLNodeT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* parentEnd )
+{
+    // This is a recursive method, but thinking about it "at the current level"
+    // it is a pretty simple flat list:
+    //		<foo/>
+    //		<!-- comment -->
+    //
+    // With a special case:
+    //		<foo>
+    //		</foo>
+    //		<!-- comment -->
+    //
+    // Where the closing element (/foo) *must* be the next thing after the opening
+    // element, and the names must match. BUT the tricky bit is that the closing
+    // element will be read by the child.
+    //
+    // 'endTag' is the end tag for this node, it is returned by a call to a child.
+    // 'parentEnd' is the end tag for the parent, which is filled in and returned.
+
+    while( p && *p ) {
+        XMLNodeT<xchar>* node = 0;
+
+        p = _document->Identify( p, &node, this != _document );
+        if ( node == 0 ) {
+            break;
+        }
+
+        StrPairT<xchar> endTag;
+        p = node->ParseDeep( p, &endTag );
+        if ( !p ) {
+            DeleteNode( node );
+            if ( !_document->Error() ) {
+                _document->SetError( XML_ERROR_PARSING, 0, 0 );
+            }
+            break;
+        }
+
+        XMLDeclarationT<xchar>* decl = node->ToDeclaration();
+        if ( decl ) {
+                // A declaration can only be the first child of a document.
+                // Set error, if document already has children.
+                if ( !_document->NoChildren() ) {
+                        _document->SetError( XML_ERROR_PARSING_DECLARATION, decl->Value(), 0);
+                        DeleteNode( decl );
+                        break;
+                }
+        }
+
+        XMLElementT<xchar>* ele = node->ToElement();
+        if ( ele ) {
+            // We read the end tag. Return it to the parent.
+            if ( ele->ClosingType() == XMLElementT<xchar>::CLOSING ) {
+                if ( parentEnd ) {
+                    ele->_value.TransferTo( parentEnd );
+                }
+                node->_memPool->SetTracked();   // created and then immediately deleted.
+                DeleteNode( node );
+                return p;
+            }
+
+            // Handle an end tag returned to this level.
+            // And handle a bunch of annoying errors.
+            bool mismatch = false;
+            if ( endTag.Empty() ) {
+                if ( ele->ClosingType() == XMLElementT<xchar>::OPEN ) {
+                    mismatch = true;
+                }
+            }
+            else {
+                if ( ele->ClosingType() != XMLElementT<xchar>::OPEN ) {
+                    mismatch = true;
+                }
+                else if ( !XMLUtilT<xchar>::StringEqual( endTag.GetStr( CharBuffer() ), ele->Name() ) ) {
+                    mismatch = true;
+                }
+            }
+            if ( mismatch ) {
+                _document->SetError( XML_ERROR_MISMATCHED_ELEMENT, ele->Name(), 0 );
+                DeleteNode( node );
+                break;
+            }
+        }
+        InsertEndChild( node );
+    }
+    return 0;
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::DeleteNode( XMLNodeT<xchar>* node )
+{
+    if ( node == 0 ) {
+        return;
+    }
+    node->MarkDirty();
+    MemPool* pool = node->_memPool;
+    node->~XMLNodeT();
+    pool->Free( node );
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::InsertChildPreamble( XMLNodeT<xchar>* insertThis ) const
+{
+    TIXMLASSERT( insertThis );
+    TIXMLASSERT( insertThis->_document == _document );
+
+    if ( insertThis->_parent ) {
+        insertThis->_parent->Unlink( insertThis );
+    }
+    else {
+        _document->MarkInUse( insertThis );
+        insertThis->_memPool->SetTracked();
+    }
+    MarkDirty();
+}
+
+template<typename xchar>
+void XMLNodeT<xchar>::MarkDirty() const
+{
+    if ( _document->_parsing ) {
+        // Nothing has been cached or read yet: Clear() started afresh.
+        return;
+    }
+    ++_document->_wideGeneration;
+    if ( _document->_printCache.Empty() && !_document->_source ) {
+        return;
+    }
+    for( const XMLNodeT<xchar>* node = this; node; node = node->_parent ) {
+        _document->DropCachedOutput( node );
+    }
+}
+
+// --------- XMLText ---------- //
+template <typename xchar>
+xchar* XMLTextT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+{
+    const xchar* start = p;
+    if ( this->CData() ) {
+		xchar Tag1[] = {']', ']', '>', 0};
+        p = _value.ParseText( CharBuffer(), p, Tag1, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
+        if ( !p ) {
+            _document->SetError( XML_ERROR_PARSING_CDATA, start, 0 );
+        }
+        return p;
+    }
+    else {
+        int flags = _document->ProcessEntities() ? StrPairT<xchar>::TEXT_ELEMENT : StrPairT<xchar>::TEXT_ELEMENT_LEAVE_ENTITIES;
+        if ( _document->WhitespaceMode() == COLLAPSE_WHITESPACE ) {
             flags |= StrPairT<xchar>::NEEDS_WHITESPACE_COLLAPSING;
         }
-		xchar Tag2[] = {'<', 0};
-        p = _value.ParseText( p, Tag2, flags );
-        if ( p && *p ) {
-            return p-1;
+		xchar Tag2[] = {'<', 0};
+        p = _value.ParseText( CharBuffer(), p, Tag2, flags );
+        if ( p && *p ) {
+            return p-1;
+        }
+        if ( !p ) {
+            _document->SetError( XML_ERROR_PARSING_TEXT, start, 0 );
+        }
+    }
+    return 0;
+}
+
+template <typename xchar>
+XMLNodeT<xchar>* XMLTextT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+{
+    if ( !doc ) {
+        doc = _document;
+    }
+    XMLTextT<xchar>* text = doc->NewText( Value() );	// fixme: this will always allocate memory. Intern?
+    text->SetCData( this->CData() );
+    return text;
+}
+
+template <typename xchar>
+bool XMLTextT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+{
+    const XMLTextT<xchar>* text = compare->ToText();
+    return ( text && XMLUtilT<xchar>::StringEqual( text->Value(), Value() ) );
+}
+
+template <typename xchar>
+bool XMLTextT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+{
+    TIXMLASSERT( visitor );
+    return visitor->Visit( *this );
+}
+
+
+// --------- XMLComment ---------- //
+
+template <typename xchar>
+XMLCommentT<xchar>::XMLCommentT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
+{
+}
+
+
+template <typename xchar>
+XMLCommentT<xchar>::~XMLCommentT()
+{
+}
+
+
+template <typename xchar>
+xchar* XMLCommentT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+{
+    // Comment parses as text.
+    const xchar* start = p;
+	xchar cmtendTag[] = {'-', '-', '>', 0};
+	p = _value.ParseText( CharBuffer(), p, cmtendTag, StrPairT<xchar>::COMMENT );
+    if ( p == 0 ) {
+        _document->SetError( XML_ERROR_PARSING_COMMENT, start, 0 );
+    }
+    return p;
+}
+
+
+template <typename xchar>
+XMLNodeT<xchar>* XMLCommentT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+{
+    if ( !doc ) {
+        doc = _document;
+    }
+    XMLCommentT<xchar>* comment = doc->NewComment( Value() );	// fixme: this will always allocate memory. Intern?
+    return comment;
+}
+
+
+template <typename xchar>
+bool XMLCommentT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+{
+    TIXMLASSERT( compare );
+    const XMLCommentT<xchar>* comment = compare->ToComment();
+    return ( comment && XMLUtilT<xchar>::StringEqual( comment->Value(), Value() ));
+}
+
+
+template <typename xchar>
+bool XMLCommentT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+{
+    TIXMLASSERT( visitor );
+    return visitor->Visit( *this );
+}
+
+
+// --------- XMLDeclaration ---------- //
+
+template <typename xchar>
+XMLDeclarationT<xchar>::XMLDeclarationT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
+{
+}
+
+
+template <typename xchar>
+XMLDeclarationT<xchar>::~XMLDeclarationT()
+{
+    //printf( "~XMLDeclaration\n" );
+}
+
+
+template <typename xchar>
+xchar* XMLDeclarationT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+{
+    // Declaration parses as text.
+    const xchar* start = p;
+	xchar endTag[] = {'?', '>', 0};
+	p = _value.ParseText( CharBuffer(), p, endTag, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
+    if ( p == 0 ) {
+        _document->SetError( XML_ERROR_PARSING_DECLARATION, start, 0 );
+    }
+    return p;
+}
+
+
+template <typename xchar>
+XMLNodeT<xchar>* XMLDeclarationT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+{
+    if ( !doc ) {
+        doc = _document;
+    }
+    XMLDeclarationT<xchar>* dec = doc->NewDeclaration( Value() );	// fixme: this will always allocate memory. Intern?
+    return dec;
+}
+
+
+template <typename xchar>
+bool XMLDeclarationT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+{
+    TIXMLASSERT( compare );
+    const XMLDeclarationT<xchar>* declaration = compare->ToDeclaration();
+    return ( declaration && XMLUtilT<xchar>::StringEqual( declaration->Value(), Value() ));
+}
+
+
+
+template <typename xchar>
+bool XMLDeclarationT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+{
+    TIXMLASSERT( visitor );
+    return visitor->Visit( *this );
+}
+
+// --------- XMLUnknown ---------- //
+template <typename xchar>
+XMLUnknownT<xchar>::XMLUnknownT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
+{
+}
+
+template <typename xchar>
+XMLUnknownT<xchar>::~XMLUnknownT()
+{
+}
+
+template <typename xchar>
+xchar* XMLUnknownT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+{
+    // Unknown parses as text.
+    const xchar* start = p;
+	xchar endTag[] = {'>', 0};
+	p = _value.ParseText( CharBuffer(), p, endTag, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
+    if ( !p ) {
+        _document->SetError( XML_ERROR_PARSING_UNKNOWN, start, 0 );
+    }
+    return p;
+}
+
+template <typename xchar>
+XMLNodeT<xchar>* XMLUnknownT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+{
+    if ( !doc ) {
+        doc = _document;
+    }
+    XMLUnknownT<xchar>* text = doc->NewUnknown( Value() );	// fixme: this will always allocate memory. Intern?
+    return text;
+}
+
+template <typename xchar>
+bool XMLUnknownT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+{
+    TIXMLASSERT( compare );
+    const XMLUnknownT<xchar>* unknown = compare->ToUnknown();
+    return ( unknown && XMLUtilT<xchar>::StringEqual( unknown->Value(), Value() ));
+}
+
+template <typename xchar>
+bool XMLUnknownT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+{
+    TIXMLASSERT( visitor );
+    return visitor->Visit( *this );
+}
+
+// --------- XMLAttribute ---------- //
+
+template <typename xchar>
+const xchar* XMLAttributeT<xchar>::Name() const 
+{
+    return _name.GetStr( _document->CharBuffer() );
+}
+
+template <typename xchar>
+const xchar* XMLAttributeT<xchar>::Value() const 
+{
+    return _value.GetStr( _document->CharBuffer() );
+}
+
+template<typename xchar>
+const wchar_t* XMLAttributeT<xchar>::ValueW() const
+{
+    return _document->WideString( Value() );
+}
+
+template <typename xchar>
+xchar* XMLAttributeT<xchar>::ParseDeep( xchar* p, bool processEntities )
+{
+    // Parse using the name rules: bug fix, was using ParseText before
+    p = _name.ParseName( _document->CharBuffer(), p );
+    if ( !p || !*p ) {
+        return 0;
+    }
+
+    // Skip white space before =
+    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+    if ( *p != '=' ) {
+        return 0;
+    }
+
+    ++p;	// move up to opening quote
+    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+    if ( *p != '\"' && *p != '\'' ) {
+        return 0;
+    }
+
+    xchar endTag[2] = { *p, 0 };
+    ++p;	// move past opening quote
+
+    int flags = processEntities ? StrPairT<xchar>::ATTRIBUTE_VALUE : StrPairT<xchar>::ATTRIBUTE_VALUE_LEAVE_ENTITIES;
+    if ( _document->WhitespaceMode() == PEDANTIC_WHITESPACE ) {
+        flags |= StrPairT<xchar>::NEEDS_ATTRIBUTE_NORMALIZATION;
+    }
+    p = _value.ParseText( _document->CharBuffer(), p, endTag, flags );
+    return p;
+}
+
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetName( const xchar* n )
+{
+    _name.SetStr( n );
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryIntValue( int* value ) const
+{
+    if ( XMLUtilT<xchar>::ToInt( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryUnsignedValue( unsigned int* value ) const
+{
+    if ( XMLUtilT<xchar>::ToUnsigned( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryInt8Value( char* value ) const
+{
+    if ( XMLUtilT<xchar>::ToInt8( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryUnsigned8Value( unsigned char* value ) const
+{
+    if ( XMLUtilT<xchar>::ToUnsigned8( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryInt16Value( short* value ) const
+{
+    if ( XMLUtilT<xchar>::ToInt16( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryUnsigned16Value( unsigned short* value ) const
+{
+    if ( XMLUtilT<xchar>::ToUnsigned16( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryInt64Value( long long* value ) const
+{
+    if ( XMLUtilT<xchar>::ToInt64( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryUnsigned64Value( unsigned long long* value ) const
+{
+    if ( XMLUtilT<xchar>::ToUnsigned64( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryBoolValue( bool* value ) const
+{
+    if ( XMLUtilT<xchar>::ToBool( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryFloatValue( float* value ) const
+{
+    if ( XMLUtilT<xchar>::ToFloat( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+XMLError XMLAttributeT<xchar>::QueryDoubleValue( double* value ) const
+{
+    if ( XMLUtilT<xchar>::ToDouble( Value(), value )) {
+        return XML_NO_ERROR;
+    }
+    return XML_WRONG_ATTRIBUTE_TYPE;
+}
+
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( const xchar* v )
+{
+    _value.SetStr( v );
+}
+
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( int v )
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    _value.SetStr( buf );
+}
+
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( unsigned v )
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    _value.SetStr( buf );
+}
+
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( bool v )
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    _value.SetStr( buf );
+}
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( double v )
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    _value.SetStr( buf );
+}
+
+template <typename xchar>
+void XMLAttributeT<xchar>::SetAttribute( float v )
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    _value.SetStr( buf );
+}
+
+
+// --------- XMLElement ---------- //
+template <typename xchar>
+XMLElementT<xchar>::XMLElementT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc ),
+    _closingType( 0 ),
+    _rootAttribute( 0 ),
+    _sourceStart( 0 ),
+    _sourceLength( 0 )
+{
+}
+
+template <typename xchar>
+XMLElementT<xchar>::~XMLElementT()
+{
+    while( _rootAttribute ) {
+        XMLAttributeT<xchar>* next = _rootAttribute->_next;
+        DeleteAttribute( _rootAttribute );
+        _rootAttribute = next;
+    }
+}
+
+template <typename xchar>
+const XMLAttributeT<xchar>* XMLElementT<xchar>::FindAttribute( const xchar* name ) const
+{
+    for( XMLAttributeT<xchar>* a = _rootAttribute; a; a = a->_next ) {
+        if ( XMLUtilT<xchar>::StringEqual( a->Name(), name ) ) {
+            return a;
+        }
+    }
+    return 0;
+}
+
+template <typename xchar>
+const xchar* XMLElementT<xchar>::Attribute( const xchar* name, const xchar* value ) const
+{
+    const XMLAttributeT<xchar>* a = FindAttribute( name );
+    if ( !a ) {
+        return 0;
+    }
+    if ( !value || XMLUtilT<xchar>::StringEqual( a->Value(), value )) {
+        return a->Value();
+    }
+    return 0;
+}
+
+template <typename xchar>
+const xchar* XMLElementT<xchar>::GetText() const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        return FirstChild()->Value();
+    }
+    return 0;
+}
+
+template<typename xchar>
+const wchar_t* XMLElementT<xchar>::GetTextW() const
+{
+    return _document->WideString( GetText() );
+}
+
+template<typename xchar>
+const wchar_t* XMLElementT<xchar>::AttributeW( const xchar* name ) const
+{
+    return _document->WideString( Attribute( name ) );
+}
+
+template <typename xchar>
+void	XMLElementT<xchar>::SetText( const xchar* inText )
+{
+	if ( FirstChild() && FirstChild()->ToText() )
+		FirstChild()->SetValue( inText );
+	else {
+		XMLTextT<xchar>*	theText = GetDocument()->NewText( inText );
+		InsertFirstChild( theText );
+	}
+}
+
+template <typename xchar>
+void XMLElementT<xchar>::SetText( int v ) 
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    SetText( buf );
+}
+
+template <typename xchar>
+void XMLElementT<xchar>::SetText( unsigned v ) 
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    SetText( buf );
+}
+
+template <typename xchar>
+void XMLElementT<xchar>::SetText( bool v ) 
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    SetText( buf );
+}
+
+template <typename xchar>
+void XMLElementT<xchar>::SetText( float v ) 
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    SetText( buf );
+}
+
+template <typename xchar>
+void XMLElementT<xchar>::SetText( double v ) 
+{
+    xchar buf[BUF_SIZE];
+    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
+    SetText( buf );
+}
+
+template <typename xchar>
+XMLError XMLElementT<xchar>::QueryIntText( int* ival ) const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        const xchar* t = FirstChild()->Value();
+        if ( XMLUtilT<xchar>::ToInt( t, ival ) ) {
+            return XML_SUCCESS;
+        }
+        return XML_CAN_NOT_CONVERT_TEXT;
+    }
+    return XML_NO_TEXT_NODE;
+}
+
+template <typename xchar>
+XMLError XMLElementT<xchar>::QueryUnsignedText( unsigned* uval ) const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        const xchar* t = FirstChild()->Value();
+        if ( XMLUtilT<xchar>::ToUnsigned( t, uval ) ) {
+            return XML_SUCCESS;
+        }
+        return XML_CAN_NOT_CONVERT_TEXT;
+    }
+    return XML_NO_TEXT_NODE;
+}
+
+template <typename xchar>
+XMLError XMLElementT<xchar>::QueryBoolText( bool* bval ) const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        const xchar* t = FirstChild()->Value();
+        if ( XMLUtilT<xchar>::ToBool( t, bval ) ) {
+            return XML_SUCCESS;
+        }
+        return XML_CAN_NOT_CONVERT_TEXT;
+    }
+    return XML_NO_TEXT_NODE;
+}
+
+template <typename xchar>
+XMLError XMLElementT<xchar>::QueryDoubleText( double* dval ) const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        const xchar* t = FirstChild()->Value();
+        if ( XMLUtilT<xchar>::ToDouble( t, dval ) ) {
+            return XML_SUCCESS;
+        }
+        return XML_CAN_NOT_CONVERT_TEXT;
+    }
+    return XML_NO_TEXT_NODE;
+}
+
+template <typename xchar>
+XMLError XMLElementT<xchar>::QueryFloatText( float* fval ) const
+{
+    if ( FirstChild() && FirstChild()->ToText() ) {
+        const xchar* t = FirstChild()->Value();
+        if ( XMLUtilT<xchar>::ToFloat( t, fval ) ) {
+            return XML_SUCCESS;
+        }
+        return XML_CAN_NOT_CONVERT_TEXT;
+    }
+    return XML_NO_TEXT_NODE;
+}
+
+
+template <typename xchar>
+XMLAttributeT<xchar>* XMLElementT<xchar>::FindOrCreateAttribute( const xchar* name )
+{
+    XMLAttributeT<xchar>* last = 0;
+    XMLAttributeT<xchar>* attrib = 0;
+    for( attrib = _rootAttribute;
+            attrib;
+            last = attrib, attrib = attrib->_next ) {
+        if ( XMLUtilT<xchar>::StringEqual( attrib->Name(), name ) ) {
+            break;
+        }
+    }
+    if ( !attrib ) {
+        TIXMLASSERT( sizeof( XMLAttribute ) == _document->_attributePool.ItemSize() );
+        attrib = new (_document->_attributePool.Alloc() ) XMLAttributeT<xchar>();
+        attrib->_document = _document;
+        if ( last ) {
+            last->_next = attrib;
         }
-        if ( !p ) {
-            _document->SetError( XML_ERROR_PARSING_TEXT, start, 0 );
+        else {
+            _rootAttribute = attrib;
         }
+        attrib->SetName( name );
+        _document->_attributePool.SetTracked(); // always created and linked.
     }
-    return 0;
+    this->MarkDirty();	// the caller is about to set the value
+    return attrib;
 }
 
 template <typename xchar>
-XMLNodeT<xchar>* XMLTextT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+void XMLElementT<xchar>::DeleteAttribute( const xchar* name )
 {
-    if ( !doc ) {
-        doc = _document;
+    XMLAttributeT<xchar>* prev = 0;
+    for( XMLAttributeT<xchar>* a=_rootAttribute; a; a=a->_next ) {
+        if ( XMLUtilT<xchar>::StringEqual( name, a->Name() ) ) {
+            this->MarkDirty();
+            if ( prev ) {
+                prev->_next = a->_next;
+            }
+            else {
+                _rootAttribute = a->_next;
+            }
+            DeleteAttribute( a );
+            break;
+        }
+        prev = a;
     }
-    XMLTextT<xchar>* text = doc->NewText( Value() );	// fixme: this will always allocate memory. Intern?
-    text->SetCData( this->CData() );
-    return text;
 }
 
 template <typename xchar>
-bool XMLTextT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+xchar* XMLElementT<xchar>::ParseAttributes( xchar* p )
 {
-    const XMLTextT<xchar>* text = compare->ToText();
-    return ( text && XMLUtilT<xchar>::StringEqual( text->Value(), Value() ) );
-}
+    const xchar* start = p;
+    XMLAttributeT<xchar>* prevAttribute = 0;
 
-template <typename xchar>
-bool XMLTextT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
-{
-    TIXMLASSERT( visitor );
-    return visitor->Visit( *this );
-}
+    // Read the attributes.
+    while( p ) {
+        p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+        if ( !(*p) ) {
+            _document->SetError( XML_ERROR_PARSING_ELEMENT, start, Name() );
+            return 0;
+        }
 
+        // attribute.
+        if ( NameCharLength( p, NAME_START_CHAR ) ) {
+            TIXMLASSERT( sizeof( XMLAttribute ) == _document->_attributePool.ItemSize() );
+            XMLAttributeT<xchar>* attrib = new (_document->_attributePool.Alloc() ) XMLAttributeT<xchar>();
+            attrib->_document = _document;
+			_document->_attributePool.SetTracked();
 
-// --------- XMLComment ---------- //
+            p = attrib->ParseDeep( p, _document->ProcessEntities() );
+            if ( !p || Attribute( attrib->Name() ) ) {
+                DeleteAttribute( attrib );
+                _document->SetError( XML_ERROR_PARSING_ATTRIBUTE, start, p );
+                return 0;
+            }
+            // There is a minor bug here: if the attribute in the source xml
+            // document is duplicated, it will not be detected and the
+            // attribute will be doubly added. However, tracking the 'prevAttribute'
+            // avoids re-scanning the attribute list. Preferring performance for
+            // now, may reconsider in the future.
+            if ( prevAttribute ) {
+                prevAttribute->_next = attrib;
+            }
+            else {
+                _rootAttribute = attrib;
+            }
+            prevAttribute = attrib;
+        }
+        // end of the tag
+        else if ( *p == '>' ) {
+            ++p;
+            break;
+        }
+        // end of the tag
+        else if ( *p == '/' && *(p+1) == '>' ) {
+            _closingType = CLOSED;
+            return p+2;	// done; sealed element.
+        }
+        else {
+            _document->SetError( XML_ERROR_PARSING_ELEMENT, start, p );
+            return 0;
+        }
+    }
+    return p;
+}
 
 template <typename xchar>
-XMLCommentT<xchar>::XMLCommentT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
+void XMLElementT<xchar>::DeleteAttribute( XMLAttributeT<xchar>* attribute )
 {
+    if ( attribute == 0 ) {
+        return;
+    }
+    MemPool* pool = &attribute->_document->_attributePool;
+    attribute->~XMLAttributeT();
+    pool->Free( attribute );
 }
 
-
+//
+//	<ele></ele>
+//	<ele>foo<b>bar</b></ele>
+//
 template <typename xchar>
-XMLCommentT<xchar>::~XMLCommentT()
+xchar* XMLElementT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* strPair )
 {
-}
+    const xchar* start = p - 1;		// Identify() has read the '<'
 
+    // Read the element name.
+    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
 
-template <typename xchar>
-xchar* XMLCommentT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
-{
-    // Comment parses as text.
-    const xchar* start = p;
-	xchar cmtendTag[] = {'-', '-', '>', 0};
-	p = _value.ParseText( p, cmtendTag, StrPairT<xchar>::COMMENT );
-    if ( p == 0 ) {
-        _document->SetError( XML_ERROR_PARSING_COMMENT, start, 0 );
+    // The closing element is the </element> form. It is
+    // parsed just like a regular element then deleted from
+    // the DOM.
+    if ( *p == '/' ) {
+        _closingType = CLOSING;
+        ++p;
+    }
+
+    p = _value.ParseName( CharBuffer(), p );
+    if ( _value.Empty() ) {
+        return 0;
+    }
+
+    p = ParseAttributes( p );
+    if ( p && *p && !_closingType ) {
+        p = XMLNodeT<xchar>::ParseDeep( p, strPair );
+    }
+    if ( p && _document->_source ) {
+        _sourceStart = static_cast<unsigned>( start - CharBuffer() );
+        _sourceLength = static_cast<unsigned>( p - start );
     }
     return p;
 }
 
 
 template <typename xchar>
-XMLNodeT<xchar>* XMLCommentT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+XMLNodeT<xchar>* XMLElementT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
 {
     if ( !doc ) {
         doc = _document;
     }
-    XMLCommentT<xchar>* comment = doc->NewComment( Value() );	// fixme: this will always allocate memory. Intern?
-    return comment;
+    XMLElementT<xchar>* element = doc->NewElement( Value() );					// fixme: this will always allocate memory. Intern?
+    for( const XMLAttributeT<xchar>* a=FirstAttribute(); a; a=a->Next() ) {
+        element->SetAttribute( a->Name(), a->Value() );					// fixme: this will always allocate memory. Intern?
+    }
+    return element;
 }
 
-
 template <typename xchar>
-bool XMLCommentT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+bool XMLElementT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
 {
     TIXMLASSERT( compare );
-    const XMLCommentT<xchar>* comment = compare->ToComment();
-    return ( comment && XMLUtilT<xchar>::StringEqual( comment->Value(), Value() ));
-}
-
-
-template <typename xchar>
-bool XMLCommentT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
-{
-    TIXMLASSERT( visitor );
-    return visitor->Visit( *this );
-}
-
-
-// --------- XMLDeclaration ---------- //
-
-template <typename xchar>
-XMLDeclarationT<xchar>::XMLDeclarationT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
-{
-}
+    const XMLElementT<xchar>* other = compare->ToElement();
+    if ( other && XMLUtilT<xchar>::StringEqual( other->Name(), Name() )) {
 
+        const XMLAttributeT<xchar>* a=FirstAttribute();
+        const XMLAttributeT<xchar>* b=other->FirstAttribute();
 
-template <typename xchar>
-XMLDeclarationT<xchar>::~XMLDeclarationT()
-{
-    //printf( "~XMLDeclaration\n" );
+        while ( a && b ) {
+            if ( !XMLUtilT<xchar>::StringEqual( a->Value(), b->Value() ) ) {
+                return false;
+            }
+            a = a->Next();
+            b = b->Next();
+        }
+        if ( a || b ) {
+            // different count
+            return false;
+        }
+        return true;
+    }
+    return false;
 }
 
-
 template <typename xchar>
-xchar* XMLDeclarationT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+bool XMLElementT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
 {
-    // Declaration parses as text.
-    const xchar* start = p;
-	xchar endTag[] = {'?', '>', 0};
-	p = _value.ParseText( p, endTag, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
-    if ( p == 0 ) {
-        _document->SetError( XML_ERROR_PARSING_DECLARATION, start, 0 );
+    TIXMLASSERT( visitor );
+    if ( visitor->VisitEnter( *this, _rootAttribute ) ) {
+        for ( const XMLNodeT<xchar>* node=FirstChild(); node; node=node->NextSibling() ) {
+            if ( !node->Accept( visitor ) ) {
+                break;
+            }
+        }
     }
-    return p;
+    return visitor->VisitExit( *this );
 }
 
 
-template <typename xchar>
-XMLNodeT<xchar>* XMLDeclarationT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
-{
-    if ( !doc ) {
-        doc = _document;
-    }
-    XMLDeclarationT<xchar>* dec = doc->NewDeclaration( Value() );	// fixme: this will always allocate memory. Intern?
-    return dec;
-}
+// --------- XMLDocument ----------- //
 
+// Warning: List must match 'enum XMLError'
+template<typename xchar>
+const char* XMLDocumentT<xchar>::_errorNames[XML_ERROR_COUNT] = {
+    "XML_SUCCESS",
+    "XML_NO_ATTRIBUTE",
+    "XML_WRONG_ATTRIBUTE_TYPE",
+    "XML_ERROR_FILE_NOT_FOUND",
+    "XML_ERROR_FILE_COULD_NOT_BE_OPENED",
+    "XML_ERROR_FILE_READ_ERROR",
+    "XML_ERROR_ELEMENT_MISMATCH",
+    "XML_ERROR_PARSING_ELEMENT",
+    "XML_ERROR_PARSING_ATTRIBUTE",
+    "XML_ERROR_IDENTIFYING_TAG",
+    "XML_ERROR_PARSING_TEXT",
+    "XML_ERROR_PARSING_CDATA",
+    "XML_ERROR_PARSING_COMMENT",
+    "XML_ERROR_PARSING_DECLARATION",
+    "XML_ERROR_PARSING_UNKNOWN",
+    "XML_ERROR_EMPTY_DOCUMENT",
+    "XML_ERROR_MISMATCHED_ELEMENT",
+    "XML_ERROR_PARSING",
+    "XML_CAN_NOT_CONVERT_TEXT",
+    "XML_NO_TEXT_NODE",
+    "XML_ERROR_INVALID_UTF8",
+    "XML_ERROR_FILE_WRITE_ERROR"
+};
 
-template <typename xchar>
-bool XMLDeclarationT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+template<typename xchar>
+XMLDocumentT<xchar>::XMLDocumentT( bool processEntities, Whitespace whitespace ) :
+    XMLNodeT( 0 ),
+    _writeBOM( false ),
+    _processEntities( processEntities ),
+    _validateUTF8( false ),
+    _errorID( XML_NO_ERROR ),
+    _whitespace( whitespace ),
+    _errorStr1( 0 ),
+    _errorStr2( 0 ),
+    _errorOffset( 0 ),
+    _charBuffer( 0 ),
+    _printCacheLive( 0 ),
+    _preserveSource( false ),
+    _source( 0 ),
+    _parsing( false ),
+    _wideCount( 0 ),
+    _wideGeneration( 1 ),
+    _wideCountGeneration( 1 ),
+    _wideNext( 0 ),
+    _wideEnd( 0 )
 {
-    TIXMLASSERT( compare );
-    const XMLDeclarationT<xchar>* declaration = compare->ToDeclaration();
-    return ( declaration && XMLUtilT<xchar>::StringEqual( declaration->Value(), Value() ));
+    // avoid VC++ C4355 warning about 'this' in initializer list (C4355 is off by default in VS2012+)
+    _document = this;
+    ResetPrintCache();
 }
 
-
-
-template <typename xchar>
-bool XMLDeclarationT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+template<typename xchar>
+XMLDocumentT<xchar>::~XMLDocumentT()
 {
-    TIXMLASSERT( visitor );
-    return visitor->Visit( *this );
+    Clear();
 }
 
-// --------- XMLUnknown ---------- //
-template <typename xchar>
-XMLUnknownT<xchar>::XMLUnknownT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc )
+#ifdef TINYXML2_RVALUE_REFERENCES
+template<typename xchar>
+XMLDocumentT<xchar>::XMLDocumentT( XMLDocumentT<xchar>&& other ) :
+    XMLNodeT( 0 ),
+    _writeBOM( false ),
+    _processEntities( true ),
+    _validateUTF8( false ),
+    _errorID( XML_NO_ERROR ),
+    _whitespace( PRESERVE_WHITESPACE ),
+    _errorStr1( 0 ),
+    _errorStr2( 0 ),
+    _errorOffset( 0 ),
+    _charBuffer( 0 ),
+    _printCacheLive( 0 ),
+    _preserveSource( false ),
+    _source( 0 ),
+    _parsing( false ),
+    _wideCount( 0 ),
+    _wideGeneration( 1 ),
+    _wideCountGeneration( 1 ),
+    _wideNext( 0 ),
+    _wideEnd( 0 )
 {
+    _document = this;
+    ResetPrintCache();
+    Swap( other );
 }
 
-template <typename xchar>
-XMLUnknownT<xchar>::~XMLUnknownT()
+template<typename xchar>
+XMLDocumentT<xchar>& XMLDocumentT<xchar>::operator=( XMLDocumentT<xchar>&& other )
 {
+    if ( this != &other ) {
+        // The old contents go to 'temp', and are deleted with it.
+        XMLDocumentT<xchar> temp( static_cast<XMLDocumentT<xchar>&&>( other ) );
+        Swap( temp );
+    }
+    return *this;
 }
+#endif
 
-template <typename xchar>
-xchar* XMLUnknownT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* )
+template<typename xchar>
+void XMLDocumentT<xchar>::Swap( XMLDocumentT<xchar>& other )
 {
-    // Unknown parses as text.
-    const xchar* start = p;
-	xchar endTag[] = {'>', 0};
-	p = _value.ParseText( p, endTag, StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION );
-    if ( !p ) {
-        _document->SetError( XML_ERROR_PARSING_UNKNOWN, start, 0 );
+    if ( this == &other ) {
+        return;
     }
-    return p;
+    SwapValues( _writeBOM, other._writeBOM );
+    SwapValues( _processEntities, other._processEntities );
+    SwapValues( _validateUTF8, other._validateUTF8 );
+    SwapValues( _errorID, other._errorID );
+    SwapValues( _whitespace, other._whitespace );
+    SwapValues( _errorStr1, other._errorStr1 );
+    SwapValues( _errorStr2, other._errorStr2 );
+    SwapValues( _errorOffset, other._errorOffset );
+    SwapValues( _charBuffer, other._charBuffer );
+
+    _elementPool.Swap( other._elementPool );
+    _attributePool.Swap( other._attributePool );
+    _textPool.Swap( other._textPool );
+    _commentPool.Swap( other._commentPool );
+    _unlinked.Swap( other._unlinked );
+    _printCache.Swap( other._printCache );
+    _printCacheText.Swap( other._printCacheText );
+    SwapValues( _printCacheLive, other._printCacheLive );
+    SwapValues( _preserveSource, other._preserveSource );
+    SwapValues( _source, other._source );
+    _wideIndex.Swap( other._wideIndex );
+    SwapValues( _wideCount, other._wideCount );
+    SwapValues( _wideGeneration, other._wideGeneration );
+    SwapValues( _wideCountGeneration, other._wideCountGeneration );
+    _wideBlocks.Swap( other._wideBlocks );
+    SwapValues( _wideNext, other._wideNext );
+    SwapValues( _wideEnd, other._wideEnd );
+    for( int i=0; i<PRINT_CACHE_LAYOUT; ++i ) {
+        SwapValues( _printCacheLayout[i], other._printCacheLayout[i] );
+    }
+
+    SwapValues( _firstChild, other._firstChild );
+    SwapValues( _lastChild, other._lastChild );
+
+    AdoptNodes();
+    other.AdoptNodes();
 }
 
-template <typename xchar>
-XMLNodeT<xchar>* XMLUnknownT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::AdoptNodes()
 {
-    if ( !doc ) {
-        doc = _document;
+    for( XMLNodeT<xchar>* node = _firstChild; node; node = node->_next ) {
+        node->_parent = this;
+        AdoptSubtree( node );
+    }
+    for( int i=0; i<_unlinked.Size(); ++i ) {
+        AdoptSubtree( _unlinked[i] );
     }
-    XMLUnknownT<xchar>* text = doc->NewUnknown( Value() );	// fixme: this will always allocate memory. Intern?
-    return text;
 }
 
-template <typename xchar>
-bool XMLUnknownT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::AdoptSubtree( XMLNodeT<xchar>* root )
 {
-    TIXMLASSERT( compare );
-    const XMLUnknownT<xchar>* unknown = compare->ToUnknown();
-    return ( unknown && XMLUtilT<xchar>::StringEqual( unknown->Value(), Value() ));
+    // Pre-order walk of 'root' and everything under it.
+    XMLNodeT<xchar>* node = root;
+    while ( node ) {
+        node->_document = this;
+        XMLElementT<xchar>* ele = node->ToElement();
+        if ( ele ) {
+            node->_memPool = &_elementPool;
+            for( XMLAttributeT<xchar>* a = ele->_rootAttribute; a; a = a->_next ) {
+                a->_document = this;
+            }
+        }
+        else if ( node->ToText() ) {
+            node->_memPool = &_textPool;
+        }
+        else {
+            node->_memPool = &_commentPool;
+        }
+
+        if ( node->_firstChild ) {
+            node = node->_firstChild;
+            continue;
+        }
+        while ( node != root && !node->_next ) {
+            node = node->_parent;
+        }
+        node = ( node == root ) ? 0 : node->_next;
+    }
 }
 
-template <typename xchar>
-bool XMLUnknownT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::TrackUnlinked( XMLNodeT<xchar>* node )
 {
-    TIXMLASSERT( visitor );
-    return visitor->Visit( *this );
+    TIXMLASSERT( node );
+    TIXMLASSERT( node->_unlinkedIndex < 0 );
+    node->_unlinkedIndex = _unlinked.Size();
+    _unlinked.Push( node );
 }
 
-// --------- XMLAttribute ---------- //
-
-template <typename xchar>
-const xchar* XMLAttributeT<xchar>::Name() const 
+template<typename xchar>
+void XMLDocumentT<xchar>::MarkInUse( XMLNodeT<xchar>* node )
 {
-    return _name.GetStr();
+    TIXMLASSERT( node );
+    TIXMLASSERT( node->_parent == 0 );
+    // Nodes detached from the tree were never in the list.
+    const int index = node->_unlinkedIndex;
+    if ( index < 0 ) {
+        return;
+    }
+    TIXMLASSERT( index < _unlinked.Size() && _unlinked[index] == node );
+    XMLNodeT<xchar>* last = _unlinked.PeekTop();
+    _unlinked[index] = last;
+    last->_unlinkedIndex = index;
+    _unlinked.Pop();
+    node->_unlinkedIndex = -1;
 }
 
-template <typename xchar>
-const xchar* XMLAttributeT<xchar>::Value() const 
+template<typename xchar>
+void XMLDocumentT<xchar>::DeepCopy( XMLDocumentT<xchar>* target ) const
 {
-    return _value.GetStr();
+    TIXMLASSERT( target );
+    if ( target == this ) {
+        return;
+    }
+    target->Clear();
+    // One pass over the whole document sizes the pools and strings.
+    CloneBlock strings;
+    target->PrepareClone( this, &strings );
+    for( const XMLNodeT<xchar>* node = _firstChild; node; node = node->_next ) {
+        target->InsertEndChild( target->CloneSubtree( node, &strings ) );
+    }
 }
 
-template <typename xchar>
-xchar* XMLAttributeT<xchar>::ParseDeep( xchar* p, bool processEntities )
+template<typename xchar>
+static void AddCloneSize( const xchar* str, size_t* size, size_t* count )
 {
-    // Parse using the name rules: bug fix, was using ParseText before
-    p = _name.ParseName( p );
-    if ( !p || !*p ) {
-        return 0;
+    const size_t s = StrPairT<xchar>::CloneSize( str );
+    if ( s ) {
+        *size += s;
+        ++*count;
     }
+}
 
-    // Skip white space before =
-    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-    if ( *p != '=' ) {
-        return 0;
-    }
+template<typename xchar>
+void XMLDocumentT<xchar>::PrepareClone( const XMLNodeT<xchar>* root, CloneBlock* strings )
+{
+    int elements = 0;
+    int attributes = 0;
+    int texts = 0;
+    int comments = 0;
+    size_t size = 0;
+    size_t count = 0;
+
+    const XMLNodeT<xchar>* node = root;
+    while ( node ) {
+        if ( const XMLElementT<xchar>* ele = node->ToElement() ) {
+            ++elements;
+            for( const XMLAttributeT<xchar>* a = ele->FirstAttribute(); a; a = a->Next() ) {
+                ++attributes;
+                AddCloneSize( a->Name(), &size, &count );
+                AddCloneSize( a->Value(), &size, &count );
+            }
+        }
+        else if ( node->ToText() ) {
+            ++texts;
+        }
+        else if ( !node->ToDocument() ) {
+            ++comments;
+        }
+        if ( node->Value() ) {
+            AddCloneSize( node->Value(), &size, &count );
+        }
 
-    ++p;	// move up to opening quote
-    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-    if ( *p != '\"' && *p != '\'' ) {
-        return 0;
+        if ( node->_firstChild ) {
+            node = node->_firstChild;
+            continue;
+        }
+        while ( node != root && !node->_next ) {
+            node = node->_parent;
+        }
+        node = ( node == root ) ? 0 : node->_next;
     }
 
-    xchar endTag[2] = { *p, 0 };
-    ++p;	// move past opening quote
+    _elementPool.Reserve( elements );
+    _attributePool.Reserve( attributes );
+    _textPool.Reserve( texts );
+    _commentPool.Reserve( comments );
 
-    p = _value.ParseText( p, endTag, processEntities ? StrPairT<xchar>::ATTRIBUTE_VALUE : StrPairT<xchar>::ATTRIBUTE_VALUE_LEAVE_ENTITIES );
-    return p;
+    StrPairT<xchar>::NewCloneBlock( strings, size, count );
 }
 
-
-template <typename xchar>
-void XMLAttributeT<xchar>::SetName( const xchar* n )
-{
-    _name.SetStr( n );
+template<typename xchar>
+XMLNodeT<xchar>* XMLDocumentT<xchar>::CloneNode( const XMLNodeT<xchar>* node, CloneBlock* strings )
+{
+    XMLNodeT<xchar>* clone = 0;
+    if ( const XMLElementT<xchar>* ele = node->ToElement() ) {
+        XMLElementT<xchar>* element = new (_elementPool.Alloc()) XMLElementT<xchar>( this );
+        element->_memPool = &_elementPool;
+        XMLAttributeT<xchar>** last = &element->_rootAttribute;
+        for( const XMLAttributeT<xchar>* a = ele->FirstAttribute(); a; a = a->Next() ) {
+            XMLAttributeT<xchar>* attrib = new (_attributePool.Alloc()) XMLAttributeT<xchar>();
+            attrib->_document = this;
+            _attributePool.SetTracked();
+            attrib->_name.SetClonedStr( a->Name(), strings );
+            attrib->_value.SetClonedStr( a->Value(), strings );
+            *last = attrib;
+            last = &attrib->_next;
+        }
+        clone = element;
+    }
+    else if ( const XMLTextT<xchar>* text = node->ToText() ) {
+        XMLTextT<xchar>* t = new (_textPool.Alloc()) XMLTextT<xchar>( this );
+        t->_memPool = &_textPool;
+        t->SetCData( text->CData() );
+        clone = t;
+    }
+    else {
+        if ( node->ToComment() ) {
+            clone = new (_commentPool.Alloc()) XMLCommentT<xchar>( this );
+        }
+        else if ( node->ToDeclaration() ) {
+            clone = new (_commentPool.Alloc()) XMLDeclarationT<xchar>( this );
+        }
+        else {
+            TIXMLASSERT( node->ToUnknown() );
+            clone = new (_commentPool.Alloc()) XMLUnknownT<xchar>( this );
+        }
+        clone->_memPool = &_commentPool;
+    }
+    clone->_value.SetClonedStr( node->Value(), strings );
+    return clone;
 }
 
+template<typename xchar>
+XMLNodeT<xchar>* XMLDocumentT<xchar>::CloneSubtree( const XMLNodeT<xchar>* root, CloneBlock* strings )
+{
+    // Pre-order walk of the source, keeping 'clone' in step with 'node'.
+    // New children are linked directly: they can't already be in a tree.
+    XMLNodeT<xchar>* const cloneRoot = CloneNode( root, strings );
+    XMLNodeT<xchar>* clone = cloneRoot;
+    const XMLNodeT<xchar>* node = root;
+    for( ;; ) {
+        XMLNodeT<xchar>* parent = 0;
+        if ( node->_firstChild ) {
+            node = node->_firstChild;
+            parent = clone;
+        }
+        else {
+            while ( node != root && !node->_next ) {
+                node = node->_parent;
+                clone = clone->_parent;
+            }
+            if ( node == root ) {
+                break;
+            }
+            node = node->_next;
+            parent = clone->_parent;
+        }
+        clone = CloneNode( node, strings );
+        clone->_parent = parent;
+        clone->_prev = parent->_lastChild;
+        if ( parent->_lastChild ) {
+            parent->_lastChild->_next = clone;
+        }
+        else {
+            parent->_firstChild = clone;
+        }
+        parent->_lastChild = clone;
+        clone->_memPool->SetTracked();
+    }
+    return cloneRoot;
+}
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryIntValue( int* value ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::Clear()
 {
-    if ( XMLUtilT<xchar>::ToInt( Value(), value )) {
-        return XML_NO_ERROR;
+    DeleteChildren();
+    ResetPrintCache();
+
+#ifdef DEBUG
+    const bool hadError = Error();
+#endif
+    _errorID = XML_NO_ERROR;
+    _errorStr1 = 0;
+    _errorStr2 = 0;
+    _errorOffset = 0;
+
+    delete [] _charBuffer;
+    _charBuffer = 0;
+    delete [] _source;
+    _source = 0;
+    ClearWideStrings();
+
+#if 0
+    _textPool.Trace( "text" );
+    _elementPool.Trace( "element" );
+    _commentPool.Trace( "comment" );
+    _attributePool.Trace( "attribute" );
+#endif
+    
+#ifdef DEBUG
+    // Unlinked nodes may own children and attributes, which are tracked.
+    if ( !hadError && _unlinked.Empty() ) {
+        TIXMLASSERT( _elementPool.CurrentAllocs()   == _elementPool.Untracked() );
+        TIXMLASSERT( _attributePool.CurrentAllocs() == _attributePool.Untracked() );
+        TIXMLASSERT( _textPool.CurrentAllocs()      == _textPool.Untracked() );
+        TIXMLASSERT( _commentPool.CurrentAllocs()   == _commentPool.Untracked() );
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+#endif
 }
 
+template<typename xchar>
+void XMLDocumentT<xchar>::Compact()
+{
+    _elementPool.BeginRelocation();
+    _attributePool.BeginRelocation();
+    _textPool.BeginRelocation();
+    _commentPool.BeginRelocation();
+
+    // Pre-order walk. When a node moves, its parent has already moved,
+    // so every link to the old address can be patched in place.
+    XMLNodeT<xchar>* node = _firstChild;
+    while ( node ) {
+        XMLNodeT<xchar>* moved = static_cast<XMLNodeT<xchar>*>( node->_memPool->Relocate( node ) );
+        XMLNodeT<xchar>* parent = moved->_parent;
+        TIXMLASSERT( parent );
+        if ( parent->_firstChild == node ) {
+            parent->_firstChild = moved;
+        }
+        if ( parent->_lastChild == node ) {
+            parent->_lastChild = moved;
+        }
+        if ( moved->_prev ) {
+            moved->_prev->_next = moved;
+        }
+        if ( moved->_next ) {
+            moved->_next->_prev = moved;
+        }
+        for( XMLNodeT<xchar>* child = moved->_firstChild; child; child = child->_next ) {
+            child->_parent = moved;
+        }
+        // The print cache keeps its output, keyed by the new address.
+        const int entry = moved->_printCacheEntry;
+        if ( entry >= 0 && entry < _printCache.Size() && _printCache[entry].node == node ) {
+            _printCache[entry].node = moved;
+        }
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryUnsignedValue( unsigned int* value ) const
-{
-    if ( XMLUtilT<xchar>::ToUnsigned( Value(), value )) {
-        return XML_NO_ERROR;
+        XMLElementT<xchar>* ele = moved->ToElement();
+        if ( ele ) {
+            for( XMLAttributeT<xchar>** a = &ele->_rootAttribute; *a; a = &(*a)->_next ) {
+                *a = static_cast<XMLAttributeT<xchar>*>( _attributePool.Relocate( *a ) );
+            }
+        }
+
+        if ( moved->_firstChild ) {
+            node = moved->_firstChild;
+            continue;
+        }
+        node = moved;
+        while ( node != this && !node->_next ) {
+            node = node->_parent;
+        }
+        node = ( node == this ) ? 0 : node->_next;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+
+    _elementPool.EndRelocation();
+    _attributePool.EndRelocation();
+    _textPool.EndRelocation();
+    _commentPool.EndRelocation();
+}
+
+template<typename xchar>
+XMLElementT<xchar>* XMLDocumentT<xchar>::NewElement( const xchar* name )
+{
+    TIXMLASSERT( sizeof( XMLElement ) == _elementPool.ItemSize() );
+    XMLElementT<xchar>* ele = new (_elementPool.Alloc()) XMLElementT<xchar>( this );
+    ele->_memPool = &_elementPool;
+    TrackUnlinked( ele );
+    ele->SetName( name );
+    return ele;
 }
 
+template<typename xchar>
+XMLCommentT<xchar>* XMLDocumentT<xchar>::NewComment( const xchar* str )
+{
+    TIXMLASSERT( sizeof( XMLComment ) == _commentPool.ItemSize() );
+    XMLCommentT<xchar>* comment = new (_commentPool.Alloc()) XMLCommentT<xchar>( this );
+    comment->_memPool = &_commentPool;
+    TrackUnlinked( comment );
+    comment->SetValue( str );
+    return comment;
+}
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryInt8Value( char* value ) const
+template<typename xchar>
+XMLTextT<xchar>* XMLDocumentT<xchar>::NewText( const xchar* str )
 {
-    if ( XMLUtilT<xchar>::ToInt8( Value(), value )) {
-        return XML_NO_ERROR;
-    }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+    TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
+    XMLTextT<xchar>* text = new (_textPool.Alloc()) XMLTextT<xchar>( this );
+    text->_memPool = &_textPool;
+    TrackUnlinked( text );
+    text->SetValue( str );
+    return text;
 }
 
+template<typename xchar>
+XMLDeclarationT<xchar>* XMLDocumentT<xchar>::NewDeclaration( const xchar* str )
+{
+    TIXMLASSERT( sizeof( XMLDeclaration ) == _commentPool.ItemSize() );
+    XMLDeclarationT<xchar>* dec = new (_commentPool.Alloc()) XMLDeclarationT<xchar>( this );
+    dec->_memPool = &_commentPool;
+    TrackUnlinked( dec );
+	
+	xchar xmlTag[] = {'x', 'm', 'l', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n', '=', 
+					'"', '1', '.', '0', '"', ' ', 'e', 'n', 'c', 'o', 'd', 'i', 
+					'n', 'g', '=', '"', 'U', 'T', 'F', '-', '8', '"', 0};
+    dec->SetValue( str ? str : xmlTag );
+    return dec;
+}
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryUnsigned8Value( unsigned char* value ) const
+template<typename xchar>
+XMLUnknownT<xchar>* XMLDocumentT<xchar>::NewUnknown( const xchar* str )
 {
-    if ( XMLUtilT<xchar>::ToUnsigned8( Value(), value )) {
-        return XML_NO_ERROR;
+    TIXMLASSERT( sizeof( XMLUnknown ) == _commentPool.ItemSize() );
+    XMLUnknownT<xchar>* unk = new (_commentPool.Alloc()) XMLUnknownT<xchar>( this );
+    unk->_memPool = &_commentPool;
+    TrackUnlinked( unk );
+    unk->SetValue( str );
+    return unk;
+}
+
+template<typename xchar>
+void XMLDocumentT<xchar>::DeleteNode( XMLNodeT<xchar>* node )	{
+    TIXMLASSERT( node );
+    TIXMLASSERT(node->_document == this );
+    if (node->_parent) {
+        node->_parent->DeleteChild( node );
+    }
+    else {
+        // Isn't in the tree.
+        // Use the parent delete.
+        // Also, we need to mark it tracked: we 'know'
+        // it was never used.
+        MarkInUse( node );
+        node->_memPool->SetTracked();
+        // Call the static XMLNodeT version:
+        XMLNodeT<xchar>::DeleteNode(node);
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
 }
 
-
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryInt16Value( short* value ) const
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::LoadFile( const xchar* filename )
 {
-    if ( XMLUtilT<xchar>::ToInt16( Value(), value )) {
-        return XML_NO_ERROR;
+    Clear();
+    const int fd = OpenPath( filename, false, true );
+    if ( fd < 0 ) {
+        SetError( XML_ERROR_FILE_NOT_FOUND, filename, 0 );
+        return _errorID;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+    LoadBytes( 0, fd, PathSize( fd ) );
+    ClosePath( fd );
+    return _errorID;
 }
 
-
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryUnsigned16Value( unsigned short* value ) const
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::LoadFile( FILE* fp )
 {
-    if ( XMLUtilT<xchar>::ToUnsigned16( Value(), value )) {
-        return XML_NO_ERROR;
+    Clear();
+
+    fseek( fp, 0, SEEK_SET );
+    if ( fgetc( fp ) == EOF && ferror( fp ) != 0 ) {
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
-}
 
+    fseek( fp, 0, SEEK_END );
+    const long filelength = ftell( fp );
+    fseek( fp, 0, SEEK_SET );
+    return LoadBytes( fp, -1, filelength );
+}
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryInt64Value( long long* value ) const
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::LoadBytes( FILE* fp, int fd, long long filelength )
 {
-    if ( XMLUtilT<xchar>::ToInt64( Value(), value )) {
-        return XML_NO_ERROR;
+    if ( filelength < 0 ) {
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
-}
 
+    if ( (unsigned long long)filelength >= (size_t)-1 ) {
+        // Cannot handle files which won't fit in buffer together with null terminator
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
+    }
+    if ( (unsigned long long)filelength / sizeof(xchar) >= UINT_MAX ) {
+        // Strings are stored as 32-bit offsets into the buffer.
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
+    }
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryUnsigned64Value( unsigned long long* value ) const
-{
-    if ( XMLUtilT<xchar>::ToUnsigned64( Value(), value )) {
-        return XML_NO_ERROR;
+    if ( filelength == 0 ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
-}
 
+    if ( LoadBuffer( fp, fd, (size_t)filelength ) != XML_NO_ERROR ) {
+        return _errorID;
+    }
+    Parse();
+    return _errorID;
+}
 
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryBoolValue( bool* value ) const
+template< >
+XMLError XMLDocumentT<char>::LoadBuffer( FILE* fp, int fd, size_t size )
 {
-    if ( XMLUtilT<xchar>::ToBool( Value(), value )) {
-        return XML_NO_ERROR;
+    TIXMLASSERT( _charBuffer == 0 );
+    _charBuffer = new char[size+1];
+    if ( !ReadFully( fp, fd, _charBuffer, size ) ) {
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+    _charBuffer[size] = 0;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( _charBuffer );
+    size_t nameStart = 0;
+    size_t nameEnd = 0;
+    const int encoding = DeclaredEncoding( bytes, size, &nameStart, &nameEnd );
+    if ( encoding != SOURCE_UTF8 ) {
+        char* source = _charBuffer;
+        _charBuffer = SingleByteToUTF8( bytes, size, encoding, nameStart, nameEnd, &size );
+        delete [] source;
+    }
+    else if ( _validateUTF8 && !CheckUTF8( _charBuffer, size ) ) {
+        return _errorID;
+    }
+    if ( size >= UINT_MAX ) {
+        // Strings are stored as 32-bit offsets into the buffer.
+        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
+        return _errorID;
+    }
+    return XML_NO_ERROR;
 }
 
-
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryFloatValue( float* value ) const
+template< >
+XMLError XMLDocumentT<wchar_t>::LoadBuffer( FILE* fp, int fd, size_t size )
 {
-    if ( XMLUtilT<xchar>::ToFloat( Value(), value )) {
-        return XML_NO_ERROR;
+    TIXMLASSERT( _charBuffer == 0 );
+    size_t invalidOffset = 0;
+    const XMLError error = ReadTranscoded<wchar_t>( fp, fd, size, _charBuffer, _validateUTF8, &invalidOffset );
+    if ( error != XML_NO_ERROR ) {
+        SetError( error, 0, 0 );
+        _errorOffset = invalidOffset;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+    return error;
 }
 
-
-template <typename xchar>
-XMLError XMLAttributeT<xchar>::QueryDoubleValue( double* value ) const
+#ifdef TINYXML2_CHAR16
+template< >
+XMLError XMLDocumentT<char16_t>::LoadBuffer( FILE* fp, int fd, size_t size )
 {
-    if ( XMLUtilT<xchar>::ToDouble( Value(), value )) {
-        return XML_NO_ERROR;
+    TIXMLASSERT( _charBuffer == 0 );
+    size_t invalidOffset = 0;
+    const XMLError error = ReadTranscoded<char16_t>( fp, fd, size, _charBuffer, _validateUTF8, &invalidOffset );
+    if ( error != XML_NO_ERROR ) {
+        SetError( error, 0, 0 );
+        _errorOffset = invalidOffset;
     }
-    return XML_WRONG_ATTRIBUTE_TYPE;
+    return error;
 }
+#endif
 
-
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( const xchar* v )
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::SaveFile( const xchar* filename, bool compact )
 {
-    _value.SetStr( v );
+    // Narrow documents keep the platform's line endings; wide ones are
+    // written as UTF-8 bytes.
+    const int fd = OpenPath( filename, true, sizeof( xchar ) > 1 );
+    if ( fd < 0 ) {
+        SetError( XML_ERROR_FILE_COULD_NOT_BE_OPENED, filename, 0 );
+        return _errorID;
+    }
+    SetError( XML_NO_ERROR, 0, 0 );
+    bool written = false;
+    if ( sizeof( xchar ) == 1 ) {
+        XMLFdSinkT<xchar> file( fd );
+        XMLPrinterT<xchar> stream( file, compact );
+        Print( &stream );
+        stream.Flush();
+        written = !file.Error();
+    }
+    else {
+        XMLFdSinkT<char> file( fd );
+        XMLEncodingSinkT<xchar> encoder( file, XML_ENCODING_UTF8 );
+        XMLPrinterT<xchar> stream( encoder, compact );
+        Print( &stream );
+        stream.Flush();
+        written = !file.Error();
+    }
+    if ( !ClosePath( fd ) ) {
+        written = false;
+    }
+    if ( !written ) {
+        SetError( XML_ERROR_FILE_WRITE_ERROR, filename, 0 );
+    }
+    return _errorID;
 }
 
-
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( int v )
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::SaveFile( FILE* fp, bool compact )
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    _value.SetStr( buf );
+    // Clear any error from the last save, otherwise it will get reported
+    // for *this* call.
+    SetError( XML_NO_ERROR, 0, 0 );
+    if ( sizeof( xchar ) == 1 ) {
+        XMLPrinterT<xchar> stream( fp, compact );
+        Print( &stream );
+    }
+    else {
+        XMLFileSinkT<char> file( fp );
+        XMLEncodingSinkT<xchar> encoder( file, XML_ENCODING_UTF8 );
+        XMLPrinterT<xchar> stream( encoder, compact );
+        Print( &stream );
+        stream.Flush();
+    }
+    return _errorID;
 }
 
-
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( unsigned v )
+template<typename xchar>
+XMLError XMLDocumentT<xchar>::Parse( const xchar* p, size_t len )
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    _value.SetStr( buf );
-}
+    Clear();
 
+    if ( len == 0 || !p || !*p ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return _errorID;
+    }
+    if ( len == (size_t)(-1) ) {
+        len = strlen( p );
+    }
+    if ( len >= UINT_MAX ) {
+        // Strings are stored as 32-bit offsets into the buffer.
+        SetError( XML_ERROR_PARSING, 0, 0 );
+        return _errorID;
+    }
+    TIXMLASSERT( _charBuffer == 0 );
+    int encoding = SOURCE_UTF8;
+    size_t nameStart = 0;
+    size_t nameEnd = 0;
+    if ( sizeof( xchar ) == 1 ) {
+        encoding = DeclaredEncoding( reinterpret_cast<const unsigned char*>( p ), len, &nameStart, &nameEnd );
+    }
+    if ( encoding != SOURCE_UTF8 ) {
+        // ISO-8859-1 or Windows-1252, transcoded to UTF-8.
+        _charBuffer = SingleByteToUTF8( reinterpret_cast<const unsigned char*>( p ), len, encoding, nameStart, nameEnd, &len );
+        if ( len >= UINT_MAX ) {
+            SetError( XML_ERROR_PARSING, 0, 0 );
+            return _errorID;
+        }
+    }
+    else {
+        if ( sizeof( xchar ) == 1 && _validateUTF8 && !CheckUTF8( reinterpret_cast<const char*>( p ), len ) ) {
+            return _errorID;
+        }
+        _charBuffer = new char[ (len+1)*sizeof(xchar) ];
+        memcpy( _charBuffer, p, len*sizeof(xchar) );
+        CharBuffer()[len] = 0;
+    }
 
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( bool v )
-{
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    _value.SetStr( buf );
+    Parse();
+    if ( Error() ) {
+        // clean up now essentially dangling memory.
+        // and the parse fail can put objects in the
+        // pools that are dead and inaccessible.
+        DeleteChildren();
+        _unlinked.Clear();
+        _elementPool.Clear();
+        _attributePool.Clear();
+        _textPool.Clear();
+        _commentPool.Clear();
+    }
+    return _errorID;
 }
 
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( double v )
+template<typename xchar>
+void XMLDocumentT<xchar>::Print( XMLPrinterT<xchar>* streamer ) const
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    _value.SetStr( buf );
+    if ( streamer ) {
+        Accept( streamer );
+    }
+    else {
+        XMLPrinterT<xchar> stdoutStreamer( stdout );
+        Accept( &stdoutStreamer );
+    }
 }
 
-template <typename xchar>
-void XMLAttributeT<xchar>::SetAttribute( float v )
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintParallel( XMLPrinterT<xchar>* streamer, int threadCount ) const
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    _value.SetStr( buf );
-}
+    if ( !streamer ) {
+        XMLPrinterT<xchar> stdoutStreamer( stdout );
+        PrintParallel( &stdoutStreamer, threadCount );
+        return;
+    }
+#ifdef TIXML_THREADS
+    if ( threadCount <= 0 ) {
+        threadCount = static_cast<int>( std::thread::hardware_concurrency() );
+    }
+    // Siblings only print the same way independently of each other if
+    // none of them is text: text switches the printer into inline layout.
+    const XMLElementT<xchar>* root = RootElement();
+    int count = 0;
+    bool split = ( root != 0 );
+    for( const XMLNodeT<xchar>* node = root ? root->FirstChild() : 0; node && split; node = node->NextSibling() ) {
+        split = ( node->ToText() == 0 );
+        ++count;
+    }
+    // The parts are printed by plain printers, which only stand in for
+    // 'streamer' if it doesn't override anything.
+    if ( !split || count < 2 || threadCount < 2 || typeid( *streamer ) != typeid( XMLPrinterT<xchar> ) ) {
+        Print( streamer );
+        return;
+    }
+    if ( threadCount > count ) {
+        threadCount = count;
+    }
 
+    streamer->VisitEnter( *this );
+    for( const XMLNodeT<xchar>* node = FirstChild(); node; node = node->NextSibling() ) {
+        if ( node != root ) {
+            node->Accept( streamer );
+            continue;
+        }
+        streamer->VisitEnter( *root, root->FirstAttribute() );
+        streamer->SealElementIfJustOpened();
+
+        std::vector< XMLPrinterT<xchar> > parts( threadCount );
+        std::vector< std::thread > threads;
+        threads.reserve( threadCount );
+        const XMLNodeT<xchar>* first = root->FirstChild();
+        int i = 0;
+        for( ; i<threadCount; ++i ) {
+            XMLPrinterT<xchar>& part = parts[i];
+            part.CopyLayout( *streamer );
+
+            // Thread i prints children [i*count/threadCount, (i+1)*count/threadCount).
+            const int n = ( i + 1 ) * count / threadCount - i * count / threadCount;
+            const XMLNodeT<xchar>* end = first;
+            for( int j=0; j<n; ++j ) {
+                end = end->NextSibling();
+            }
+            try {
+                threads.push_back( std::thread( &XMLDocumentT<xchar>::PrintSiblings, &part, first, end ) );
+            }
+            catch( ... ) {
+                // Out of threads: the calling thread prints the rest.
+                PrintSiblings( &part, first, 0 );
+                ++i;
+                break;
+            }
+            first = end;
+        }
+        for( size_t t=0; t<threads.size(); ++t ) {
+            threads[t].join();
+        }
+        for( int k=0; k<i; ++k ) {
+            streamer->Write( parts[k].CStr(), parts[k].CStrSize() - 1 );
+        }
 
-// --------- XMLElement ---------- //
-template <typename xchar>
-XMLElementT<xchar>::XMLElementT( XMLDocumentT<xchar>* doc ) : XMLNodeT<xchar>( doc ),
-    _closingType( 0 ),
-    _rootAttribute( 0 )
-{
+        streamer->VisitExit( *root );
+    }
+    streamer->VisitExit( *this );
+#else
+    (void)threadCount;
+    Print( streamer );
+#endif
 }
 
-template <typename xchar>
-XMLElementT<xchar>::~XMLElementT()
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintIncremental( XMLPrinterT<xchar>* streamer, int depth ) const
 {
-    while( _rootAttribute ) {
-        XMLAttributeT<xchar>* next = _rootAttribute->_next;
-        DeleteAttribute( _rootAttribute );
-        _rootAttribute = next;
+    if ( !streamer ) {
+        XMLPrinterT<xchar> stdoutStreamer( stdout );
+        PrintIncremental( &stdoutStreamer, depth );
+        return;
+    }
+    if ( depth < 2 ) {
+        depth = 2;
+    }
+    const int layout[PRINT_CACHE_LAYOUT] = {
+        streamer->_compactMode ? 1 : 0, streamer->_depth,
+        streamer->_indentWidth, static_cast<int>( streamer->_indentChar ), depth
+    };
+    if ( memcmp( layout, _printCacheLayout, sizeof( layout ) ) != 0 ) {
+        ResetPrintCache();
+        memcpy( _printCacheLayout, layout, sizeof( layout ) );
+    }
+
+    XMLPrinterT<xchar> scratch;
+    streamer->VisitEnter( *this );
+    for( const XMLNodeT<xchar>* node = FirstChild(); node; node = node->NextSibling() ) {
+        PrintCached( streamer, &scratch, node, 1, depth );
+    }
+    streamer->VisitExit( *this );
+
+    if ( _printCacheText.Size() > 2 * _printCacheLive + 4096 ) {
+        CompactPrintCache();
     }
 }
 
-template <typename xchar>
-const XMLAttributeT<xchar>* XMLElementT<xchar>::FindAttribute( const xchar* name ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintCached( XMLPrinterT<xchar>* streamer, XMLPrinterT<xchar>* scratch,
+                                       const XMLNodeT<xchar>* node, int level, int depth ) const
 {
-    for( XMLAttributeT<xchar>* a = _rootAttribute; a; a = a->_next ) {
-        if ( XMLUtilT<xchar>::StringEqual( a->Name(), name ) ) {
-            return a;
+    const XMLElementT<xchar>* element = node->ToElement();
+    if ( !element ) {
+        node->Accept( streamer );
+        return;
+    }
+    if ( level == depth ) {
+        const int index = node->_printCacheEntry;
+        if ( index >= 0 && index < _printCache.Size() && _printCache[index].node == node ) {
+            const PrintCacheEntry& entry = _printCache[index];
+            streamer->Write( _printCacheText.Mem() + entry.offset, entry.length );
+            return;
         }
+        scratch->ClearBuffer();
+        scratch->CopyLayout( *streamer );
+        node->Accept( scratch );
+
+        PrintCacheEntry entry;
+        entry.node = node;
+        entry.offset = _printCacheText.Size();
+        entry.length = scratch->CStrSize() - 1;
+        memcpy( _printCacheText.PushArr( entry.length ), scratch->CStr(), entry.length * sizeof( xchar ) );
+        node->_printCacheEntry = _printCache.Size();
+        _printCache.Push( entry );
+        _printCacheLive += entry.length;
+
+        streamer->Write( scratch->CStr(), entry.length );
+        return;
     }
-    return 0;
+
+    // Children are printed one by one only if they are laid out
+    // independently of each other; text switches to inline layout.
+    bool split = ( element->FirstChild() != 0 );
+    for( const XMLNodeT<xchar>* child = element->FirstChild(); child && split; child = child->NextSibling() ) {
+        split = ( child->ToText() == 0 );
+    }
+    if ( !split ) {
+        node->Accept( streamer );
+        return;
+    }
+    streamer->VisitEnter( *element, element->FirstAttribute() );
+    streamer->SealElementIfJustOpened();
+    for( const XMLNodeT<xchar>* child = element->FirstChild(); child; child = child->NextSibling() ) {
+        PrintCached( streamer, scratch, child, level + 1, depth );
+    }
+    streamer->VisitExit( *element );
 }
 
-template <typename xchar>
-const xchar* XMLElementT<xchar>::Attribute( const xchar* name, const xchar* value ) const
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintVerbatim( XMLPrinterT<xchar>* streamer ) const
 {
-    const XMLAttributeT<xchar>* a = FindAttribute( name );
-    if ( !a ) {
-        return 0;
+    if ( !streamer ) {
+        XMLPrinterT<xchar> stdoutStreamer( stdout );
+        PrintVerbatim( &stdoutStreamer );
+        return;
     }
-    if ( !value || XMLUtilT<xchar>::StringEqual( a->Value(), value )) {
-        return a->Value();
+    if ( !_source ) {
+        Print( streamer );
+        return;
     }
-    return 0;
+    streamer->VisitEnter( *this );
+    for( const XMLNodeT<xchar>* node = FirstChild(); node; node = node->NextSibling() ) {
+        PrintVerbatim( streamer, node );
+    }
+    streamer->VisitExit( *this );
 }
 
-template <typename xchar>
-const xchar* XMLElementT<xchar>::GetText() const
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintVerbatim( XMLPrinterT<xchar>* streamer, const XMLNodeT<xchar>* node ) const
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        return FirstChild()->Value();
+    const XMLElementT<xchar>* element = node->ToElement();
+    if ( !element ) {
+        node->Accept( streamer );
+        return;
     }
-    return 0;
+    if ( element->_sourceLength ) {
+        streamer->PushElementSource( *element, _source + element->_sourceStart, element->_sourceLength );
+        return;
+    }
+    streamer->VisitEnter( *element, element->FirstAttribute() );
+    for( const XMLNodeT<xchar>* child = element->FirstChild(); child; child = child->NextSibling() ) {
+        PrintVerbatim( streamer, child );
+    }
+    streamer->VisitExit( *element );
 }
 
-template <typename xchar>
-void	XMLElementT<xchar>::SetText( const xchar* inText )
+template<typename xchar>
+void XMLDocumentT<xchar>::ResetPrintCache() const
 {
-	if ( FirstChild() && FirstChild()->ToText() )
-		FirstChild()->SetValue( inText );
-	else {
-		XMLTextT<xchar>*	theText = GetDocument()->NewText( inText );
-		InsertFirstChild( theText );
-	}
+    _printCache.Clear();
+    _printCacheText.Clear();
+    _printCacheLive = 0;
+    memset( _printCacheLayout, 0, sizeof( _printCacheLayout ) );
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::SetText( int v ) 
+template<typename xchar>
+void XMLDocumentT<xchar>::DropCachedOutput( const XMLNodeT<xchar>* node ) const
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    SetText( buf );
+    const int index = node->_printCacheEntry;
+    if ( index >= 0 && index < _printCache.Size() && _printCache[index].node == node ) {
+        _printCacheLive -= _printCache[index].length;
+        _printCache[index].node = 0;
+    }
+    node->_printCacheEntry = -1;
+
+    const XMLElementT<xchar>* element = node->ToElement();
+    if ( element ) {
+        element->_sourceLength = 0;
+    }
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::SetText( unsigned v ) 
-{
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    SetText( buf );
+// Squeeze out dropped entries, once they take up more than the live ones.
+template<typename xchar>
+void XMLDocumentT<xchar>::CompactPrintCache() const
+{
+    DynArray< xchar, 10 > text;
+    int live = 0;
+    for( int i=0; i<_printCache.Size(); ++i ) {
+        PrintCacheEntry entry = _printCache[i];
+        if ( !entry.node ) {
+            continue;
+        }
+        xchar* dest = text.PushArr( entry.length );
+        memcpy( dest, _printCacheText.Mem() + entry.offset, entry.length * sizeof( xchar ) );
+        entry.offset = static_cast<int>( dest - text.Mem() );
+        entry.node->_printCacheEntry = live;
+        _printCache[live++] = entry;
+    }
+    _printCache.PopArr( _printCache.Size() - live );
+    _printCacheText.Swap( text );
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::SetText( bool v ) 
+template<typename xchar>
+void XMLDocumentT<xchar>::PrintSiblings( XMLPrinterT<xchar>* printer, const XMLNodeT<xchar>* first, const XMLNodeT<xchar>* end )
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    SetText( buf );
+    for( const XMLNodeT<xchar>* node = first; node != end; node = node->NextSibling() ) {
+        node->Accept( printer );
+    }
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::SetText( float v ) 
+template<typename xchar>
+bool XMLDocumentT<xchar>::CheckUTF8( const char* p, size_t size )
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    SetText( buf );
+    const unsigned char* start = reinterpret_cast<const unsigned char*>( p );
+    const unsigned char* invalid = FindInvalidUTF8( start, start + size );
+    if ( invalid ) {
+        SetError( XML_ERROR_INVALID_UTF8, 0, 0 );
+        _errorOffset = invalid - start;
+        return false;
+    }
+    return true;
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::SetText( double v ) 
+template<typename xchar>
+void XMLDocumentT<xchar>::SetError( XMLError error, const xchar* str1, const xchar* str2 )
 {
-    xchar buf[BUF_SIZE];
-    XMLUtilT<xchar>::ToStr( v, buf, BUF_SIZE );
-    SetText( buf );
+    TIXMLASSERT( error >= 0 && error < XML_ERROR_COUNT );
+    _errorID = error;
+    _errorStr1 = str1;
+    _errorStr2 = str2;
+    _errorOffset = 0;
 }
 
-template <typename xchar>
-XMLError XMLElementT<xchar>::QueryIntText( int* ival ) const
+template<typename xchar>
+const char* XMLDocumentT<xchar>::ErrorName() const
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        const xchar* t = FirstChild()->Value();
-        if ( XMLUtilT<xchar>::ToInt( t, ival ) ) {
-            return XML_SUCCESS;
-        }
-        return XML_CAN_NOT_CONVERT_TEXT;
-    }
-    return XML_NO_TEXT_NODE;
+	TIXMLASSERT( _errorID >= 0 && _errorID < XML_ERROR_COUNT );
+    const char* errorName = _errorNames[_errorID];
+    TIXMLASSERT( errorName && errorName[0] );
+    return errorName;
 }
 
-template <typename xchar>
-XMLError XMLElementT<xchar>::QueryUnsignedText( unsigned* uval ) const
+template< >
+void XMLDocumentT<char>::PrintError() const
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        const xchar* t = FirstChild()->Value();
-        if ( XMLUtilT<xchar>::ToUnsigned( t, uval ) ) {
-            return XML_SUCCESS;
+    if ( Error() ) {
+        static const int LEN = 20;
+        char buf1[LEN] = { 0 };
+        char buf2[LEN] = { 0 };
+
+        if ( _errorStr1 ) {
+            TIXML_SNPRINTF( buf1, LEN, "%s", _errorStr1 );
         }
-        return XML_CAN_NOT_CONVERT_TEXT;
+        if ( _errorStr2 ) {
+            TIXML_SNPRINTF( buf2, LEN, "%s", _errorStr2 );
+        }
+
+        // Should check INT_MIN <= _errorID && _errorId <= INT_MAX, but that
+        // causes a clang "always true" -Wtautological-constant-out-of-range-compare warning
+        TIXMLASSERT( 0 <= _errorID && XML_ERROR_COUNT - 1 <= INT_MAX );
+        printf( "XMLDocument error id=%d '%s' str1=%s str2=%s\n",
+                static_cast<int>( _errorID ), ErrorName(), buf1, buf2 );
     }
-    return XML_NO_TEXT_NODE;
 }
 
-template <typename xchar>
-XMLError XMLElementT<xchar>::QueryBoolText( bool* bval ) const
+// Copy the ASCII characters of 'str' into 'buf' and mark the rest with '?',
+// for PrintError(): wide strings can't be mixed into narrow printf output,
+// and there is no printf for char16_t.
+template<typename xchar>
+static void NarrowErrorStr( const xchar* str, char* buf, int len )
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        const xchar* t = FirstChild()->Value();
-        if ( XMLUtilT<xchar>::ToBool( t, bval ) ) {
-            return XML_SUCCESS;
-        }
-        return XML_CAN_NOT_CONVERT_TEXT;
+    for( int i=0; str && str[i] && i<len-1; ++i ) {
+        const unsigned long c = static_cast<unsigned long>( str[i] );
+        buf[i] = c < 128 ? static_cast<char>( c ) : '?';
     }
-    return XML_NO_TEXT_NODE;
 }
 
-template <typename xchar>
-XMLError XMLElementT<xchar>::QueryDoubleText( double* dval ) const
+template< >
+void XMLDocumentT<wchar_t>::PrintError() const
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        const xchar* t = FirstChild()->Value();
-        if ( XMLUtilT<xchar>::ToDouble( t, dval ) ) {
-            return XML_SUCCESS;
-        }
-        return XML_CAN_NOT_CONVERT_TEXT;
+    if ( Error() ) {
+        static const int LEN = 20;
+        char buf1[LEN] = { 0 };
+        char buf2[LEN] = { 0 };
+        NarrowErrorStr( _errorStr1, buf1, LEN );
+        NarrowErrorStr( _errorStr2, buf2, LEN );
+
+        TIXMLASSERT( 0 <= _errorID && XML_ERROR_COUNT - 1 <= INT_MAX );
+        printf( "XMLDocument error id=%d '%s' str1=%s str2=%s\n",
+                static_cast<int>( _errorID ), ErrorName(), buf1, buf2 );
     }
-    return XML_NO_TEXT_NODE;
 }
 
-template <typename xchar>
-XMLError XMLElementT<xchar>::QueryFloatText( float* fval ) const
+#ifdef TINYXML2_CHAR16
+template< >
+void XMLDocumentT<char16_t>::PrintError() const
 {
-    if ( FirstChild() && FirstChild()->ToText() ) {
-        const xchar* t = FirstChild()->Value();
-        if ( XMLUtilT<xchar>::ToFloat( t, fval ) ) {
-            return XML_SUCCESS;
-        }
-        return XML_CAN_NOT_CONVERT_TEXT;
+    if ( Error() ) {
+        static const int LEN = 20;
+        char buf1[LEN] = { 0 };
+        char buf2[LEN] = { 0 };
+        NarrowErrorStr( _errorStr1, buf1, LEN );
+        NarrowErrorStr( _errorStr2, buf2, LEN );
+
+        TIXMLASSERT( 0 <= _errorID && XML_ERROR_COUNT - 1 <= INT_MAX );
+        printf( "XMLDocument error id=%d '%s' str1=%s str2=%s\n",
+                static_cast<int>( _errorID ), ErrorName(), buf1, buf2 );
     }
-    return XML_NO_TEXT_NODE;
 }
+#endif
 
-
-template <typename xchar>
-XMLAttributeT<xchar>* XMLElementT<xchar>::FindOrCreateAttribute( const xchar* name )
+template<typename xchar>
+void XMLDocumentT<xchar>::Parse()
 {
-    XMLAttributeT<xchar>* last = 0;
-    XMLAttributeT<xchar>* attrib = 0;
-    for( attrib = _rootAttribute;
-            attrib;
-            last = attrib, attrib = attrib->_next ) {
-        if ( XMLUtilT<xchar>::StringEqual( attrib->Name(), name ) ) {
-            break;
-        }
+    TIXMLASSERT( NoChildren() ); // Clear() must have been called previously
+    TIXMLASSERT( _charBuffer );
+    xchar* p = XMLUtilT<xchar>::SkipWhiteSpace( CharBuffer() );
+    if ( sizeof( xchar ) == 1 ) {
+        p = reinterpret_cast<xchar*>( const_cast<char*>( XMLUtilT<char>::ReadBOM( reinterpret_cast<char*>( p ), &_writeBOM ) ) );
     }
-    if ( !attrib ) {
-        TIXMLASSERT( sizeof( XMLAttribute ) == _document->_attributePool.ItemSize() );
-        attrib = new (_document->_attributePool.Alloc() ) XMLAttributeT<xchar>();
-        attrib->_memPool = &_document->_attributePool;
-        if ( last ) {
-            last->_next = attrib;
-        }
-        else {
-            _rootAttribute = attrib;
-        }
-        attrib->SetName( name );
-        attrib->_memPool->SetTracked(); // always created and linked.
+    else if ( static_cast<unsigned long>( *p ) == 0xFEFF ) {
+        // A wide buffer holds the byte order mark as a character.
+        _writeBOM = true;
+        ++p;
     }
-    return attrib;
-}
-
-template <typename xchar>
-void XMLElementT<xchar>::DeleteAttribute( const xchar* name )
-{
-    XMLAttributeT<xchar>* prev = 0;
-    for( XMLAttributeT<xchar>* a=_rootAttribute; a; a=a->_next ) {
-        if ( XMLUtilT<xchar>::StringEqual( name, a->Name() ) ) {
-            if ( prev ) {
-                prev->_next = a->_next;
-            }
-            else {
-                _rootAttribute = a->_next;
-            }
-            DeleteAttribute( a );
-            break;
-        }
-        prev = a;
+    if ( !*p ) {
+        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
+        return;
+    }
+    if ( _preserveSource ) {
+        // Parsing and reading values modify the buffer; keep the original.
+        const size_t size = strlen( CharBuffer() ) + 1;
+        _source = new xchar[size];
+        memcpy( _source, CharBuffer(), size * sizeof( xchar ) );
     }
+    _parsing = true;
+    ParseDeep( p, 0 );
+    _parsing = false;
 }
 
-template <typename xchar>
-xchar* XMLElementT<xchar>::ParseAttributes( xchar* p )
-{
-    const xchar* start = p;
-    XMLAttributeT<xchar>* prevAttribute = 0;
-
-    // Read the attributes.
-    while( p ) {
-        p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-        if ( !(*p) ) {
-            _document->SetError( XML_ERROR_PARSING_ELEMENT, start, Name() );
-            return 0;
-        }
 
-        // attribute.
-        if (XMLUtilT<xchar>::IsNameStartChar( *p ) ) {
-            TIXMLASSERT( sizeof( XMLAttribute ) == _document->_attributePool.ItemSize() );
-            XMLAttributeT<xchar>* attrib = new (_document->_attributePool.Alloc() ) XMLAttributeT<xchar>();
-            attrib->_memPool = &_document->_attributePool;
-			attrib->_memPool->SetTracked();
+// --------- XMLCompactDocument ----------- //
 
-            p = attrib->ParseDeep( p, _document->ProcessEntities() );
-            if ( !p || Attribute( attrib->Name() ) ) {
-                DeleteAttribute( attrib );
-                _document->SetError( XML_ERROR_PARSING_ATTRIBUTE, start, p );
-                return 0;
-            }
-            // There is a minor bug here: if the attribute in the source xml
-            // document is duplicated, it will not be detected and the
-            // attribute will be doubly added. However, tracking the 'prevAttribute'
-            // avoids re-scanning the attribute list. Preferring performance for
-            // now, may reconsider in the future.
-            if ( prevAttribute ) {
-                prevAttribute->_next = attrib;
-            }
-            else {
-                _rootAttribute = attrib;
-            }
-            prevAttribute = attrib;
-        }
-        // end of the tag
-        else if ( *p == '>' ) {
-            ++p;
-            break;
-        }
-        // end of the tag
-        else if ( *p == '/' && *(p+1) == '>' ) {
-            _closingType = CLOSED;
-            return p+2;	// done; sealed element.
-        }
-        else {
-            _document->SetError( XML_ERROR_PARSING_ELEMENT, start, p );
-            return 0;
-        }
-    }
-    return p;
+template<typename xchar>
+XMLCompactDocumentT<xchar>::XMLCompactDocumentT( bool processEntities, Whitespace whitespace ) :
+    _processEntities( processEntities ),
+    _whitespace( whitespace )
+{
 }
 
-template <typename xchar>
-void XMLElementT<xchar>::DeleteAttribute( XMLAttributeT<xchar>* attribute )
+template<typename xchar>
+void XMLCompactDocumentT<xchar>::Clear()
 {
-    if ( attribute == 0 ) {
-        return;
-    }
-    MemPool* pool = attribute->_memPool;
-    attribute->~XMLAttributeT();
-    pool->Free( attribute );
+    _nodes.Clear();
+    _attributes.Clear();
+    _strings.Clear();
 }
 
-//
-//	<ele></ele>
-//	<ele>foo<b>bar</b></ele>
-//
-template <typename xchar>
-xchar* XMLElementT<xchar>::ParseDeep( xchar* p, StrPairT<xchar>* strPair )
+template<typename xchar>
+XMLError XMLCompactDocumentT<xchar>::Parse( const xchar* xml, size_t nBytes )
 {
-    // Read the element name.
-    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
-
-    // The closing element is the </element> form. It is
-    // parsed just like a regular element then deleted from
-    // the DOM.
-    if ( *p == '/' ) {
-        _closingType = CLOSING;
-        ++p;
+    Clear();
+    if ( nBytes == 0 || !xml || !*xml ) {
+        return XML_ERROR_EMPTY_DOCUMENT;
+    }
+    if ( nBytes == (size_t)(-1) ) {
+        nBytes = strlen( xml );
+    }
+    if ( nBytes >= NONE ) {
+        // Strings are stored as 32-bit offsets into the buffer.
+        return XML_ERROR_PARSING;
+    }
+    // The same input as XMLDocument::Parse(), kept in _strings.
+    size_t nameStart = 0;
+    size_t nameEnd = 0;
+    int encoding = SOURCE_UTF8;
+    if ( sizeof( xchar ) == 1 ) {
+        encoding = DeclaredEncoding( reinterpret_cast<const unsigned char*>( xml ), nBytes, &nameStart, &nameEnd );
+    }
+    if ( encoding != SOURCE_UTF8 ) {
+        char* utf8 = SingleByteToUTF8( reinterpret_cast<const unsigned char*>( xml ), nBytes, encoding, nameStart, nameEnd, &nBytes );
+        if ( nBytes < NONE ) {
+            memcpy( _strings.PushArr( (int)nBytes + 1 ), utf8, nBytes + 1 );
+        }
+        delete [] utf8;
+        if ( nBytes >= NONE ) {
+            return XML_ERROR_PARSING;
+        }
     }
-
-    p = _value.ParseName( p );
-    if ( _value.Empty() ) {
-        return 0;
+    else {
+        xchar* buffer = _strings.PushArr( (int)nBytes + 1 );
+        memcpy( buffer, xml, nBytes * sizeof(xchar) );
+        buffer[nBytes] = 0;
     }
 
-    p = ParseAttributes( p );
-    if ( !p || !*p || _closingType ) {
-        return p;
+    const XMLError error = ParseBuffer();
+    if ( error ) {
+        Clear();
     }
-
-    p = XMLNodeT<xchar>::ParseDeep( p, strPair );
-    return p;
+    return error;
 }
 
-
-template <typename xchar>
-XMLNodeT<xchar>* XMLElementT<xchar>::ShallowClone( XMLDocumentT<xchar>* doc ) const
+// The parse follows XMLDocument::Identify() and the ParseDeep() methods,
+// one node at a time, with the open elements kept on a stack instead of
+// the call stack. A string is flushed (normalized and null terminated in
+// place) once the character after it has been read, since the null
+// overwrites that character.
+template<typename xchar>
+XMLError XMLCompactDocumentT<xchar>::ParseBuffer()
 {
-    if ( !doc ) {
-        doc = _document;
+    static const xchar xmlHeader[]		= { '<', '?', 0 };
+    static const xchar commentHeader[]	= { '<', '!', '-', '-', 0 };
+    static const xchar cdataHeader[]		= { '<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[', 0 };
+    static const xchar dtdHeader[]		= { '<', '!', 0 };
+    static const xchar declarationEnd[]	= { '?', '>', 0 };
+    static const xchar commentEnd[]		= { '-', '-', '>', 0 };
+    static const xchar cdataEnd[]		= { ']', ']', '>', 0 };
+    static const xchar tagEnd[]			= { '>', 0 };
+    static const xchar textEnd[]		= { '<', 0 };
+
+    xchar* const base = _strings.Mem();
+    xchar* p = XMLUtilT<xchar>::SkipWhiteSpace( base );
+    if ( sizeof( xchar ) == 1 ) {
+        bool bom = false;
+        p = reinterpret_cast<xchar*>( const_cast<char*>( XMLUtilT<char>::ReadBOM( reinterpret_cast<char*>( p ), &bom ) ) );
+    }
+    else if ( static_cast<unsigned long>( *p ) == 0xFEFF ) {
+        ++p;
     }
-    XMLElementT<xchar>* element = doc->NewElement( Value() );					// fixme: this will always allocate memory. Intern?
-    for( const XMLAttributeT<xchar>* a=FirstAttribute(); a; a=a->Next() ) {
-        element->SetAttribute( a->Name(), a->Value() );					// fixme: this will always allocate memory. Intern?
+    if ( !*p ) {
+        return XML_ERROR_EMPTY_DOCUMENT;
     }
-    return element;
-}
 
-template <typename xchar>
-bool XMLElementT<xchar>::ShallowEqual( const XMLNodeT<xchar>* compare ) const
-{
-    TIXMLASSERT( compare );
-    const XMLElementT<xchar>* other = compare->ToElement();
-    if ( other && XMLUtilT<xchar>::StringEqual( other->Name(), Name() )) {
+    int textFlags = _processEntities ? StrPairT<xchar>::TEXT_ELEMENT : StrPairT<xchar>::TEXT_ELEMENT_LEAVE_ENTITIES;
+    if ( _whitespace == COLLAPSE_WHITESPACE ) {
+        textFlags |= StrPairT<xchar>::NEEDS_WHITESPACE_COLLAPSING;
+    }
+    int valueFlags = _processEntities ? StrPairT<xchar>::ATTRIBUTE_VALUE : StrPairT<xchar>::ATTRIBUTE_VALUE_LEAVE_ENTITIES;
+    if ( _whitespace == PEDANTIC_WHITESPACE ) {
+        valueFlags |= StrPairT<xchar>::NEEDS_ATTRIBUTE_NORMALIZATION;
+    }
 
-        const XMLAttributeT<xchar>* a=FirstAttribute();
-        const XMLAttributeT<xchar>* b=other->FirstAttribute();
+    AppendNode( DOCUMENT, NONE, 0 );
+    DynArray< unsigned, 32 > lastChild;		// per depth, as in Build()
+    lastChild.Push( NONE );
+    unsigned parent = 0;
+    // XMLDocument rejects a declaration once the document has a child,
+    // and a top level node becomes its child when it has been parsed.
+    bool documentHasChild = false;
+    // Text ends at the '<' of the next node; it is flushed after that.
+    StrPairT<xchar> pendingText;
+    unsigned pendingNode = NONE;
 
-        while ( a && b ) {
-            if ( !XMLUtilT<xchar>::StringEqual( a->Value(), b->Value() ) ) {
-                return false;
+    while ( *p ) {
+        xchar* const start = p;
+        p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+        if ( !*p ) {
+            break;
+        }
+
+        NodeType type = ELEMENT;
+        const xchar* endTag = 0;
+        int flags = StrPairT<xchar>::NEEDS_NEWLINE_NORMALIZATION;
+        XMLError error = XML_ERROR_PARSING;
+        bool cdata = false;
+        if ( parent != 0 && p != start && _whitespace == PEDANTIC_WHITESPACE ) {
+            // White space before a tag is text of its own.
+            type = TEXT;
+            p = start;
+            endTag = textEnd;
+            flags = textFlags;
+            error = XML_ERROR_PARSING_TEXT;
+        }
+        else if ( XMLUtilT<xchar>::StringEqual( p, xmlHeader, 2 ) ) {
+            type = DECLARATION;
+            p += 2;
+            endTag = declarationEnd;
+            error = XML_ERROR_PARSING_DECLARATION;
+        }
+        else if ( XMLUtilT<xchar>::StringEqual( p, commentHeader, 4 ) ) {
+            type = COMMENT;
+            p += 4;
+            endTag = commentEnd;
+            flags = StrPairT<xchar>::COMMENT;
+            error = XML_ERROR_PARSING_COMMENT;
+        }
+        else if ( XMLUtilT<xchar>::StringEqual( p, cdataHeader, 9 ) ) {
+            type = TEXT;
+            cdata = true;
+            p += 9;
+            endTag = cdataEnd;
+            error = XML_ERROR_PARSING_CDATA;
+        }
+        else if ( XMLUtilT<xchar>::StringEqual( p, dtdHeader, 2 ) ) {
+            type = UNKNOWN;
+            p += 2;
+            endTag = tagEnd;
+            error = XML_ERROR_PARSING_UNKNOWN;
+        }
+        else if ( *p == '<' ) {
+            ++p;
+        }
+        else {
+            // All the text counts, including the white space.
+            type = TEXT;
+            p = start;
+            endTag = textEnd;
+            flags = textFlags;
+            error = XML_ERROR_PARSING_TEXT;
+        }
+        if ( pendingNode != NONE ) {
+            StrPairT<xchar> text;
+            pendingText.TransferTo( &text );
+            _nodes[(int)pendingNode]._value = FlushString( &text, &_nodes[(int)pendingNode]._valueLength );
+            pendingNode = NONE;
+        }
+
+        if ( type != ELEMENT ) {
+            StrPairT<xchar> value;
+            xchar* next = value.ParseText( base, p, endTag, flags );
+            if ( !next ) {
+                return error;
             }
-            a = a->Next();
-            b = b->Next();
+            if ( type == DECLARATION && documentHasChild ) {
+                return XML_ERROR_PARSING_DECLARATION;
+            }
+            if ( type == TEXT && !cdata ) {
+                if ( !*next ) {
+                    return XML_ERROR_PARSING;
+                }
+                // Back up to the '<'.
+                --next;
+            }
+            const unsigned index = AppendNode( type, parent, &lastChild );
+            _nodes[(int)index]._cdata = cdata ? 1 : 0;
+            if ( type == TEXT && !cdata ) {
+                value.TransferTo( &pendingText );
+                pendingNode = index;
+            }
+            else {
+                _nodes[(int)index]._value = FlushString( &value, &_nodes[(int)index]._valueLength );
+            }
+            documentHasChild = documentHasChild || parent == 0;
+            p = next;
+            continue;
         }
-        if ( a || b ) {
-            // different count
-            return false;
+
+        // An element: the start tag, an end tag, or both in one.
+        p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+        bool closing = false;
+        if ( *p == '/' ) {
+            closing = true;
+            ++p;
+        }
+        StrPairT<xchar> name;
+        p = name.ParseName( base, p );
+        if ( name.Empty() ) {
+            return XML_ERROR_PARSING;
         }
-        return true;
-    }
-    return false;
-}
 
-template <typename xchar>
-bool XMLElementT<xchar>::Accept( XMLVisitorT<xchar>* visitor ) const
-{
-    TIXMLASSERT( visitor );
-    if ( visitor->VisitEnter( *this, _rootAttribute ) ) {
-        for ( const XMLNodeT<xchar>* node=FirstChild(); node; node=node->NextSibling() ) {
-            if ( !node->Accept( visitor ) ) {
+        const int firstAttribute = _attributes.Size();
+        bool closed = false;
+        for( ;; ) {
+            p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+            if ( !*p ) {
+                return XML_ERROR_PARSING_ELEMENT;
+            }
+            if ( NameCharLength( p, NAME_START_CHAR ) ) {
+                // As XMLAttribute::ParseDeep().
+                StrPairT<xchar> attributeName;
+                StrPairT<xchar> attributeValue;
+                p = attributeName.ParseName( base, p );
+                if ( !p || !*p ) {
+                    return XML_ERROR_PARSING_ATTRIBUTE;
+                }
+                p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+                if ( *p != '=' ) {
+                    return XML_ERROR_PARSING_ATTRIBUTE;
+                }
+                p = XMLUtilT<xchar>::SkipWhiteSpace( p + 1 );
+                if ( *p != '\"' && *p != '\'' ) {
+                    return XML_ERROR_PARSING_ATTRIBUTE;
+                }
+                const xchar quote[2] = { *p, 0 };
+                p = attributeValue.ParseText( base, p + 1, quote, valueFlags );
+                if ( !p ) {
+                    return XML_ERROR_PARSING_ATTRIBUTE;
+                }
+                CompactAttribute attrib;
+                attrib._name = FlushString( &attributeName, 0 );
+                attrib._value = FlushString( &attributeValue, 0 );
+                for( int i = firstAttribute; i < _attributes.Size(); ++i ) {
+                    if ( XMLUtilT<xchar>::StringEqual( base + _attributes[i]._name, base + attrib._name ) ) {
+                        return XML_ERROR_PARSING_ATTRIBUTE;
+                    }
+                }
+                _attributes.Push( attrib );
+            }
+            else if ( *p == '>' ) {
+                ++p;
                 break;
             }
+            else if ( *p == '/' && *(p+1) == '>' ) {
+                // Even after a '/', this makes an empty element.
+                p += 2;
+                closing = false;
+                closed = true;
+                break;
+            }
+            else {
+                return XML_ERROR_PARSING_ELEMENT;
+            }
         }
-    }
-    return visitor->VisitExit( *this );
-}
 
+        unsigned nameLength = 0;
+        const unsigned nameOffset = FlushString( &name, &nameLength );
+        if ( closing ) {
+            _attributes.PopArr( _attributes.Size() - firstAttribute );
+            if ( parent == 0 ) {
+                // XMLDocument stops at an end tag outside any element.
+                return XML_SUCCESS;
+            }
+            if ( !XMLUtilT<xchar>::StringEqual( base + nameOffset, Value( parent ) ) ) {
+                return XML_ERROR_MISMATCHED_ELEMENT;
+            }
+            lastChild.Pop();
+            parent = _nodes[(int)parent]._parent;
+            documentHasChild = documentHasChild || parent == 0;
+            continue;
+        }
 
-// --------- XMLDocument ----------- //
+        const unsigned index = AppendNode( ELEMENT, parent, &lastChild );
+        CompactNode& node = _nodes[(int)index];
+        node._value = nameOffset;
+        node._valueLength = nameLength;
+        node._firstAttribute = (unsigned)firstAttribute;
+        node._attributeCount = (unsigned)( _attributes.Size() - firstAttribute );
+        if ( closed ) {
+            documentHasChild = documentHasChild || parent == 0;
+            continue;
+        }
+        if ( !*p ) {
+            // An open element at the very end has no end tag to match.
+            return XML_ERROR_MISMATCHED_ELEMENT;
+        }
+        parent = index;
+        lastChild.Push( NONE );
+    }
+    return ( parent == 0 ) ? XML_SUCCESS : XML_ERROR_PARSING;
+}
 
-// Warning: List must match 'enum XMLError'
 template<typename xchar>
-const char* XMLDocumentT<xchar>::_errorNames[XML_ERROR_COUNT] = {
-    "XML_SUCCESS",
-    "XML_NO_ATTRIBUTE",
-    "XML_WRONG_ATTRIBUTE_TYPE",
-    "XML_ERROR_FILE_NOT_FOUND",
-    "XML_ERROR_FILE_COULD_NOT_BE_OPENED",
-    "XML_ERROR_FILE_READ_ERROR",
-    "XML_ERROR_ELEMENT_MISMATCH",
-    "XML_ERROR_PARSING_ELEMENT",
-    "XML_ERROR_PARSING_ATTRIBUTE",
-    "XML_ERROR_IDENTIFYING_TAG",
-    "XML_ERROR_PARSING_TEXT",
-    "XML_ERROR_PARSING_CDATA",
-    "XML_ERROR_PARSING_COMMENT",
-    "XML_ERROR_PARSING_DECLARATION",
-    "XML_ERROR_PARSING_UNKNOWN",
-    "XML_ERROR_EMPTY_DOCUMENT",
-    "XML_ERROR_MISMATCHED_ELEMENT",
-    "XML_ERROR_PARSING",
-    "XML_CAN_NOT_CONVERT_TEXT",
-    "XML_NO_TEXT_NODE"
-};
+unsigned XMLCompactDocumentT<xchar>::AppendNode( NodeType type, unsigned parent, DynArray< unsigned, 32 >* lastChild )
+{
+    TIXMLASSERT( (unsigned)_nodes.Size() < NONE );
+    const unsigned index = (unsigned)_nodes.Size();
+    CompactNode c;
+    c._parent = parent;
+    c._nextSibling = NONE;
+    c._value = 0;
+    c._valueLength = 0;
+    c._firstAttribute = (unsigned)_attributes.Size();
+    c._attributeCount = 0;
+    c._type = type;
+    c._cdata = 0;
+    _nodes.Push( c );
+    if ( lastChild ) {
+        unsigned& prev = (*lastChild)[lastChild->Size() - 1];
+        if ( prev != NONE ) {
+            _nodes[(int)prev]._nextSibling = index;
+        }
+        prev = index;
+    }
+    return index;
+}
 
 template<typename xchar>
-XMLDocumentT<xchar>::XMLDocumentT( bool processEntities, Whitespace whitespace ) :
-    XMLNodeT( 0 ),
-    _writeBOM( false ),
-    _processEntities( processEntities ),
-    _errorID( XML_NO_ERROR ),
-    _whitespace( whitespace ),
-    _errorStr1( 0 ),
-    _errorStr2( 0 ),
-    _charBuffer( 0 )
+unsigned XMLCompactDocumentT<xchar>::FlushString( StrPairT<xchar>* str, unsigned* length )
 {
-    // avoid VC++ C4355 warning about 'this' in initializer list (C4355 is off by default in VS2012+)
-    _document = this;
+    // Normalizing only shortens the span, so the string stays in place.
+    const xchar* s = str->GetStr( _strings.Mem() );
+    TIXMLASSERT( s >= _strings.Mem() && s < _strings.Mem() + _strings.Size() );
+    if ( length ) {
+        *length = (unsigned)strlen( s );
+    }
+    return (unsigned)( s - _strings.Mem() );
 }
 
 template<typename xchar>
-XMLDocumentT<xchar>::~XMLDocumentT()
+XMLError XMLCompactDocumentT<xchar>::Build( const XMLDocumentT<xchar>& doc )
 {
     Clear();
+    if ( doc.Error() ) {
+        return doc.ErrorID();
+    }
+
+    AddNode( &doc, NONE );
+
+    // lastChild[depth] is the most recently added child at that depth,
+    // so its _nextSibling can be filled in when the next one arrives.
+    DynArray< unsigned, 32 > lastChild;
+    lastChild.Push( NONE );
+    unsigned parent = 0;
+
+    const XMLNodeT<xchar>* node = doc.FirstChild();
+    while ( node ) {
+        const unsigned index = AddNode( node, parent );
+        unsigned& prev = lastChild[lastChild.Size() - 1];
+        if ( prev != NONE ) {
+            _nodes[(int)prev]._nextSibling = index;
+        }
+        prev = index;
+
+        if ( node->FirstChild() ) {
+            parent = index;
+            lastChild.Push( NONE );
+            node = node->FirstChild();
+            continue;
+        }
+        // Climb until there is a sibling to move to.
+        while ( !node->NextSibling() ) {
+            node = node->Parent();
+            if ( node == &doc ) {
+                break;
+            }
+            lastChild.Pop();
+            parent = _nodes[(int)parent]._parent;
+        }
+        node = ( node == &doc ) ? 0 : node->NextSibling();
+    }
+    return XML_SUCCESS;
 }
 
 template<typename xchar>
-void XMLDocumentT<xchar>::Clear()
+unsigned XMLCompactDocumentT<xchar>::AddString( const xchar* str, unsigned* length )
 {
-    DeleteChildren();
+    const size_t len = strlen( str );
+    TIXMLASSERT( (size_t)_strings.Size() + len < NONE );
+    const unsigned offset = (unsigned)_strings.Size();
+    memcpy( _strings.PushArr( (int)len + 1 ), str, ( len+1 ) * sizeof(xchar) );
+    if ( length ) {
+        *length = (unsigned)len;
+    }
+    return offset;
+}
 
-#ifdef DEBUG
-    const bool hadError = Error();
-#endif
-    _errorID = XML_NO_ERROR;
-    _errorStr1 = 0;
-    _errorStr2 = 0;
+template<typename xchar>
+unsigned XMLCompactDocumentT<xchar>::AddNode( const XMLNodeT<xchar>* node, unsigned parent )
+{
+    TIXMLASSERT( (unsigned)_nodes.Size() < NONE );
+    const unsigned index = (unsigned)_nodes.Size();
 
-    delete [] _charBuffer;
-    _charBuffer = 0;
+    CompactNode c;
+    c._parent = parent;
+    c._nextSibling = NONE;
+    c._value = 0;
+    c._valueLength = 0;
+    c._firstAttribute = (unsigned)_attributes.Size();
+    c._attributeCount = 0;
+    c._cdata = 0;
 
-#if 0
-    _textPool.Trace( "text" );
-    _elementPool.Trace( "element" );
-    _commentPool.Trace( "comment" );
-    _attributePool.Trace( "attribute" );
-#endif
-    
-#ifdef DEBUG
-    if ( !hadError ) {
-        TIXMLASSERT( _elementPool.CurrentAllocs()   == _elementPool.Untracked() );
-        TIXMLASSERT( _attributePool.CurrentAllocs() == _attributePool.Untracked() );
-        TIXMLASSERT( _textPool.CurrentAllocs()      == _textPool.Untracked() );
-        TIXMLASSERT( _commentPool.CurrentAllocs()   == _commentPool.Untracked() );
+    if ( node->ToDocument() ) {
+        c._type = DOCUMENT;
     }
-#endif
+    else {
+        c._value = AddString( node->Value(), &c._valueLength );
+        const XMLElementT<xchar>* element = node->ToElement();
+        const XMLTextT<xchar>* text = node->ToText();
+        if ( element ) {
+            c._type = ELEMENT;
+            for( const XMLAttributeT<xchar>* a = element->FirstAttribute(); a; a = a->Next() ) {
+                CompactAttribute attrib;
+                attrib._name = AddString( a->Name(), 0 );
+                attrib._value = AddString( a->Value(), 0 );
+                _attributes.Push( attrib );
+                ++c._attributeCount;
+            }
+        }
+        else if ( text ) {
+            c._type = TEXT;
+            c._cdata = text->CData() ? 1 : 0;
+        }
+        else if ( node->ToComment() ) {
+            c._type = COMMENT;
+        }
+        else if ( node->ToDeclaration() ) {
+            c._type = DECLARATION;
+        }
+        else {
+            TIXMLASSERT( node->ToUnknown() );
+            c._type = UNKNOWN;
+        }
+    }
+    _nodes.Push( c );
+    return index;
 }
 
 template<typename xchar>
-XMLElementT<xchar>* XMLDocumentT<xchar>::NewElement( const xchar* name )
+const xchar* XMLCompactDocumentT<xchar>::Value( unsigned node ) const
 {
-    TIXMLASSERT( sizeof( XMLElement ) == _elementPool.ItemSize() );
-    XMLElementT<xchar>* ele = new (_elementPool.Alloc()) XMLElementT<xchar>( this );
-    ele->_memPool = &_elementPool;
-    ele->SetName( name );
-    return ele;
+    const CompactNode& c = GetNode( node );
+    if ( c._type == DOCUMENT ) {
+        return 0;
+    }
+    return _strings.Mem() + c._value;
 }
 
 template<typename xchar>
-XMLCommentT<xchar>* XMLDocumentT<xchar>::NewComment( const xchar* str )
+unsigned XMLCompactDocumentT<xchar>::FirstChildElement( unsigned node, const xchar* name ) const
 {
-    TIXMLASSERT( sizeof( XMLComment ) == _commentPool.ItemSize() );
-    XMLCommentT<xchar>* comment = new (_commentPool.Alloc()) XMLCommentT<xchar>( this );
-    comment->_memPool = &_commentPool;
-    comment->SetValue( str );
-    return comment;
+    for( unsigned child = FirstChild( node ); child != NONE; child = NextSibling( child ) ) {
+        if ( Type( child ) == ELEMENT ) {
+            if ( !name || XMLUtilT<xchar>::StringEqual( Value( child ), name ) ) {
+                return child;
+            }
+        }
+    }
+    return NONE;
 }
 
 template<typename xchar>
-XMLTextT<xchar>* XMLDocumentT<xchar>::NewText( const xchar* str )
+unsigned XMLCompactDocumentT<xchar>::NextSiblingElement( unsigned node, const xchar* name ) const
 {
-    TIXMLASSERT( sizeof( XMLTextT<xchar> ) == _textPool.ItemSize() );
-    XMLTextT<xchar>* text = new (_textPool.Alloc()) XMLTextT<xchar>( this );
-    text->_memPool = &_textPool;
-    text->SetValue( str );
-    return text;
+    for( unsigned sibling = NextSibling( node ); sibling != NONE; sibling = NextSibling( sibling ) ) {
+        if ( Type( sibling ) == ELEMENT ) {
+            if ( !name || XMLUtilT<xchar>::StringEqual( Value( sibling ), name ) ) {
+                return sibling;
+            }
+        }
+    }
+    return NONE;
 }
 
 template<typename xchar>
-XMLDeclarationT<xchar>* XMLDocumentT<xchar>::NewDeclaration( const xchar* str )
-{
-    TIXMLASSERT( sizeof( XMLDeclaration ) == _commentPool.ItemSize() );
-    XMLDeclarationT<xchar>* dec = new (_commentPool.Alloc()) XMLDeclarationT<xchar>( this );
-    dec->_memPool = &_commentPool;
-	
-	xchar xmlTag[] = {'x', 'm', 'l', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n', '=', 
-					'"', '1', '.', '0', '"', ' ', 'e', 'n', 'c', 'o', 'd', 'i', 
-					'n', 'g', '=', '"', 'U', 'T', 'F', '-', '8', '"', 0};
-    dec->SetValue( str ? str : xmlTag );
-    return dec;
+const xchar* XMLCompactDocumentT<xchar>::Attribute( unsigned node, const xchar* name, const xchar* value ) const
+{
+    const unsigned count = AttributeCount( node );
+    for( unsigned i=0; i<count; ++i ) {
+        if ( XMLUtilT<xchar>::StringEqual( AttributeName( node, i ), name ) ) {
+            const xchar* v = AttributeValue( node, i );
+            if ( !value || XMLUtilT<xchar>::StringEqual( v, value ) ) {
+                return v;
+            }
+            return 0;
+        }
+    }
+    return 0;
 }
 
 template<typename xchar>
-XMLUnknownT<xchar>* XMLDocumentT<xchar>::NewUnknown( const xchar* str )
+const xchar* XMLCompactDocumentT<xchar>::GetText( unsigned node ) const
 {
-    TIXMLASSERT( sizeof( XMLUnknown ) == _commentPool.ItemSize() );
-    XMLUnknownT<xchar>* unk = new (_commentPool.Alloc()) XMLUnknownT<xchar>( this );
-    unk->_memPool = &_commentPool;
-    unk->SetValue( str );
-    return unk;
+    const unsigned child = FirstChild( node );
+    if ( child != NONE && Type( child ) == TEXT ) {
+        return Value( child );
+    }
+    return 0;
 }
 
-static FILE* callfopen( const char* filepath, const char* mode )
+
+// --------- XMLOutputSink ----------- //
+
+template< >
+void XMLFileSinkT<char>::Write( const char* data, size_t size )
 {
-    TIXMLASSERT( filepath );
-    TIXMLASSERT( mode );
-#if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
-    FILE* fp = 0;
-    errno_t err = fopen_s( &fp, filepath, mode );
-    if ( err ) {
-        return 0;
+    fwrite( data, 1, size, _fp );
+}
+
+template< >
+void XMLFileSinkT<wchar_t>::Write( const wchar_t* data, size_t size )
+{
+    // Wide streams translate the characters; stay on the wide functions.
+    for( size_t i=0; i<size; ++i ) {
+        fputwc( data[i], _fp );
     }
-#else
-    FILE* fp = fopen( filepath, mode );
-#endif
-    return fp;
 }
 
+#ifdef TINYXML2_CHAR16
+template< >
+void XMLFileSinkT<char16_t>::Write( const char16_t* data, size_t size )
+{
+    // UTF-16LE, whatever the byte order of the host.
+    unsigned char bytes[512];
+    while ( size ) {
+        const size_t n = size < sizeof( bytes ) / 2 ? size : sizeof( bytes ) / 2;
+        for( size_t i=0; i<n; ++i ) {
+            bytes[2*i] = static_cast<unsigned char>( data[i] & 0xFF );
+            bytes[2*i+1] = static_cast<unsigned char>( data[i] >> 8 );
+        }
+        fwrite( bytes, 2, n, _fp );
+        data += n;
+        size -= n;
+    }
+}
+#endif
 
-static FILE* callfopen( const wchar_t* filepath, const wchar_t* mode )
+template<typename xchar>
+void XMLFileSinkT<xchar>::Flush()
 {
-    TIXMLASSERT( filepath );
-    TIXMLASSERT( mode );
-#if defined(_MSC_VER) && (_MSC_VER >= 1400 ) && (!defined WINCE)
-    FILE* fp = 0;
-    errno_t err = _wfopen_s( &fp, filepath, mode );
-    if ( err ) {
-        return 0;
+    if ( _fp ) {
+        fflush( _fp );
     }
+}
+
+template<typename xchar>
+void XMLFdSinkT<xchar>::Write( const xchar* data, size_t size )
+{
+    const char* p = reinterpret_cast<const char*>( data );
+    size_t remaining = size * sizeof(xchar);
+    while ( remaining && !_error ) {
+#if defined(_WIN32)
+        const unsigned chunk = ( remaining < (size_t)INT_MAX ) ? (unsigned)remaining : (unsigned)INT_MAX;
+        const int written = _write( _fd, p, chunk );
 #else
-    FILE* fp = _wfopen( filepath, mode );
+        const ssize_t written = write( _fd, p, remaining );
+        if ( written < 0 && errno == EINTR ) {
+            continue;
+        }
 #endif
-    return fp;
+        if ( written <= 0 ) {
+            _error = true;
+            break;
+        }
+        p += written;
+        remaining -= (size_t)written;
+    }
 }
 
 template<typename xchar>
-void XMLDocumentT<xchar>::DeleteNode( XMLNodeT<xchar>* node )	{
-    TIXMLASSERT( node );
-    TIXMLASSERT(node->_document == this );
-    if (node->_parent) {
-        node->_parent->DeleteChild( node );
+void XMLMemorySinkT<xchar>::Write( const xchar* data, size_t size )
+{
+    size_t n = _capacity - _size;
+    if ( size > n ) {
+        _overflow = true;
     }
     else {
-        // Isn't in the tree.
-        // Use the parent delete.
-        // Also, we need to mark it tracked: we 'know'
-        // it was never used.
-        node->_memPool->SetTracked();
-        // Call the static XMLNodeT version:
-        XMLNodeT<xchar>::DeleteNode(node);
+        n = size;
     }
+    memcpy( _mem + _size, data, n * sizeof(xchar) );
+    _size += n;
 }
 
+#ifdef TIXML_SSE2
+// Narrow 16 ASCII units to bytes; false if any isn't ASCII.
 template<typename xchar>
-XMLError XMLDocumentT<xchar>::LoadFile( const xchar* filename )
+static inline bool PackASCII16( const xchar* p, unsigned char* out )
 {
-    Clear();
-	xchar mode[] = {'r', 'b', 0};
-    FILE* fp = callfopen( filename, mode );
-    if ( !fp ) {
-        SetError( XML_ERROR_FILE_NOT_FOUND, filename, 0 );
-        return _errorID;
+    const __m128i* in = reinterpret_cast<const __m128i*>( p );
+    __m128i lo;
+    __m128i hi;
+    if ( sizeof( xchar ) == 2 ) {
+        lo = _mm_loadu_si128( in );
+        hi = _mm_loadu_si128( in + 1 );
     }
-    LoadFile( fp );
-    fclose( fp );
-    return _errorID;
+    else {
+        lo = _mm_packs_epi32( _mm_loadu_si128( in ), _mm_loadu_si128( in + 1 ) );
+        hi = _mm_packs_epi32( _mm_loadu_si128( in + 2 ), _mm_loadu_si128( in + 3 ) );
+    }
+    // After the signed pack, anything outside 0-0x7F has a bit of 0xFF80 set.
+    const __m128i high = _mm_and_si128( _mm_or_si128( lo, hi ), _mm_set1_epi16( static_cast<short>( 0xFF80 ) ) );
+    if ( _mm_movemask_epi8( _mm_cmpeq_epi16( high, _mm_setzero_si128() ) ) != 0xFFFF ) {
+        return false;
+    }
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( out ), _mm_packus_epi16( lo, hi ) );
+    return true;
 }
 
-template<typename xchar>
-XMLError XMLDocumentT<xchar>::LoadFile( FILE* fp )
+template< >
+inline bool PackASCII16( const char*, unsigned char* )
 {
-    Clear();
+    return false;
+}
+#endif
 
-    fseek( fp, 0, SEEK_SET );
-    if ( fgetc( fp ) == EOF && ferror( fp ) != 0 ) {
-        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
-        return _errorID;
+template<typename xchar>
+unsigned char* XMLEncodingSinkT<xchar>::Encode( unsigned long ch, unsigned char* out )
+{
+    if ( ch > 0x10FFFF || ( ch >= 0xD800 && ch <= 0xDFFF ) ) {
+        ch = 0xFFFD;
     }
-
-    fseek( fp, 0, SEEK_END );
-    const long filelength = ftell( fp );
-    fseek( fp, 0, SEEK_SET );
-    if ( filelength == -1L ) {
-        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
-        return _errorID;
+    if ( !_started ) {
+        _started = true;
+        if ( _writeBOM && ch != 0xFEFF ) {
+            out = Encode( 0xFEFF, out );
+        }
     }
-
-    if ( (unsigned long)filelength >= (size_t)-1 ) {
-        // Cannot handle files which won't fit in buffer together with null terminator
-        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
-        return _errorID;
+    if ( _encoding == XML_ENCODING_UTF8 ) {
+        int length = 0;
+        XMLUtilT<char>::ConvertUTF32ToUTF8( ch, reinterpret_cast<char*>( out ), &length );
+        return out + length;
     }
-
-    if ( filelength == 0 ) {
-        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
-        return _errorID;
+    unsigned long units[2] = { ch, 0 };
+    int n = 1;
+    if ( ch >= 0x10000 ) {
+        units[0] = 0xD800 + ( ( ch - 0x10000 ) >> 10 );
+        units[1] = 0xDC00 + ( ( ch - 0x10000 ) & 0x3FF );
+        n = 2;
     }
-
-    const size_t size = filelength;
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[size+1*sizeof(xchar)];
-    size_t read = fread( _charBuffer, 1, size, fp );
-    if ( read != size ) {
-        SetError( XML_ERROR_FILE_READ_ERROR, 0, 0 );
-        return _errorID;
+    for( int i=0; i<n; ++i ) {
+        const unsigned char hi = static_cast<unsigned char>( units[i] >> 8 );
+        const unsigned char lo = static_cast<unsigned char>( units[i] & 0xFF );
+        *out++ = _encoding == XML_ENCODING_UTF16BE ? hi : lo;
+        *out++ = _encoding == XML_ENCODING_UTF16BE ? lo : hi;
     }
+    return out;
+}
 
-    _charBuffer[size] = 0;
-	_charBuffer[size+sizeof(xchar)-1] = 0;
+template<typename xchar>
+void XMLEncodingSinkT<xchar>::Write( const xchar* data, size_t size )
+{
+    const xchar* end = data + size;
+    unsigned char block[BLOCK + 16];
+    unsigned char* out = block;
+    while ( data < end ) {
+        if ( out - block > BLOCK ) {
+            _target->Write( reinterpret_cast<const char*>( block ), out - block );
+            out = block;
+        }
+        if ( _started && _remaining == 0 && _encoding == XML_ENCODING_UTF8 ) {
+            // Runs of ASCII are copied without decoding.
+#ifdef TIXML_SSE2
+            while ( end - data >= 16 && out - block <= BLOCK - 16 && PackASCII16( data, out ) ) {
+                data += 16;
+                out += 16;
+            }
+#endif
+            while ( data < end && out - block <= BLOCK && static_cast<unsigned long>( *data ) < 0x80 ) {
+                *out++ = static_cast<unsigned char>( *data++ );
+            }
+            if ( data == end || out - block > BLOCK ) {
+                continue;
+            }
+        }
 
-    Parse();
-    return _errorID;
+        const unsigned long unit = sizeof( xchar ) == 1 ? static_cast<unsigned char>( *data ) : static_cast<unsigned long>( *data );
+        ++data;
+        if ( _remaining > 0 ) {
+            // The rest of a character split between writes, or units.
+            const bool continues = sizeof( xchar ) == 1 ? ( unit & 0xC0 ) == 0x80 : ( unit >= 0xDC00 && unit <= 0xDFFF );
+            if ( continues ) {
+                _partial = sizeof( xchar ) == 1 ? ( _partial << 6 ) | ( unit & 0x3F ) : 0x10000 + ( ( _partial - 0xD800 ) << 10 ) + ( unit - 0xDC00 );
+                if ( --_remaining == 0 ) {
+                    out = Encode( _partial, out );
+                }
+                continue;
+            }
+            out = Encode( 0xFFFD, out );
+            _remaining = 0;
+        }
+        if ( sizeof( xchar ) == 1 && unit >= 0x80 ) {
+            if ( unit >= 0xC0 && unit < 0xF8 ) {
+                _remaining = unit < 0xE0 ? 1 : unit < 0xF0 ? 2 : 3;
+                _partial = unit & ( 0x3F >> _remaining );
+            }
+            else {
+                out = Encode( 0xFFFD, out );
+            }
+        }
+        else if ( sizeof( xchar ) == 2 && unit >= 0xD800 && unit <= 0xDFFF ) {
+            if ( unit <= 0xDBFF ) {
+                _remaining = 1;
+                _partial = unit;
+            }
+            else {
+                out = Encode( 0xFFFD, out );
+            }
+        }
+        else {
+            out = Encode( unit, out );
+        }
+    }
+    if ( out != block ) {
+        _target->Write( reinterpret_cast<const char*>( block ), out - block );
+    }
 }
 
-template< >
-XMLError XMLDocumentT<char>::SaveFile( const char* filename, bool compact )
+template<typename xchar>
+void XMLEncodingSinkT<xchar>::Flush()
 {
-	char mode[] = {'w', 0};
-    FILE* fp = callfopen( filename, mode );
-    if ( !fp ) {
-        SetError( XML_ERROR_FILE_COULD_NOT_BE_OPENED, filename, 0 );
-        return _errorID;
+    if ( _remaining > 0 ) {
+        unsigned char block[8];
+        _remaining = 0;
+        _target->Write( reinterpret_cast<const char*>( block ), Encode( 0xFFFD, block ) - block );
     }
-    SaveFile(fp, compact);
-    fclose( fp );
-    return _errorID;
+    _target->Flush();
 }
 
-template< >
-XMLError XMLDocumentT<wchar_t>::SaveFile( const wchar_t* filename, bool compact )
+
+// --------- XMLPrinter ----------- //
+
+template<typename xchar>
+XMLPrinterT<xchar>::XMLPrinterT( FILE* file, bool compact, int depth ) :
+    _elementJustOpened( false ),
+    _firstElement( true ),
+    _fileSink( file ),
+    _sink( file ? &_fileSink : 0 ),
+    _bufferSize( 0 ),	// a FILE* is buffered already; write through
+    _indentWidth( 4 ),
+    _indentChar( ' ' ),
+    _depth( depth ),
+    _textDepth( -1 ),
+    _processEntities( true ),
+    _compactMode( compact )
 {
-	wchar_t mode[] = {'w', ',', ' ', 'c', 'c', 's', '=', 'U', 'N', 'I', 'C', 'O', 'D', 'E', 0};
-    FILE* fp = callfopen( filename, mode );
-    if ( !fp ) {
-        SetError( XML_ERROR_FILE_COULD_NOT_BE_OPENED, filename, 0 );
-        return _errorID;
-    }
-	_writeBOM = false; //UNICODE ccs flag automatically writes BOM.
-    SaveFile(fp, compact);
-    fclose( fp );
-    return _errorID;
+    InitEscapes();
+    _buffer.Push( 0 );
 }
 
 template<typename xchar>
-XMLError XMLDocumentT<xchar>::SaveFile( FILE* fp, bool compact )
+XMLPrinterT<xchar>::XMLPrinterT( XMLOutputSinkT<xchar>& sink, bool compact, int depth, int bufferSize ) :
+    _elementJustOpened( false ),
+    _firstElement( true ),
+    _fileSink( 0 ),
+    _sink( &sink ),
+    _bufferSize( bufferSize ),
+    _indentWidth( 4 ),
+    _indentChar( ' ' ),
+    _depth( depth ),
+    _textDepth( -1 ),
+    _processEntities( true ),
+    _compactMode( compact )
 {
-    // Clear any error from the last save, otherwise it will get reported
-    // for *this* call.
-    SetError( XML_NO_ERROR, 0, 0 );
-    XMLPrinterT<xchar> stream( fp, compact );
-    Print( &stream );
-    return _errorID;
+    TIXMLASSERT( bufferSize >= 0 );
+    InitEscapes();
+    _buffer.Push( 0 );
 }
 
 template<typename xchar>
-XMLError XMLDocumentT<xchar>::Parse( const xchar* p, size_t len )
+XMLPrinterT<xchar>::~XMLPrinterT()
 {
-    Clear();
+    if ( _sink ) {
+        FlushBuffer();
+    }
+}
 
-    if ( len == 0 || !p || !*p ) {
-        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
-        return _errorID;
+template<typename xchar>
+void XMLPrinterT<xchar>::InitEscapes()
+{
+    for( int i=0; i<ENTITY_RANGE; ++i ) {
+        _escape[i] = 0;
+        _restrictedEscape[i] = 0;
     }
-    if ( len == (size_t)(-1) ) {
-        len = strlen( p );
+    for( int i=0; i<NUM_ENTITIES; ++i ) {
+        const char entityValue = entities[i].value;
+        TIXMLASSERT( 0 <= entityValue && entityValue < ENTITY_RANGE );
+        _escape[ (unsigned char)entityValue ] = (unsigned char)( i+1 );
     }
-    TIXMLASSERT( _charBuffer == 0 );
-    _charBuffer = new char[ (len+1)*sizeof(xchar) ];
-    memcpy( _charBuffer, p, len*sizeof(xchar) );
-    _charBuffer[len*sizeof(xchar)] = 0;
-	_charBuffer[len*sizeof(xchar)+sizeof(xchar)-1] = 0;
+    _restrictedEscape[(unsigned char)'&'] = _escape[(unsigned char)'&'];
+    _restrictedEscape[(unsigned char)'<'] = _escape[(unsigned char)'<'];
+    _restrictedEscape[(unsigned char)'>'] = _escape[(unsigned char)'>'];	// not required, but consistency is nice
+}
 
-    Parse();
-    if ( Error() ) {
-        // clean up now essentially dangling memory.
-        // and the parse fail can put objects in the
-        // pools that are dead and inaccessible.
-        DeleteChildren();
-        _elementPool.Clear();
-        _attributePool.Clear();
-        _textPool.Clear();
-        _commentPool.Clear();
-    }
-    return _errorID;
+#ifdef TINYXML2_RVALUE_REFERENCES
+template<typename xchar>
+XMLPrinterT<xchar>::XMLPrinterT( XMLPrinterT<xchar>&& other ) :
+    _elementJustOpened( false ),
+    _firstElement( true ),
+    _fileSink( 0 ),
+    _sink( 0 ),
+    _bufferSize( 0 ),
+    _indentWidth( 4 ),
+    _indentChar( ' ' ),
+    _depth( 0 ),
+    _textDepth( -1 ),
+    _processEntities( true ),
+    _compactMode( false )
+{
+    InitEscapes();
+    _buffer.Push( 0 );
+    Swap( other );
 }
 
 template<typename xchar>
-void XMLDocumentT<xchar>::Print( XMLPrinterT<xchar>* streamer ) const
+XMLPrinterT<xchar>& XMLPrinterT<xchar>::operator=( XMLPrinterT<xchar>&& other )
 {
-    if ( streamer ) {
-        Accept( streamer );
+    Swap( other );
+    return *this;
+}
+#endif
+
+template<typename xchar>
+void XMLPrinterT<xchar>::Swap( XMLPrinterT<xchar>& other )
+{
+    if ( this == &other ) {
+        return;
     }
-    else {
-        XMLPrinterT<xchar> stdoutStreamer( stdout );
-        Accept( &stdoutStreamer );
+    SwapValues( _elementJustOpened, other._elementJustOpened );
+    _stack.Swap( other._stack );
+    SwapValues( _firstElement, other._firstElement );
+    SwapValues( _fileSink, other._fileSink );
+    SwapValues( _sink, other._sink );
+    // A printer to a FILE* points at its own file sink.
+    if ( _sink == &other._fileSink ) {
+        _sink = &_fileSink;
+    }
+    if ( other._sink == &_fileSink ) {
+        other._sink = &other._fileSink;
+    }
+    SwapValues( _bufferSize, other._bufferSize );
+    SwapValues( _indentWidth, other._indentWidth );
+    SwapValues( _indentChar, other._indentChar );
+    _indent.Swap( other._indent );
+    SwapValues( _depth, other._depth );
+    SwapValues( _textDepth, other._textDepth );
+    SwapValues( _processEntities, other._processEntities );
+    SwapValues( _compactMode, other._compactMode );
+    for( int i=0; i<ENTITY_RANGE; ++i ) {
+        SwapValues( _escape[i], other._escape[i] );
+        SwapValues( _restrictedEscape[i], other._restrictedEscape[i] );
     }
+    _buffer.Swap( other._buffer );
 }
 
-template<typename xchar>
-void XMLDocumentT<xchar>::SetError( XMLError error, const xchar* str1, const xchar* str2 )
+
+template< >
+void XMLPrinterT<char>::Print( const char* format, ... )
 {
-    TIXMLASSERT( error >= 0 && error < XML_ERROR_COUNT );
-    _errorID = error;
-    _errorStr1 = str1;
-    _errorStr2 = str2;
+    va_list     va;
+    va_start( va, format );
+
+    const int len = TIXML_VSCPRINTF( format, va );
+    // Close out and re-start the va-args
+    va_end( va );
+    TIXMLASSERT( len >= 0 );
+    va_start( va, format );
+    TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
+    char* p = _buffer.PushArr( len ) - 1;	// back up over the null terminator.
+    TIXML_VSNPRINTF( p, len+1, format, va );
+    va_end( va );
+
+    if ( _sink && _buffer.Size() > _bufferSize ) {
+        FlushBuffer();
+    }
 }
 
-template<typename xchar>
-const char* XMLDocumentT<xchar>::ErrorName() const
+template< >
+void XMLPrinterT<wchar_t>::Print( const wchar_t* format, ... )
 {
-	TIXMLASSERT( _errorID >= 0 && _errorID < XML_ERROR_COUNT );
-    const char* errorName = _errorNames[_errorID];
-    TIXMLASSERT( errorName && errorName[0] );
-    return errorName;
+    va_list     va;
+    va_start( va, format );
+
+    int len = TIXML_VSCWPRINTF( format, va );
+    // Close out and re-start the va-args
+    va_end( va );
+    va_start( va, format );
+    TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
+    wchar_t* p = _buffer.PushArr( len ) - 1;	// back up over the null terminator.
+    TIXML_VSNWPRINTF( p, len+1, format, va );
+    va_end( va );
+
+    if ( _sink && _buffer.Size() > _bufferSize ) {
+        FlushBuffer();
+    }
 }
 
+#ifdef TINYXML2_CHAR16
 template< >
-void XMLDocumentT<char>::PrintError() const
+void XMLPrinterT<char16_t>::Print( const char16_t* format, ... )
 {
-    if ( Error() ) {
-        static const int LEN = 20;
-        char buf1[LEN] = { 0 };
-        char buf2[LEN] = { 0 };
+    // There is no printf for char16_t: format with the char functions,
+    // from an ASCII format, and widen the result.
+    DynArray<char, 64> narrowFormat;
+    for( const char16_t* f = format; *f; ++f ) {
+        narrowFormat.Push( *f < 128 ? static_cast<char>( *f ) : '?' );
+    }
+    narrowFormat.Push( 0 );
 
-        if ( _errorStr1 ) {
-            TIXML_SNPRINTF( buf1, LEN, "%s", _errorStr1 );
-        }
-        if ( _errorStr2 ) {
-            TIXML_SNPRINTF( buf2, LEN, "%s", _errorStr2 );
-        }
+    va_list     va;
+    va_start( va, format );
+    const int len = TIXML_VSCPRINTF( narrowFormat.Mem(), va );
+    va_end( va );
+    TIXMLASSERT( len >= 0 );
+    DynArray<char, 256> str;
+    str.PushArr( len + 1 );
+    va_start( va, format );
+    TIXML_VSNPRINTF( str.Mem(), len+1, narrowFormat.Mem(), va );
+    va_end( va );
+
+    TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
+    char16_t* p = _buffer.PushArr( len ) - 1;	// back up over the null terminator.
+    for( int i=0; i<=len; ++i ) {
+        p[i] = static_cast<unsigned char>( str[i] );
+    }
+
+    if ( _sink && _buffer.Size() > _bufferSize ) {
+        FlushBuffer();
+    }
+}
+#endif
 
-        // Should check INT_MIN <= _errorID && _errorId <= INT_MAX, but that
-        // causes a clang "always true" -Wtautological-constant-out-of-range-compare warning
-        TIXMLASSERT( 0 <= _errorID && XML_ERROR_COUNT - 1 <= INT_MAX );
-        printf( "XMLDocument error id=%d '%s' str1=%s str2=%s\n",
-                static_cast<int>( _errorID ), ErrorName(), buf1, buf2 );
+template<typename xchar>
+void XMLPrinterT<xchar>::Write( const xchar* data, size_t size )
+{
+    if ( _sink && size >= (size_t)_bufferSize ) {
+        // Too big to stage.
+        FlushBuffer();
+        _sink->Write( data, size );
+        return;
+    }
+    TIXMLASSERT( size <= (size_t)INT_MAX );
+    TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
+    xchar* p = _buffer.PushArr( (int)size ) - 1;	// back up over the null terminator.
+    memcpy( p, data, size * sizeof(xchar) );
+    p[size] = 0;
+
+    if ( _sink && _buffer.Size() > _bufferSize ) {
+        FlushBuffer();
     }
 }
 
-template< >
-void XMLDocumentT<wchar_t>::PrintError() const
+template<typename xchar>
+void XMLPrinterT<xchar>::Write( const xchar* data )
 {
-    if ( Error() ) {
-        static const int LEN = 20;
-        wchar_t buf1[LEN] = { 0 };
-        wchar_t buf2[LEN] = { 0 };
+    Write( data, strlen( data ) );
+}
 
-        if ( _errorStr1 ) {
-            TIXML_SNWPRINTF( buf1, LEN, L"%s", _errorStr1 );
-        }
-        if ( _errorStr2 ) {
-            TIXML_SNWPRINTF( buf2, LEN, L"%s", _errorStr2 );
-        }
+template<typename xchar>
+void XMLPrinterT<xchar>::Putc( xchar ch )
+{
+    TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
+    _buffer[_buffer.Size() - 1] = ch;
+    _buffer.Push( 0 );
 
-        // Should check INT_MIN <= _errorID && _errorId <= INT_MAX, but that
-        // causes a clang "always true" -Wtautological-constant-out-of-range-compare warning
-        TIXMLASSERT( 0 <= _errorID && XML_ERROR_COUNT - 1 <= INT_MAX );
-        wprintf( L"XMLDocument error id=%d '%S' str1=%s str2=%s\n",
-                static_cast<int>( _errorID ), ErrorName(), buf1, buf2 );
+    if ( _sink && _buffer.Size() > _bufferSize ) {
+        FlushBuffer();
     }
 }
 
 template<typename xchar>
-void XMLDocumentT<xchar>::Parse()
+void XMLPrinterT<xchar>::FlushBuffer()
 {
-    TIXMLASSERT( NoChildren() ); // Clear() must have been called previously
-    TIXMLASSERT( _charBuffer );
-    char* p = _charBuffer;
-    p = XMLUtilT<char>::SkipWhiteSpace( p );
-    p = const_cast<char*>( XMLUtilT<char>::ReadBOM( p, &_writeBOM ) );
-    if ( !*p ) {
-        SetError( XML_ERROR_EMPTY_DOCUMENT, 0, 0 );
-        return;
+    TIXMLASSERT( _sink );
+    const int size = _buffer.Size() - 1;
+    if ( size > 0 ) {
+        _sink->Write( _buffer.Mem(), size );
+        ClearBuffer();
     }
-    ParseDeep((xchar*)p, 0 );
 }
 
-
 template<typename xchar>
-XMLPrinterT<xchar>::XMLPrinterT( FILE* file, bool compact, int depth ) :
-    _elementJustOpened( false ),
-    _firstElement( true ),
-    _fp( file ),
-    _depth( depth ),
-    _textDepth( -1 ),
-    _processEntities( true ),
-    _compactMode( compact )
+void XMLPrinterT<xchar>::Flush()
 {
-    for( int i=0; i<ENTITY_RANGE; ++i ) {
-        _entityFlag[i] = false;
-        _restrictedEntityFlag[i] = false;
+    if ( _sink ) {
+        FlushBuffer();
+        _sink->Flush();
     }
-    for( int i=0; i<NUM_ENTITIES; ++i ) {
-        const char entityValue = entities[i].value;
-        TIXMLASSERT( 0 <= entityValue && entityValue < ENTITY_RANGE );
-        _entityFlag[ (unsigned char)entityValue ] = true;
+}
+
+template<typename xchar>
+void XMLPrinterT<xchar>::CopyLayout( const XMLPrinterT<xchar>& other )
+{
+    _compactMode = other._compactMode;
+    _processEntities = other._processEntities;
+    _depth = other._depth;
+    _textDepth = -1;
+    _firstElement = false;
+    if ( _indentWidth != other._indentWidth || _indentChar != other._indentChar ) {
+        SetIndent( other._indentWidth, other._indentChar );
     }
-    _restrictedEntityFlag[(unsigned char)'&'] = true;
-    _restrictedEntityFlag[(unsigned char)'<'] = true;
-    _restrictedEntityFlag[(unsigned char)'>'] = true;	// not required, but consistency is nice
-    _buffer.Push( 0 );
 }
 
+template<typename xchar>
+void XMLPrinterT<xchar>::PushElementSource( const XMLElementT<xchar>& element, const xchar* source, size_t size )
+{
+    // The layout of OpenElement() and CloseElement() around the element.
+    const XMLElementT<xchar>* parentElem = element.Parent() ? element.Parent()->ToElement() : 0;
+    const bool compactMode = parentElem ? CompactMode( *parentElem ) : _compactMode;
+    SealElementIfJustOpened();
+    if ( _textDepth < 0 && !_firstElement && !compactMode ) {
+        Putc( '\n' );
+    }
+    if ( !compactMode ) {
+        PrintSpace( _depth );
+    }
+    Write( source, size );
+    _firstElement = false;
+    if ( _depth == 0 && !CompactMode( element ) ) {
+        Putc( '\n' );
+    }
+}
 
-template< >
-void XMLPrinterT<char>::Print( const char* format, ... )
+template<typename xchar>
+void XMLPrinterT<xchar>::SetIndent( int width, xchar ch )
 {
-    va_list     va;
-    va_start( va, format );
+    TIXMLASSERT( width >= 0 );
+    _indentWidth = width;
+    _indentChar = ch;
+    _indent.Clear();
+}
 
-    if ( _fp ) {
-        vfprintf( _fp, format, va );
+template<typename xchar>
+void XMLPrinterT<xchar>::PrintSpace( int depth )
+{
+    const int size = depth * _indentWidth;
+    if ( size <= 0 ) {
+        return;
     }
-    else {
-        const int len = TIXML_VSCPRINTF( format, va );
-        // Close out and re-start the va-args
-        va_end( va );
-        TIXMLASSERT( len >= 0 );
-        va_start( va, format );
-        TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
-        char* p = _buffer.PushArr( len ) - 1;	// back up over the null terminator.
-		TIXML_VSNPRINTF( p, len+1, format, va );
+    if ( _indent.Size() < size ) {
+        const int grow = size - _indent.Size();
+        xchar* p = _indent.PushArr( grow );
+        for( int i=0; i<grow; ++i ) {
+            p[i] = _indentChar;
+        }
     }
-    va_end( va );
+    Write( _indent.Mem(), size );
 }
 
-template< >
-void XMLPrinterT<wchar_t>::Print( const wchar_t* format, ... )
+
+template<typename xchar>
+const xchar* XMLPrinterT<xchar>::FindEscape( const xchar* p, const xchar* end, const unsigned char* escape )
 {
-    va_list     va;
-    va_start( va, format );
+    for( ; p < end; ++p ) {
+        // Remember, char is sometimes signed. (How many times has that bitten me?)
+        if ( *p > 0 && *p < ENTITY_RANGE && escape[(unsigned)*p] ) {
+            break;
+        }
+    }
+    return p;
+}
 
-    if ( _fp ) {
-        vfwprintf( _fp, format, va );
+#ifdef TIXML_SSE2
+template< >
+const char* XMLPrinterT<char>::FindEscape( const char* p, const char* end, const unsigned char* escape )
+{
+    // Every character that can be escaped is one of these five. Compare
+    // 16 bytes at a time, and check the candidates against the table.
+    const __m128i quot = _mm_set1_epi8( '"' );
+    const __m128i amp  = _mm_set1_epi8( '&' );
+    const __m128i apos = _mm_set1_epi8( '\'' );
+    const __m128i lt   = _mm_set1_epi8( '<' );
+    const __m128i gt   = _mm_set1_epi8( '>' );
+    while ( end - p >= 16 ) {
+        const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) );
+        const __m128i hit = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, quot ), _mm_cmpeq_epi8( v, amp ) ),
+                                          _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, apos ), _mm_cmpeq_epi8( v, lt ) ),
+                                                        _mm_cmpeq_epi8( v, gt ) ) );
+        int mask = _mm_movemask_epi8( hit );
+        while ( mask ) {
+            int i = 0;
+            while ( !( mask & ( 1 << i ) ) ) {
+                ++i;
+            }
+            if ( escape[(unsigned char)p[i]] ) {
+                return p + i;
+            }
+            mask &= mask - 1;
+        }
+        p += 16;
     }
-    else {
-        int len = TIXML_VSCWPRINTF( format, va );
-        // Close out and re-start the va-args
-        va_end( va );
-        va_start( va, format );
-        TIXMLASSERT( _buffer.Size() > 0 && _buffer[_buffer.Size() - 1] == 0 );
-        wchar_t* p = _buffer.PushArr( len ) - 1;	// back up over the null terminator.
-		TIXML_VSNWPRINTF( p, len+1, format, va );
+    for( ; p < end; ++p ) {
+        if ( *p > 0 && *p < ENTITY_RANGE && escape[(unsigned char)*p] ) {
+            break;
+        }
     }
-    va_end( va );
+    return p;
 }
+#endif
 
 template<typename xchar>
-void XMLPrinterT<xchar>::PrintSpace( int depth )
+void XMLPrinterT<xchar>::WriteEntity( int index )
 {
-	xchar space[] = {' ', ' ', ' ', ' ', 0};
-    for( int i=0; i<depth; ++i ) {
-        Print( space );
+    TIXMLASSERT( index >= 0 && index < NUM_ENTITIES );
+    const Entity& entity = entities[index];
+    // "&" pattern ";" - the longest is "&quot;"
+    xchar buf[8];
+    TIXMLASSERT( entity.length + 2 <= 8 );
+    buf[0] = '&';
+    for( int i=0; i<entity.length; ++i ) {
+        buf[i+1] = entity.pattern[i];
     }
+    buf[entity.length+1] = ';';
+    Write( buf, entity.length+2 );
 }
 
-
 template<typename xchar>
 void XMLPrinterT<xchar>::PrintString( const xchar* p, bool restricted )
 {
-    // Look for runs of bytes between entities to print.
-    const xchar* q = p;
-
-    if ( _processEntities ) {
-        const bool* flag = restricted ? _restrictedEntityFlag : _entityFlag;
-        while ( *q ) {
-            TIXMLASSERT( p <= q );
-            // Remember, char is sometimes signed. (How many times has that bitten me?)
-            if ( *q > 0 && *q < ENTITY_RANGE ) {
-                // Check for entities. If one is found, flush
-                // the stream up until the entity, write the
-                // entity, and keep looking.
-                if ( flag[(unsigned char)(*q)] ) {
-                    while ( p < q ) {
-                        const size_t delta = q - p;
-                        // %.*s accepts type int as "precision"
-                        const int toPrint = ( INT_MAX < delta ) ? INT_MAX : (int)delta;
-						xchar format[] = {'%', '.', '*', 's', 0};
-                        Print( format, toPrint, p );
-                        p += toPrint;
-                    }
-                    bool entityPatternPrinted = false;
-                    for( int i=0; i<NUM_ENTITIES; ++i ) {
-                        if ( entities[i].value == *q ) {
-							xchar format[] = {'&', '%', 's', ';', 0};
-							xchar* pattern = new xchar[entities[i].length+1];
-							for (int j = 0; j < entities[i].length; j++)
-								pattern[j] = entities[i].pattern[j];
-							pattern[entities[i].length] = 0;
-							Print( format, pattern);
-                            entityPatternPrinted = true;
-                            break;
-                        }
-                    }
-                    if ( !entityPatternPrinted ) {
-                        // TIXMLASSERT( entityPatternPrinted ) causes gcc -Wunused-but-set-variable in release
-                        TIXMLASSERT( false );
-                    }
-                    ++p;
-                }
-            }
-            ++q;
-            TIXMLASSERT( p <= q );
-        }
+    const xchar* const end = p + strlen( p );
+    if ( !_processEntities ) {
+        Write( p, end - p );
+        return;
     }
-    // Flush the remaining string. This will be the entire
-    // string if an entity wasn't found.
-    TIXMLASSERT( p <= q );
-    if ( !_processEntities || ( p < q ) ) {
-		xchar format[] = {'%', 's', 0};
-        Print( format, p );
+    // Copy the runs between entities in bulk; escape the rest from the table.
+    const unsigned char* escape = restricted ? _restrictedEscape : _escape;
+    while ( p < end ) {
+        const xchar* q = FindEscape( p, end, escape );
+        if ( p < q ) {
+            Write( p, q - p );
+        }
+        if ( q == end ) {
+            break;
+        }
+        WriteEntity( escape[(unsigned)*q] - 1 );
+        p = q + 1;
     }
 }
 
@@ -2713,13 +6911,12 @@ template< >
 void XMLPrinterT<char>::PushHeader( bool writeBOM, bool writeDec )
 {
     if ( writeBOM ) {
-        static const unsigned char bom[] = { TIXML_UTF_LEAD_0, TIXML_UTF_LEAD_1, TIXML_UTF_LEAD_2, 0 };
-		
-        Print( "%s", bom );
+        static const unsigned char bom[] = { TIXML_UTF_LEAD_0, TIXML_UTF_LEAD_1, TIXML_UTF_LEAD_2 };
+        Write( reinterpret_cast<const char*>( bom ), 3 );
     }
     if ( writeDec ) {		
 		char xmlTag[] = {'x', 'm', 'l', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n', '=', 
-						'"', '1', '.', '0', '"'};
+						'"', '1', '.', '0', '"', 0};
         PushDeclaration( xmlTag );
     }
 }
@@ -2729,15 +6926,29 @@ void XMLPrinterT<wchar_t>::PushHeader( bool writeBOM, bool writeDec )
 {
     if ( writeBOM ) {
         static const wchar_t bom = TIXML_UNICODE_LEAD_0 | TIXML_UNICODE_LEAD_1 << 8;
-		wchar_t format[] = {'%', 'c', 0};
-        Print( format, bom );
+        Putc( bom );
     }
     if ( writeDec ) {		
 		wchar_t xmlTag[] = {'x', 'm', 'l', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n', '=', 
-						'"', '1', '.', '0', '"'};
+						'"', '1', '.', '0', '"', 0};
+        PushDeclaration( xmlTag );
+    }
+}
+
+#ifdef TINYXML2_CHAR16
+template< >
+void XMLPrinterT<char16_t>::PushHeader( bool writeBOM, bool writeDec )
+{
+    if ( writeBOM ) {
+        Putc( 0xFEFF );
+    }
+    if ( writeDec ) {		
+		char16_t xmlTag[] = {'x', 'm', 'l', ' ', 'v', 'e', 'r', 's', 'i', 'o', 'n', '=', 
+						'"', '1', '.', '0', '"', 0};
         PushDeclaration( xmlTag );
     }
 }
+#endif
 
 
 template<typename xchar>
@@ -2746,15 +6957,14 @@ void XMLPrinterT<xchar>::OpenElement( const xchar* name, bool compactMode )
     SealElementIfJustOpened();
     _stack.Push( name );
 
-	xchar newLine[] = {'\n', 0};
     if ( _textDepth < 0 && !_firstElement && !compactMode ) {
-        Print( newLine );
+        Putc( '\n' );
     }
     if ( !compactMode ) {
         PrintSpace( _depth );
     }
-	xchar format[] = {'<', '%', 's', 0};
-    Print( format, name );
+    Putc( '<' );
+    Write( name );
     _elementJustOpened = true;
     _firstElement = false;
     ++_depth;
@@ -2765,11 +6975,12 @@ template<typename xchar>
 void XMLPrinterT<xchar>::PushAttribute( const xchar* name, const xchar* value )
 {
     TIXMLASSERT( _elementJustOpened );
-	xchar format[] = {' ', '%', 's', '=', '"' , 0};
-    Print( format, name );
+    Putc( ' ' );
+    Write( name );
+    Putc( '=' );
+    Putc( '\"' );
     PrintString( value, false );
-	xchar quote[] = {'"', 0};
-    Print( quote );
+    Putc( '\"' );
 }
 
 
@@ -2814,26 +7025,27 @@ void XMLPrinterT<xchar>::CloseElement( bool compactMode )
 {
     --_depth;
     const xchar* name = _stack.Pop();
-	xchar ending[] = {'/', '>', 0};
-	xchar newLine[] = {'\n', 0};
-	xchar format[] =  {'<', '/', '%', 's', '>', 0};
 
     if ( _elementJustOpened ) {
-        Print( ending );
+        Putc( '/' );
+        Putc( '>' );
     }
     else {
         if ( _textDepth < 0 && !compactMode) {
-            Print( newLine );
+            Putc( '\n' );
             PrintSpace( _depth );
         }
-        Print( format, name );
+        Putc( '<' );
+        Putc( '/' );
+        Write( name );
+        Putc( '>' );
     }
 
     if ( _textDepth == _depth ) {
         _textDepth = -1;
     }
     if ( _depth == 0 && !compactMode) {
-        Print( newLine );
+        Putc( '\n' );
     }
     _elementJustOpened = false;
 }
@@ -2846,8 +7058,7 @@ void XMLPrinterT<xchar>::SealElementIfJustOpened()
         return;
     }
     _elementJustOpened = false;
-	xchar ending[] = {'>', 0};
-    Print( ending );
+    Putc( '>' );
 }
 
 template<typename xchar>
@@ -2855,10 +7066,13 @@ void XMLPrinterT<xchar>::PushText( const xchar* text, bool cdata )
 {
     _textDepth = _depth-1;
 	
-	xchar format[] = {'<', '!', '[', 'C', 'D', 'A', 'T', 'A', '[', '%', 's', ']', ']', '>', 0};
+    static const xchar cdataStart[] = {'<', '!', '[', 'C', 'D', 'A', 'T', 'A', '['};
+    static const xchar cdataEnd[] = {']', ']', '>'};
     SealElementIfJustOpened();
     if ( cdata ) {
-        Print( format, text );
+        Write( cdataStart, 9 );
+        Write( text );
+        Write( cdataEnd, 3 );
     }
     else {
         PrintString( text, true );
@@ -2914,14 +7128,16 @@ template<typename xchar>
 void XMLPrinterT<xchar>::PushComment( const xchar* comment )
 {
     SealElementIfJustOpened();
-	xchar newLine[] = {'\n', 0};
     if ( _textDepth < 0 && !_firstElement && !_compactMode) {
-        Print( newLine );
+        Putc( '\n' );
         PrintSpace( _depth );
     }
     _firstElement = false;
-	xchar format[] = {'<', '!', '-', '-', '%', 's', '-', '-', '>', 0};
-    Print( format, comment );
+    static const xchar commentStart[] = {'<', '!', '-', '-'};
+    static const xchar commentEnd[] = {'-', '-', '>'};
+    Write( commentStart, 4 );
+    Write( comment );
+    Write( commentEnd, 3 );
 }
 
 
@@ -2929,14 +7145,16 @@ template<typename xchar>
 void XMLPrinterT<xchar>::PushDeclaration( const xchar* value )
 {
     SealElementIfJustOpened();
-	xchar newLine[] = {'\n', 0};
     if ( _textDepth < 0 && !_firstElement && !_compactMode) {
-        Print( newLine );
+        Putc( '\n' );
         PrintSpace( _depth );
     }
     _firstElement = false;
-	xchar format[] = {'<', '?', '%', 's', '?', '>', 0};
-    Print( format, value );
+    Putc( '<' );
+    Putc( '?' );
+    Write( value );
+    Putc( '?' );
+    Putc( '>' );
 }
 
 
@@ -2944,14 +7162,15 @@ template<typename xchar>
 void XMLPrinterT<xchar>::PushUnknown( const xchar* value )
 {
     SealElementIfJustOpened();
-	xchar newLine[] = {'\n', 0};
     if ( _textDepth < 0 && !_firstElement && !_compactMode) {
-        Print( newLine );
+        Putc( '\n' );
         PrintSpace( _depth );
     }
     _firstElement = false;
-	xchar format[] = {'<', '!', '%', 's', '>', 0};
-    Print( format, value );
+    Putc( '<' );
+    Putc( '!' );
+    Write( value );
+    Putc( '>' );
 }
 
 
@@ -3021,5 +7240,296 @@ bool XMLPrinterT<xchar>::Visit( const XMLUnknownT<xchar>& unknown )
     return true;
 }
 
+// --------- XMLCanonicalPrinter ----------- //
+
+// Compares 'p' with the ASCII string 'ascii', as far as 'ascii' goes.
+template<typename xchar>
+static bool MatchAscii( const xchar* p, const char* ascii )
+{
+    for( ; *ascii; ++p, ++ascii ) {
+        if ( *p != static_cast<xchar>( *ascii ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename xchar>
+static int CompareStrings( const xchar* a, const xchar* b )
+{
+    for( ; *a && *a == *b; ++a, ++b ) {
+    }
+    if ( *a == *b ) {
+        return 0;
+    }
+    return ( *a < *b ) ? -1 : 1;
+}
+
+template<typename xchar>
+static const xchar* LocalName( const xchar* name )
+{
+    const xchar* colon = 0;
+    for( const xchar* p = name; *p; ++p ) {
+        if ( *p == ':' ) {
+            colon = p;
+        }
+    }
+    return colon ? colon + 1 : name;
+}
+
+// "xmlns" or "xmlns:prefix"
+template<typename xchar>
+static bool IsNamespaceDeclaration( const xchar* name )
+{
+    return MatchAscii( name, "xmlns" ) && ( name[5] == 0 || name[5] == ':' );
+}
+
+// The value of the closest declaration of 'name' ("xmlns" or "xmlns:p")
+// on 'element' or its ancestors, or null.
+template<typename xchar>
+static const xchar* FindNamespace( const XMLNodeT<xchar>* node, const xchar* name )
+{
+    for( ; node; node = node->Parent() ) {
+        const XMLElementT<xchar>* element = node->ToElement();
+        if ( element ) {
+            const xchar* value = element->Attribute( name );
+            if ( value ) {
+                return value;
+            }
+        }
+    }
+    return 0;
+}
+
+// The namespace URI of an attribute name: empty if it has no prefix.
+template<typename xchar>
+static const xchar* AttributeNamespace( const XMLElementT<xchar>& element, const xchar* name )
+{
+    static const xchar empty[] = { 0 };
+    static const xchar xmlNamespace[] = {
+        'h','t','t','p',':','/','/','w','w','w','.','w','3','.','o','r','g','/',
+        'X','M','L','/','1','9','9','8','/','n','a','m','e','s','p','a','c','e',0
+    };
+    const xchar* local = LocalName( name );
+    if ( local == name ) {
+        return empty;
+    }
+    if ( local - name == 4 && MatchAscii( name, "xml:" ) ) {
+        return xmlNamespace;
+    }
+    xchar declaration[256] = { 'x','m','l','n','s',':' };
+    const int prefixLength = static_cast<int>( local - name ) - 1;
+    if ( prefixLength + 7 > (int)( sizeof( declaration ) / sizeof( xchar ) ) ) {
+        return empty;
+    }
+    memcpy( declaration + 6, name, prefixLength * sizeof( xchar ) );
+    declaration[6 + prefixLength] = 0;
+    const xchar* uri = FindNamespace<xchar>( &element, declaration );
+    return uri ? uri : empty;
+}
+
+// Canonical attribute order: namespace declarations by prefix (the
+// default one first), then attributes by namespace URI and local name.
+template<typename xchar>
+static bool AttributeLess( const XMLElementT<xchar>& element, const XMLAttributeT<xchar>* a, const XMLAttributeT<xchar>* b )
+{
+    const bool nsA = IsNamespaceDeclaration( a->Name() );
+    const bool nsB = IsNamespaceDeclaration( b->Name() );
+    if ( nsA != nsB ) {
+        return nsA;
+    }
+    if ( nsA ) {
+        return CompareStrings( a->Name(), b->Name() ) < 0;
+    }
+    const int c = CompareStrings( AttributeNamespace( element, a->Name() ), AttributeNamespace( element, b->Name() ) );
+    if ( c ) {
+        return c < 0;
+    }
+    return CompareStrings( LocalName( a->Name() ), LocalName( b->Name() ) ) < 0;
+}
+
+template<typename xchar>
+XMLCanonicalPrinterT<xchar>::XMLCanonicalPrinterT( FILE* file, bool withComments ) :
+    XMLPrinterT<xchar>( file, true ),
+    _withComments( withComments ),
+    _afterRoot( false )
+{
+}
+
+template<typename xchar>
+XMLCanonicalPrinterT<xchar>::XMLCanonicalPrinterT( XMLOutputSinkT<xchar>& sink, bool withComments, int bufferSize ) :
+    XMLPrinterT<xchar>( sink, true, 0, bufferSize ),
+    _withComments( withComments ),
+    _afterRoot( false )
+{
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::VisitEnter( const XMLDocumentT<xchar>& doc )
+{
+    // Other modes have already lost white space the output needs.
+    TIXMLASSERT( doc.WhitespaceMode() == PEDANTIC_WHITESPACE );
+    (void)doc;
+    _afterRoot = false;
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::VisitExit( const XMLDocumentT<xchar>& )
+{
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::VisitEnter( const XMLElementT<xchar>& element, const XMLAttributeT<xchar>* attribute )
+{
+    this->Putc( '<' );
+    this->Write( element.Name() );
+
+    // Insertion sort: elements rarely have more than a few attributes.
+    _attributes.Clear();
+    for( ; attribute; attribute = attribute->Next() ) {
+        if ( IsNamespaceDeclaration( attribute->Name() ) ) {
+            // Drop declarations that are already in effect.
+            const xchar* inherited = FindNamespace( element.Parent(), attribute->Name() );
+            if ( inherited ? CompareStrings( inherited, attribute->Value() ) == 0 : !*attribute->Value() ) {
+                continue;
+            }
+        }
+        int i = _attributes.Size();
+        _attributes.Push( attribute );
+        for( ; i > 0 && AttributeLess( element, attribute, _attributes[i-1] ); --i ) {
+            _attributes[i] = _attributes[i-1];
+        }
+        _attributes[i] = attribute;
+    }
+    for( int i=0; i<_attributes.Size(); ++i ) {
+        this->Putc( ' ' );
+        this->Write( _attributes[i]->Name() );
+        this->Putc( '=' );
+        this->Putc( '\"' );
+        WriteEscaped( _attributes[i]->Value(), true );
+        this->Putc( '\"' );
+    }
+    this->Putc( '>' );
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::VisitExit( const XMLElementT<xchar>& element )
+{
+    this->Putc( '<' );
+    this->Putc( '/' );
+    this->Write( element.Name() );
+    this->Putc( '>' );
+    if ( element.Parent() && element.Parent()->ToDocument() ) {
+        _afterRoot = true;
+    }
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::Visit( const XMLTextT<xchar>& text )
+{
+    WriteEscaped( text.Value(), false );
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::Visit( const XMLCommentT<xchar>& comment )
+{
+    if ( _withComments ) {
+        BeginOutsideNode();
+        WriteAscii( "<!--" );
+        this->Write( comment.Value() );
+        WriteAscii( "-->" );
+        EndOutsideNode( comment );
+    }
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::Visit( const XMLDeclarationT<xchar>& declaration )
+{
+    // The parser reads processing instructions as declarations. The XML
+    // declaration itself is not part of the canonical form.
+    const xchar* p = declaration.Value();
+    if ( MatchAscii( p, "xml" ) && ( !p[3] || XMLUtilT<xchar>::IsWhiteSpace( p[3] ) ) ) {
+        return true;
+    }
+    BeginOutsideNode();
+    WriteAscii( "<?" );
+    const xchar* target = p;
+    while ( *p && !XMLUtilT<xchar>::IsWhiteSpace( *p ) ) {
+        ++p;
+    }
+    this->Write( target, p - target );
+    p = XMLUtilT<xchar>::SkipWhiteSpace( p );
+    if ( *p ) {
+        this->Putc( ' ' );
+        this->Write( p );
+    }
+    WriteAscii( "?>" );
+    EndOutsideNode( declaration );
+    return true;
+}
+
+template<typename xchar>
+bool XMLCanonicalPrinterT<xchar>::Visit( const XMLUnknownT<xchar>& )
+{
+    // DTDs are not part of the canonical form.
+    return true;
+}
+
+template<typename xchar>
+void XMLCanonicalPrinterT<xchar>::BeginOutsideNode()
+{
+    if ( _afterRoot ) {
+        this->Putc( '\n' );
+    }
+}
+
+template<typename xchar>
+void XMLCanonicalPrinterT<xchar>::EndOutsideNode( const XMLNodeT<xchar>& node )
+{
+    if ( !_afterRoot && node.Parent() && node.Parent()->ToDocument() ) {
+        this->Putc( '\n' );
+    }
+}
+
+template<typename xchar>
+void XMLCanonicalPrinterT<xchar>::WriteEscaped( const xchar* p, bool attribute )
+{
+    const xchar* run = p;
+    for( ; *p; ++p ) {
+        const char* entity = 0;
+        switch( *p ) {
+            case '&':	entity = "&amp;";	break;
+            case '<':	entity = "&lt;";	break;
+            case '>':	entity = attribute ? 0 : "&gt;";		break;
+            case '\"':	entity = attribute ? "&quot;" : 0;		break;
+            case '\t':	entity = attribute ? "&#x9;" : 0;		break;
+            case '\n':	entity = attribute ? "&#xA;" : 0;		break;
+            case '\r':	entity = "&#xD;";	break;
+            default:	break;
+        }
+        if ( entity ) {
+            this->Write( run, p - run );
+            WriteAscii( entity );
+            run = p + 1;
+        }
+    }
+    this->Write( run, p - run );
+}
+
+template<typename xchar>
+void XMLCanonicalPrinterT<xchar>::WriteAscii( const char* p )
+{
+    for( ; *p; ++p ) {
+        this->Putc( static_cast<xchar>( *p ) );
+    }
+}
+
 }   // namespace tinyxml2
 
+
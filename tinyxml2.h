@@ -88,6 +88,16 @@ distribution.
 #       define TIXMLASSERT( x )           {}
 #endif
 
+// Move constructors and move assignment, where the compiler has them.
+#if __cplusplus >= 201103L || ( defined(_MSC_VER) && _MSC_VER >= 1600 )
+#   define TINYXML2_RVALUE_REFERENCES
+#endif
+
+// UTF-16 documents on every platform, where the compiler has char16_t.
+#if __cplusplus >= 201103L || ( defined(_MSC_VER) && _MSC_VER >= 1900 )
+#   define TINYXML2_CHAR16
+#endif
+
 
 /* Versioning, past 1.0.14:
 	http://semver.org/
@@ -115,11 +125,35 @@ class XMLUnknownT;
 template<typename xchar>
 class XMLPrinterT;
 
+// Exchange two values; used by the Swap() methods.
+template<class T>
+inline void SwapValues( T& a, T& b )
+{
+    T t = a;
+    a = b;
+    b = t;
+}
+
 /*
-	A class that wraps strings. Normally stores the start and end
-	pointers into the XML file itself, and will apply normalization
+	A class that wraps strings. Normally stores the location of the
+	string in the XML file itself, and will apply normalization
 	and entity translation if actually read. Can also store (and memory
-	manage) a traditional char[]
+	manage) a traditional char[], or hold a short string inline.
+
+	The layout is packed into three 32-bit words, so it costs 12 bytes
+	in every node and attribute on both 32 and 64 bit builds. A string
+	in the XML file is stored as an offset and length relative to the
+	document buffer, which is why GetStr() and the parse functions take
+	that buffer as the 'base' argument. The mode and normalization
+	flags share the last word.
+
+	The flags aren't folded into spare bits of the length: on 64 bit
+	builds the heap, interned and cloned modes fill both words of the
+	union with a pointer, and the inline mode fills them with text, so
+	no bits are spare in every mode. Freeing some would mean tagging
+	pointers or shortening inline strings, and with 32-bit alignment
+	the class would still round up to 12 bytes unless it were cut all
+	the way to 8.
 */
 template<typename xchar>
 class StrPairT
@@ -129,6 +163,7 @@ public:
         NEEDS_ENTITY_PROCESSING			= 0x01,
         NEEDS_NEWLINE_NORMALIZATION		= 0x02,
         NEEDS_WHITESPACE_COLLAPSING     = 0x04,
+        NEEDS_ATTRIBUTE_NORMALIZATION	= 0x08,	// literal tab and newlines become spaces
 
         TEXT_ELEMENT		            	= NEEDS_ENTITY_PROCESSING | NEEDS_NEWLINE_NORMALIZATION,
         TEXT_ELEMENT_LEAVE_ENTITIES		= NEEDS_NEWLINE_NORMALIZATION,
@@ -138,39 +173,74 @@ public:
         COMMENT				        = NEEDS_NEWLINE_NORMALIZATION
     };
 
-    StrPairT() : _flags( 0 ), _start( 0 ), _end( 0 ) {}
+    StrPairT() : _flags( INLINE ) {
+        _u._span._offset = 0;
+        _u._span._length = 0;
+    }
     ~StrPairT();
 
-    void Set( xchar* start, xchar* end, int flags );
+    void Set( xchar* base, xchar* start, xchar* end, int flags );
 
-    const xchar* GetStr();
+    const xchar* GetStr( xchar* base );
 
-    bool Empty() const {
-        return _start == _end;
-    }
+    bool Empty() const;
 
     void SetInternedStr( const xchar* str );
 
     void SetStr( const xchar* str, int flags=0 );
 
-    xchar* ParseText( xchar* in, const xchar* endTag, int strFlags );
-    xchar* ParseName( xchar* in );
+    xchar* ParseText( xchar* base, xchar* in, const xchar* endTag, int strFlags );
+    xchar* ParseName( xchar* base, xchar* in );
 
     void TransferTo( StrPairT<xchar>* other );
 
+    // Deep clones copy their long strings into one block. The block
+    // counts the strings that use it, and the last one frees it.
+    struct CloneBlock {
+        xchar*  start;
+        xchar*  next;
+    };
+    static size_t CloneSize( const xchar* str );
+    static void NewCloneBlock( CloneBlock* block, size_t size, size_t strings );
+    void SetClonedStr( const xchar* str, CloneBlock* block );
+
 private:
     void Reset();
-    void CollapseWhitespace();
+
+    // The pointer of a HEAP, INTERNED or CLONED string is copied in and out
+    // of the union, so the class only needs 32-bit alignment.
+    xchar* Pointer() const {
+        xchar* p = 0;
+        memcpy( &p, _u._words, sizeof( p ) );
+        return p;
+    }
+    void SetPointer( const xchar* p ) {
+        memcpy( _u._words, &p, sizeof( p ) );
+    }
 
     enum {
         NEEDS_FLUSH = 0x100,
-        NEEDS_DELETE = 0x200
+        NEEDS_DELETE = 0x200,   // HEAP: owns a new[] copy
+        INTERNED = 0x400,       // points to a string it doesn't own
+        INLINE = 0x800,         // short string held in the union
+        CLONED = 0x1000         // shares a counted clone block
     };
-
-    // After parsing, if *_end != 0, it can be set to zero.
+    // With none of the mode bits set, the string is a span of the buffer.
+    enum { INLINE_SIZE = 2 * sizeof( unsigned ) / sizeof( xchar ) };
+    // A size_t stored in a clone block: the block's count, or the offset
+    // of a string from the start of its block.
+    enum { CLONE_WORD = ( sizeof( size_t ) + sizeof( xchar ) - 1 ) / sizeof( xchar ) };
+    void ReleaseClone();
+
+    union {
+        struct {
+            unsigned _offset;
+            unsigned _length;
+        } _span;
+        unsigned    _words[2];
+        xchar       _inline[INLINE_SIZE];
+    } _u;
     int     _flags;
-    xchar*   _start;
-    xchar*   _end;
 
     StrPairT( const StrPairT<xchar>& other );	// not supported
     void operator=( StrPairT<xchar>& other );	// not supported, use TransferTo()
@@ -180,6 +250,9 @@ private:
 //template class StrPairT<wchar_t>;
 typedef StrPairT<char> StrPairA;
 typedef StrPairT<wchar_t> StrPairW;
+#ifdef TINYXML2_CHAR16
+typedef StrPairT<char16_t> StrPairU16;
+#endif
 
 #ifdef _UNICODE
 typedef StrPairW StrPair;
@@ -276,10 +349,44 @@ public:
         return _mem;
     }
 
+    void Swap( DynArray& other ) {
+        if ( this == &other ) {
+            return;
+        }
+        if ( _mem != _pool && other._mem != other._pool ) {
+            SwapValues( _mem, other._mem );
+            SwapValues( _allocated, other._allocated );
+            SwapValues( _size, other._size );
+            return;
+        }
+        // An inline pool can't be handed over; its contents are copied.
+        DynArray temp;
+        temp.TakeFrom( *this );
+        TakeFrom( other );
+        other.TakeFrom( temp );
+    }
+
 private:
     DynArray( const DynArray& ); // not supported
     void operator=( const DynArray& ); // not supported
 
+    // Moves the contents of 'other' into this array, which must not
+    // own any memory, and leaves 'other' empty.
+    void TakeFrom( DynArray& other ) {
+        TIXMLASSERT( _mem == _pool );
+        if ( other._mem == other._pool ) {
+            memcpy( _pool, other._pool, sizeof(T)*other._size );	// warning: not using constructors, only works for PODs
+        }
+        else {
+            _mem = other._mem;
+            _allocated = other._allocated;
+        }
+        _size = other._size;
+        other._mem = other._pool;
+        other._allocated = INITIAL_SIZE;
+        other._size = 0;
+    }
+
     void EnsureCapacity( int cap ) {
         TIXMLASSERT( cap > 0 );
         if ( cap > _allocated ) {
@@ -317,6 +424,7 @@ public:
     virtual void Free( void* ) = 0;
     virtual void SetTracked() = 0;
     virtual void Clear() = 0;
+    virtual void* Relocate( void* ) = 0;
 };
 
 
@@ -327,7 +435,7 @@ template< int SIZE >
 class MemPoolT : public MemPool
 {
 public:
-    MemPoolT() : _root(0), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
+    MemPoolT() : _root(0), _retiredRoot(0), _currentAllocs(0), _nAllocs(0), _maxAllocs(0), _nUntracked(0)	{}
     ~MemPoolT() {
         Clear();
     }
@@ -354,15 +462,7 @@ public:
 
     virtual void* Alloc() {
         if ( !_root ) {
-            // Need a new block.
-            Block* block = new Block();
-            _blockPtrs.Push( block );
-
-            for( int i=0; i<COUNT-1; ++i ) {
-                block->chunk[i].next = &block->chunk[i+1];
-            }
-            block->chunk[COUNT-1].next = 0;
-            _root = block->chunk;
+            NewBlock();
         }
         void* result = _root;
         _root = _root->next;
@@ -388,6 +488,101 @@ public:
         chunk->next = _root;
         _root = chunk;
     }
+    /*
+    	Relocation moves live items out of partially used blocks.
+    	BeginRelocation() retires all current blocks. Each Relocate()
+    	then copies an item into a fresh block, in call order, and
+    	frees the old copy. EndRelocation() deletes every retired block
+    	that no longer holds a live item; the others are kept and their
+    	free chunks reused.
+    */
+    void BeginRelocation() {
+        TIXMLASSERT( _retiredBlockPtrs.Empty() );
+        while( !_blockPtrs.Empty() ) {
+            _retiredBlockPtrs.Push( _blockPtrs.Pop() );
+        }
+        _retiredRoot = _root;
+        _root = 0;
+    }
+
+    virtual void* Relocate( void* mem ) {
+        TIXMLASSERT( mem );
+        if ( !_root ) {
+            NewBlock();
+        }
+        Chunk* chunk = _root;
+        _root = _root->next;
+        memcpy( chunk, mem, SIZE );	// warning: a bitwise move; items must not point into themselves.
+
+        Chunk* old = static_cast<Chunk*>( mem );
+        old->next = _retiredRoot;
+        _retiredRoot = old;
+        return chunk;
+    }
+
+    void EndRelocation() {
+        const int nBlocks = _retiredBlockPtrs.Size();
+        if ( nBlocks == 0 ) {
+            return;
+        }
+        qsort( _retiredBlockPtrs.Mem(), nBlocks, sizeof(Block*), CompareBlocks );
+
+        DynArray< int, 10 > freeCount;
+        freeCount.PushArr( nBlocks );
+        for( int i=0; i<nBlocks; ++i ) {
+            freeCount[i] = 0;
+        }
+        for( Chunk* chunk = _retiredRoot; chunk; chunk = chunk->next ) {
+            ++freeCount[FindRetiredBlock( chunk )];
+        }
+        // Free chunks in the blocks that survive go back on the free list.
+        Chunk* chunk = _retiredRoot;
+        while ( chunk ) {
+            Chunk* next = chunk->next;
+            if ( freeCount[FindRetiredBlock( chunk )] < COUNT ) {
+                chunk->next = _root;
+                _root = chunk;
+            }
+            chunk = next;
+        }
+        for( int i=0; i<nBlocks; ++i ) {
+            if ( freeCount[i] == COUNT ) {
+                delete _retiredBlockPtrs[i];
+            }
+            else {
+                _blockPtrs.Push( _retiredBlockPtrs[i] );
+            }
+        }
+        _retiredBlockPtrs.Clear();
+        _retiredRoot = 0;
+    }
+
+    int BlockCount() const {
+        return _blockPtrs.Size();
+    }
+
+    // Make sure the next 'count' calls to Alloc() don't allocate.
+    void Reserve( int count ) {
+        for( Chunk* chunk = _root; chunk && count > 0; chunk = chunk->next ) {
+            --count;
+        }
+        while ( count > 0 ) {
+            NewBlock();
+            count -= COUNT;
+        }
+    }
+
+    // Exchange the blocks and statistics of two pools of the same size.
+    void Swap( MemPoolT& other ) {
+        TIXMLASSERT( _retiredBlockPtrs.Empty() && other._retiredBlockPtrs.Empty() );
+        _blockPtrs.Swap( other._blockPtrs );
+        SwapValues( _root, other._root );
+        SwapValues( _currentAllocs, other._currentAllocs );
+        SwapValues( _nAllocs, other._nAllocs );
+        SwapValues( _maxAllocs, other._maxAllocs );
+        SwapValues( _nUntracked, other._nUntracked );
+    }
+
     void Trace( const char* name ) {
         printf( "Mempool %s watermark=%d [%dk] current=%d size=%d nAlloc=%d blocks=%d\n",
                 name, _maxAllocs, _maxAllocs*SIZE/1024, _currentAllocs, SIZE, _nAllocs, _blockPtrs.Size() );
@@ -423,8 +618,47 @@ private:
     struct Block {
         Chunk chunk[COUNT];
     };
+
+    void NewBlock() {
+        Block* block = new Block();
+        _blockPtrs.Push( block );
+
+        for( int i=0; i<COUNT-1; ++i ) {
+            block->chunk[i].next = &block->chunk[i+1];
+        }
+        block->chunk[COUNT-1].next = _root;
+        _root = block->chunk;
+    }
+
+    static int CompareBlocks( const void* a, const void* b ) {
+        const char* pa = reinterpret_cast<const char*>( *static_cast<Block* const*>( a ) );
+        const char* pb = reinterpret_cast<const char*>( *static_cast<Block* const*>( b ) );
+        return ( pa < pb ) ? -1 : ( ( pa > pb ) ? 1 : 0 );
+    }
+
+    // Retired blocks are sorted by address; binary search for the owner of a chunk.
+    int FindRetiredBlock( const Chunk* chunk ) const {
+        const char* p = reinterpret_cast<const char*>( chunk );
+        int lo = 0;
+        int hi = _retiredBlockPtrs.Size() - 1;
+        while ( lo < hi ) {
+            const int mid = ( lo + hi + 1 ) / 2;
+            if ( reinterpret_cast<const char*>( _retiredBlockPtrs[mid] ) <= p ) {
+                lo = mid;
+            }
+            else {
+                hi = mid - 1;
+            }
+        }
+        TIXMLASSERT( p >= reinterpret_cast<const char*>( _retiredBlockPtrs[lo] ) );
+        TIXMLASSERT( p < reinterpret_cast<const char*>( _retiredBlockPtrs[lo] + 1 ) );
+        return lo;
+    }
+
     DynArray< Block*, 10 > _blockPtrs;
+    DynArray< Block*, 10 > _retiredBlockPtrs;
     Chunk* _root;
+    Chunk* _retiredRoot;
 
     int _currentAllocs;
     int _nAllocs;
@@ -498,6 +732,10 @@ template class XMLVisitorT<char>;
 template class XMLVisitorT<wchar_t>;
 typedef XMLVisitorT<char> XMLVisitorA;
 typedef XMLVisitorT<wchar_t> XMLVisitorW;
+#ifdef TINYXML2_CHAR16
+template class XMLVisitorT<char16_t>;
+typedef XMLVisitorT<char16_t> XMLVisitorU16;
+#endif
 #ifdef _UNICODE
 typedef XMLVisitorW XMLVisitor;
 #else
@@ -528,6 +766,8 @@ enum XMLError {
     XML_ERROR_PARSING,
     XML_CAN_NOT_CONVERT_TEXT,
     XML_NO_TEXT_NODE,
+    XML_ERROR_INVALID_UTF8,
+    XML_ERROR_FILE_WRITE_ERROR,
 
 	XML_ERROR_COUNT
 };
@@ -561,36 +801,79 @@ public:
     static bool IsWhiteSpace( wchar_t p )					{
         return !IsUTF8Continuation(p) && iswspace( static_cast<wchar_t>(p) );
     }
+
+#ifdef TINYXML2_CHAR16
+    static bool IsWhiteSpace( char16_t p )					{
+        return p < 128 && isspace( static_cast<unsigned char>(p) );
+    }
+#endif
     
+    // Names follow the NameStartChar and NameChar productions of XML 1.0
+    // (Fifth Edition). ASCII is looked up in a bit set, so the common case
+    // has no branches; other characters go through IsNameStartCodePoint().
+    inline static bool IsASCIINameStartChar( unsigned ch ) {
+        static const unsigned bits[4] = { 0x00000000, 0x04000000, 0x87FFFFFE, 0x07FFFFFE };
+        return ( ( bits[ch >> 5] >> ( ch & 31 ) ) & 1 ) != 0;
+    }
+
+    inline static bool IsASCIINameChar( unsigned ch ) {
+        static const unsigned bits[4] = { 0x00000000, 0x07FF6000, 0x87FFFFFE, 0x07FFFFFE };
+        return ( ( bits[ch >> 5] >> ( ch & 31 ) ) & 1 ) != 0;
+    }
+
+    static bool IsNameStartCodePoint( unsigned long codePoint );
+    static bool IsNameCodePoint( unsigned long codePoint );
+
+    // A byte past ASCII is only part of a UTF-8 sequence: a lead byte may
+    // start a name, and StrPair::ParseName() checks the decoded character.
     inline static bool IsNameStartChar( char ch ) {
-        if ( ch & 0x80 ) { //if ch >= 128
-            // This is a heuristic guess in attempt to not implement Unicode-aware isalpha()
-            return true;
+        const unsigned char c = static_cast<unsigned char>( ch );
+        if ( c < 0x80 ) {
+            return IsASCIINameStartChar( c );
         }
-        if ( isalpha( ch ) ) {
-            return true;
+        return c >= 0xC2 && c <= 0xF3;
+    }
+
+    inline static bool IsNameChar( char ch ) {
+        const unsigned char c = static_cast<unsigned char>( ch );
+        if ( c < 0x80 ) {
+            return IsASCIINameChar( c );
         }
-        return ch == ':' || ch == '_';
+        return c <= 0xF3 && c != 0xC0 && c != 0xC1;
     }
-    
-	inline static bool IsNameStartChar( wchar_t ch ) {
-        if ( ch >= 128 ) {
-            // This is a heuristic guess in attempt to not implement Unicode-aware isalpha()
-            return true;
+
+    inline static bool IsNameStartChar( wchar_t ch ) {
+        const unsigned long c = static_cast<unsigned long>( ch );
+        if ( c < 0x80 ) {
+            return IsASCIINameStartChar( c );
         }
-        if ( iswalpha( ch ) ) {
-            return true;
+        return IsNameStartCodePoint( c );
+    }
+
+    inline static bool IsNameChar( wchar_t ch ) {
+        const unsigned long c = static_cast<unsigned long>( ch );
+        if ( c < 0x80 ) {
+            return IsASCIINameChar( c );
         }
-        return ch == ':' || ch == '_';
+        return IsNameCodePoint( c );
     }
 
-    inline static bool IsNameChar( xchar ch ) {
-        return IsNameStartChar( ch )
-               || isdigit( ch )
-               || ch == '.'
-               || ch == '-';
+#ifdef TINYXML2_CHAR16
+    inline static bool IsNameStartChar( char16_t ch ) {
+        if ( ch < 0x80 ) {
+            return IsASCIINameStartChar( ch );
+        }
+        return IsNameStartCodePoint( ch );
     }
 
+    inline static bool IsNameChar( char16_t ch ) {
+        if ( ch < 0x80 ) {
+            return IsASCIINameChar( ch );
+        }
+        return IsNameCodePoint( ch );
+    }
+#endif
+
     inline static bool StringEqual( const xchar* p, const xchar* q, int nChar=INT_MAX )  {
         if ( p == q ) {
             return true;
@@ -613,8 +896,8 @@ public:
     }
 
     static const char* ReadBOM( const char* p, bool* hasBOM );
-    // p is the starting location,
-    // the UTF-8 value of the entity will be placed in value, and length filled in.
+    // p is the starting location, the value of the entity in the document
+    // encoding (UTF-8, UTF-16 or UTF-32) will be placed in value, and length filled in.
     static const xchar* GetCharacterRef( const xchar* p, xchar* value, int* length );
     static void ConvertUTF32ToUTF8( unsigned long input, xchar* output, int* length );
 
@@ -642,6 +925,9 @@ public:
 //template class XMLUtilT<wchar_t>;
 typedef XMLUtilT<char> XMLUtilA;
 typedef XMLUtilT<wchar_t> XMLUtilW;
+#ifdef TINYXML2_CHAR16
+typedef XMLUtilT<char16_t> XMLUtilU16;
+#endif
 #ifdef _UNICODE
 typedef XMLUtilW XMLUtil;
 #else
@@ -748,6 +1034,12 @@ public:
     	@endverbatim
     */
     const xchar* Value() const;
+    /** Value() as a wchar_t string. Narrow documents transcode the
+    	value on first use into a cache kept by the document; the copy
+    	is valid until the document is next changed or cleared. Wide
+    	documents return Value() itself.
+    */
+    const wchar_t* ValueW() const;
 
     /** Set the Value of an XML node.
     	@sa Value()
@@ -887,6 +1179,21 @@ public:
     */
     virtual XMLNodeT<xchar>* ShallowClone( XMLDocumentT<xchar>* document ) const = 0;
 
+    /**
+    	Make a copy of this node and all of its children, owned by
+    	'target' (or by this->GetDocument() if 'target' is null).
+    	The returned node is not linked into the target's tree.
+
+    	The copy is made in one pass: the nodes and attributes are
+    	allocated from the target's pools in bulk, and the strings
+    	are copied into a single block, freed with the last node or
+    	attribute that uses it.
+
+    	Note: if called on a XMLDocument, this will return null.
+    	See XMLDocument::DeepCopy().
+    */
+    XMLNodeT<xchar>* DeepClone( XMLDocumentT<xchar>* target ) const;
+
     /**
     	Test if 2 nodes are the same, but don't test children.
     	The 2 nodes do not need to be in the same Document.
@@ -924,6 +1231,8 @@ protected:
     virtual ~XMLNodeT();
 
     virtual xchar* ParseDeep( xchar*, StrPairT<xchar>* );
+    // The document buffer that the _value spans are relative to.
+    xchar* CharBuffer() const;
 
     XMLDocumentT<xchar>*	_document;
     XMLNodeT<xchar>*		_parent;
@@ -935,8 +1244,14 @@ protected:
     XMLNodeT<xchar>*		_prev;
     XMLNodeT<xchar>*		_next;
 
+    // Drop the output cached by PrintIncremental() for this node and its
+    // ancestors; called by everything that changes what the node prints.
+    void MarkDirty() const;
+
 private:
     MemPool*		_memPool;
+    mutable int		_printCacheEntry;	// index into the document's print cache, or -1
+    int				_unlinkedIndex;		// index into the document's unlinked list, or -1
     void Unlink( XMLNodeT<xchar>* child );
     static void DeleteNode( XMLNodeT<xchar>* node );
     void InsertChildPreamble( XMLNodeT<xchar>* insertThis ) const;
@@ -948,6 +1263,10 @@ template class TINYXML2_LIB XMLNodeT<char>;
 template class TINYXML2_LIB XMLNodeT<wchar_t>;
 typedef XMLNodeT<char> XMLNodeA;
 typedef XMLNodeT<wchar_t> XMLNodeW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLNodeT<char16_t>;
+typedef XMLNodeT<char16_t> XMLNodeU16;
+#endif
 #ifdef _UNICODE
 typedef XMLNodeW XMLNode;
 #else
@@ -985,6 +1304,7 @@ public:
     /// Declare whether this should be CDATA or standard text.
     void SetCData( bool isCData )			{
         _isCData = isCData;
+        this->MarkDirty();
     }
     /// Returns true if this is a CDATA text element.
     bool CData() const						{
@@ -1010,6 +1330,10 @@ template class TINYXML2_LIB XMLTextT<char>;
 template class TINYXML2_LIB XMLTextT<wchar_t>;
 typedef XMLTextT<char> XMLTextA;
 typedef XMLTextT<wchar_t> XMLTextW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLTextT<char16_t>;
+typedef XMLTextT<char16_t> XMLTextU16;
+#endif
 #ifdef _UNICODE
 typedef XMLTextW XMLText;
 #else
@@ -1050,6 +1374,10 @@ template class TINYXML2_LIB XMLCommentT<char>;
 template class TINYXML2_LIB XMLCommentT<wchar_t>;
 typedef XMLCommentT<char> XMLCommentA;
 typedef XMLCommentT<wchar_t> XMLCommentW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLCommentT<char16_t>;
+typedef XMLCommentT<char16_t> XMLCommentU16;
+#endif
 #ifdef _UNICODE
 typedef XMLCommentW XMLComment;
 #else
@@ -1101,6 +1429,10 @@ template class TINYXML2_LIB XMLDeclarationT<char>;
 template class TINYXML2_LIB XMLDeclarationT<wchar_t>;
 typedef XMLDeclarationT<char> XMLDeclarationA;
 typedef XMLDeclarationT<wchar_t> XMLDeclarationW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLDeclarationT<char16_t>;
+typedef XMLDeclarationT<char16_t> XMLDeclarationU16;
+#endif
 #ifdef _UNICODE
 typedef XMLDeclarationW XMLDeclaration;
 #else
@@ -1148,6 +1480,10 @@ template class TINYXML2_LIB XMLUnknownT<char>;
 template class TINYXML2_LIB XMLUnknownT<wchar_t>;
 typedef XMLUnknownT<char> XMLUnknownA;
 typedef XMLUnknownT<wchar_t> XMLUnknownW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLUnknownT<char16_t>;
+typedef XMLUnknownT<char16_t> XMLUnknownU16;
+#endif
 #ifdef _UNICODE
 typedef XMLUnknownW XMLUnknown;
 #else
@@ -1167,12 +1503,16 @@ class TINYXML2_LIB XMLAttributeT
 {
 	template <typename xchar>
     friend class XMLElementT;
+	template <typename xchar>
+    friend class XMLDocumentT;
 public:
     /// The name of the attribute.
     const xchar* Name() const;
 
     /// The value of the attribute.
     const xchar* Value() const;
+    /// Value() as a wchar_t string, cached like XMLNode::ValueW().
+    const wchar_t* ValueW() const;
 
     /// The next attribute in the list.
     const XMLAttributeT<xchar>* Next() const {
@@ -1255,7 +1595,7 @@ public:
 private:
     enum { BUF_SIZE = 200 };
 
-    XMLAttributeT() : _next( 0 ), _memPool( 0 ) {}
+    XMLAttributeT() : _next( 0 ), _document( 0 ) {}
     virtual ~XMLAttributeT()	{}
 
     XMLAttributeT( const XMLAttributeT<xchar>& );	// not supported
@@ -1267,12 +1607,16 @@ private:
     mutable StrPairT<xchar> _name;
     mutable StrPairT<xchar> _value;
     XMLAttributeT<xchar>*   _next;
-    MemPool*        _memPool;
+    XMLDocumentT<xchar>*    _document;
 };
 template class TINYXML2_LIB XMLAttributeT<char>;
 template class TINYXML2_LIB XMLAttributeT<wchar_t>;
 typedef XMLAttributeT<char> XMLAttributeA;
 typedef XMLAttributeT<wchar_t> XMLAttributeW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLAttributeT<char16_t>;
+typedef XMLAttributeT<char16_t> XMLAttributeU16;
+#endif
 #ifdef _UNICODE
 typedef XMLAttributeW XMLAttribute;
 #else
@@ -1332,6 +1676,8 @@ public:
     	@endverbatim
     */
     const xchar* Attribute( const xchar* name, const xchar* value=0 ) const;
+    /// Attribute() as a wchar_t string, cached like XMLNode::ValueW().
+    const wchar_t* AttributeW( const xchar* name ) const;
 
     /** Given an attribute name, IntAttribute() returns the value
     	of the attribute interpreted as an integer. 0 will be
@@ -1614,6 +1960,8 @@ public:
     	GetText() will return "This is ".
     */
     const xchar* GetText() const;
+    /// GetText() as a wchar_t string, cached like XMLNode::ValueW().
+    const wchar_t* GetTextW() const;
 
     /** Convenience function for easy access to the text inside an element. Although easy
     	and concise, SetText() is limited compared to creating an XMLText child
@@ -1732,20 +2080,38 @@ private:
     // because the list needs to be scanned for dupes before adding
     // a new attribute.
     XMLAttributeT<xchar>* _rootAttribute;
+    // Where the element was parsed from, if the document preserves its
+    // source: '<' to the end of the closing tag. 0 length once modified.
+    unsigned _sourceStart;
+    mutable unsigned _sourceLength;
 };
 template class TINYXML2_LIB XMLElementT<char>;
 template class TINYXML2_LIB XMLElementT<wchar_t>;
 typedef XMLElementT<char> XMLElementA;
 typedef XMLElementT<wchar_t> XMLElementW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLElementT<char16_t>;
+typedef XMLElementT<char16_t> XMLElementU16;
+#endif
 #ifdef _UNICODE
 typedef XMLElementW XMLElement;
 #else
 typedef XMLElementA XMLElement;
 #endif
 
+/**
+	How a document treats white space when it parses text.
+	- PRESERVE_WHITESPACE keeps it, except for text that is only white space.
+	- COLLAPSE_WHITESPACE trims text and turns every run of white space into one space.
+	- PEDANTIC_WHITESPACE keeps all of it, white space only text between
+	  tags included, and normalizes attribute values as XML 1.0 section
+	  3.3.3 requires: a literal tab or newline becomes a space. Needed for
+	  XMLCanonicalPrinter.
+*/
 enum Whitespace {
     PRESERVE_WHITESPACE,
-    COLLAPSE_WHITESPACE
+    COLLAPSE_WHITESPACE,
+    PEDANTIC_WHITESPACE
 };
 
 
@@ -1758,12 +2124,27 @@ template<typename xchar>
 class TINYXML2_LIB XMLDocumentT : public XMLNodeT<xchar>
 {
 	template<typename xchar>
+    friend class XMLNodeT;
+	template<typename xchar>
     friend class XMLElementT;
+	template<typename xchar>
+    friend class XMLAttributeT;
 public:
     /// constructor
     XMLDocumentT( bool processEntities = true, Whitespace = PRESERVE_WHITESPACE );
     ~XMLDocumentT();
 
+#ifdef TINYXML2_RVALUE_REFERENCES
+    /**
+    	Move constructor. Takes over the tree, memory pools and
+    	buffer of 'other', which is left empty. Pointers to the
+    	nodes stay valid; they now belong to this document.
+    */
+    XMLDocumentT( XMLDocumentT<xchar>&& other );
+    /// Move assignment. The previous contents of this document are deleted.
+    XMLDocumentT<xchar>& operator=( XMLDocumentT<xchar>&& other );
+#endif
+
     virtual XMLDocumentT<xchar>* ToDocument()				{
         TIXMLASSERT( this == _document );
         return this;
@@ -1782,11 +2163,22 @@ public:
     	the number of bytes which will be parsed. If not
     	specified, TinyXML-2 will assume 'xml' points to a
     	null terminated string.
+
+    	Documents of UINT_MAX characters or more are rejected
+    	with XML_ERROR_PARSING; strings are stored as 32-bit
+    	offsets into the document.
+
+    	A narrow document whose declaration names ISO-8859-1
+    	or Windows-1252 is transcoded to UTF-8 before parsing,
+    	and its declaration then reads encoding="UTF-8".
     */
     XMLError Parse( const xchar* xml, size_t nBytes=(size_t)(-1) );
 
     /**
-    	Load an XML file from disk.
+    	Load an XML file from disk. The file is read in large
+    	blocks, without stdio buffering. Wide file names are
+    	passed to the wide API on Windows and converted to
+    	UTF-8 elsewhere.
     	Returns XML_NO_ERROR (0) on success, or
     	an errorID.
     */
@@ -1800,21 +2192,30 @@ public:
         not text in order for TinyXML-2 to correctly
         do newline normalization.
 
+    	A wide document (XMLDocumentW) detects the encoding of the file
+    	from its byte order mark, first bytes and encoding declaration,
+    	and transcodes UTF-8, UTF-16, UTF-32, ISO-8859-1 or Windows-1252
+    	to the native wchar_t encoding. A narrow document transcodes
+    	ISO-8859-1 and Windows-1252 to UTF-8, as Parse() does.
+
     	Returns XML_NO_ERROR (0) on success, or
     	an errorID.
     */
     XMLError LoadFile( FILE* );
 
     /**
-    	Save the XML file to disk.
+    	Save the XML file to disk. File names are handled as
+    	in LoadFile(); wide documents are written as UTF-8.
     	Returns XML_NO_ERROR (0) on success, or
-    	an errorID.
+    	an errorID: XML_ERROR_FILE_WRITE_ERROR if the file was
+    	opened but the document couldn't be written to it.
     */
     XMLError SaveFile( const xchar* filename, bool compact = false );
 
     /**
     	Save the XML file to disk. You are responsible
-    	for providing and closing the FILE*.
+    	for providing and closing the FILE*. Wide documents
+    	are written as UTF-8, through an XMLEncodingSink.
 
     	Returns XML_NO_ERROR (0) on success, or
     	an errorID.
@@ -1840,6 +2241,31 @@ public:
         _writeBOM = useBOM;
     }
 
+    /** Keep a copy of the text of the next documents parsed, so that
+    	PrintVerbatim() can write unmodified elements as they were read.
+    	Costs a second copy of the input. Set before Parse() or LoadFile().
+    */
+    void SetPreserveSource( bool preserve ) {
+        _preserveSource = preserve;
+    }
+    bool PreserveSource() const {
+        return _preserveSource;
+    }
+
+    /** Check that the UTF-8 input of the next documents parsed is well
+    	formed, and fail with XML_ERROR_INVALID_UTF8 otherwise; ErrorOffset()
+    	is then the byte offset of the first invalid sequence. Applies to
+    	Parse() of char documents, and to LoadFile() of files in UTF-8.
+    	Off by default; ASCII runs are checked 16 bytes at a time, so it
+    	costs little more than reading the input.
+    */
+    void SetValidateUTF8( bool validate ) {
+        _validateUTF8 = validate;
+    }
+    bool ValidateUTF8() const {
+        return _validateUTF8;
+    }
+
     /** Return the root element of DOM. Equivalent to FirstChildElement().
         To get the first node, use FirstChild().
     */
@@ -1865,6 +2291,46 @@ public:
     	@endverbatim
     */
     void Print( XMLPrinterT<xchar>* streamer=0 ) const;
+    /** Print the Document like Print(), serializing the children of the
+    	root element on up to 'threadCount' threads (0 selects the number
+    	of cores). Each thread prints a run of consecutive children into
+    	its own memory buffer, and the buffers are written to 'streamer'
+    	in order, so the output is identical to Print().
+
+    	The parts are produced by plain XMLPrinters set up like 'streamer'
+    	(compact mode, indentation), so printers of a derived class, such
+    	as XMLCanonicalPrinter, are handed to Print() instead. Documents
+    	whose root element has mixed content, and builds without thread
+    	support, are printed on the calling thread; so is the rest of the
+    	document if a thread can't be started.
+    */
+    void PrintParallel( XMLPrinterT<xchar>* streamer=0, int threadCount=0 ) const;
+    /** Print the Document like Print(), and keep a copy of the output of
+    	every element at 'depth' (1 is the root element, 2 its children,
+    	and so on; at least 2). Later calls reuse the copies of subtrees
+    	that haven't changed, so printing again after a small edit costs
+    	the edit plus copying the output.
+
+    	Changing a node's value, attributes or children, or inserting
+    	or deleting it, drops the copies of the node and its ancestors.
+    	All copies are dropped when 'depth' or the printer layout
+    	(compact mode, indentation, starting depth) changes. As with
+    	PrintParallel(), the output is produced by plain XMLPrinters
+    	set up like 'streamer'.
+    */
+    void PrintIncremental( XMLPrinterT<xchar>* streamer=0, int depth=2 ) const;
+    /** Print the Document, writing each element that hasn't been changed
+    	since it was parsed exactly as it appears in the input: original
+    	quoting, attribute layout, white space and entities. Edited
+    	elements are printed by 'streamer' as usual, with their unchanged
+    	children again copied verbatim. Requires SetPreserveSource( true )
+    	before parsing; otherwise this is the same as Print().
+    */
+    void PrintVerbatim( XMLPrinterT<xchar>* streamer=0 ) const;
+    /// Free the output kept by PrintIncremental().
+    void ClearPrintCache() {
+        ResetPrintCache();
+    }
     virtual bool Accept( XMLVisitorT<xchar>* visitor ) const;
 
     /**
@@ -1930,14 +2396,47 @@ public:
     const xchar* GetErrorStr2() const {
         return _errorStr2;
     }
+    /// Return the byte offset in the input of an XML_ERROR_INVALID_UTF8 error.
+    size_t ErrorOffset() const {
+        return _errorOffset;
+    }
     /// If there is an error, print it to stdout.
     void PrintError() const;
     
     /// Clear the document, resetting it to the initial state.
     void Clear();
 
+    /**
+    	Copy all the children of this document into 'target',
+    	which is cleared first. The settings and error state of
+    	'target' are unchanged. Uses the same bulk copy as
+    	XMLNode::DeepClone().
+    */
+    void DeepCopy( XMLDocumentT<xchar>* target ) const;
+
+    /**
+    	Exchange the contents of two documents: the tree, the nodes
+    	created but not yet inserted, the memory pools, the parse
+    	buffer, the settings and the error state. Nothing is copied;
+    	one pass over each tree points the nodes at their new document.
+    */
+    void Swap( XMLDocumentT<xchar>& other );
+
+    /**
+    	Relocate all nodes and attributes in the tree into fresh memory,
+    	in document order, and return memory blocks that are no longer
+    	used to the system. After many deletions the remaining nodes are
+    	scattered across partially empty blocks; Compact() restores
+    	traversal locality and releases the unused memory.
+
+    	All pointers to nodes and attributes of this document are
+    	invalidated. Nodes that are not linked into the tree stay
+    	where they are, and keep their blocks alive.
+    */
+    void Compact();
+
     // internal
-    xchar* Identify( xchar* p, XMLNodeT<xchar>** node );
+    xchar* Identify( xchar* p, XMLNodeT<xchar>** node, bool inElement );
 
     virtual XMLNodeT<xchar>* ShallowClone( XMLDocumentT<xchar>* /*document*/ ) const	{
         return 0;
@@ -1952,12 +2451,80 @@ private:
 
     bool        _writeBOM;
     bool        _processEntities;
+    bool        _validateUTF8;
     XMLError    _errorID;
     Whitespace  _whitespace;
     const xchar* _errorStr1;
     const xchar* _errorStr2;
+    size_t      _errorOffset;
     char*       _charBuffer;
 
+    xchar* CharBuffer() const {
+        return reinterpret_cast<xchar*>( _charBuffer );
+    }
+    // Nodes created by New...() that aren't in the tree yet.
+    DynArray< XMLNodeT<xchar>*, 10 > _unlinked;
+    void TrackUnlinked( XMLNodeT<xchar>* node );
+    void MarkInUse( XMLNodeT<xchar>* node );
+    // Point all nodes at this document, after Swap().
+    void AdoptNodes();
+    void AdoptSubtree( XMLNodeT<xchar>* root );
+
+    // Deep clones: size the pools and the string block, then copy.
+    typedef typename StrPairT<xchar>::CloneBlock CloneBlock;
+    void PrepareClone( const XMLNodeT<xchar>* root, CloneBlock* strings );
+    XMLNodeT<xchar>* CloneSubtree( const XMLNodeT<xchar>* root, CloneBlock* strings );
+    XMLNodeT<xchar>* CloneNode( const XMLNodeT<xchar>* node, CloneBlock* strings );
+
+    // Print the siblings [first, end) for PrintParallel().
+    static void PrintSiblings( XMLPrinterT<xchar>* printer, const XMLNodeT<xchar>* first, const XMLNodeT<xchar>* end );
+
+    // Output of clean subtrees kept by PrintIncremental(), for one layout.
+    struct PrintCacheEntry {
+        const XMLNodeT<xchar>* node;	// null once dropped
+        int offset;
+        int length;
+    };
+    enum { PRINT_CACHE_LAYOUT = 5 };
+    mutable DynArray< PrintCacheEntry, 10 > _printCache;
+    mutable DynArray< xchar, 10 > _printCacheText;
+    mutable int _printCacheLive;	// characters of _printCacheText still in use
+    mutable int _printCacheLayout[PRINT_CACHE_LAYOUT];
+    void ResetPrintCache() const;
+    void CompactPrintCache() const;
+    void PrintCached( XMLPrinterT<xchar>* streamer, XMLPrinterT<xchar>* scratch,
+                      const XMLNodeT<xchar>* node, int level, int depth ) const;
+
+    // Copy of the parsed text, laid out like the char buffer, for PrintVerbatim().
+    bool _preserveSource;
+    xchar* _source;
+    // Set while Parse() links the nodes it reads, which needn't be marked dirty.
+    bool _parsing;
+    void PrintVerbatim( XMLPrinterT<xchar>* streamer, const XMLNodeT<xchar>* node ) const;
+    // Forget the cached and source output of 'node', which has changed.
+    void DropCachedOutput( const XMLNodeT<xchar>* node ) const;
+
+    // Wide copies of strings for ValueW() and friends, found by the address
+    // of the string. Entries of an older generation are free slots: any
+    // change to the document starts a new one, since it may free or move
+    // strings. The first lookup of a new generation also reclaims the
+    // copies, so the blocks only hold what was read since the last change.
+    struct WideEntry {
+        const xchar* key;
+        const wchar_t* wide;
+        unsigned generation;
+    };
+    mutable DynArray< WideEntry, 1 > _wideIndex;
+    mutable int _wideCount;				// entries of the current generation
+    mutable unsigned _wideGeneration;
+    mutable unsigned _wideCountGeneration;
+    mutable DynArray< wchar_t*, 4 > _wideBlocks;
+    mutable wchar_t* _wideNext;			// free space in the last block
+    mutable wchar_t* _wideEnd;
+    const wchar_t* WideString( const xchar* str ) const;
+    wchar_t* AllocWide( size_t units ) const;
+    void ClearWideStrings();
+
     MemPoolT< sizeof(XMLElementT<xchar>) >	 _elementPool;
     MemPoolT< sizeof(XMLAttributeT<xchar>) > _attributePool;
     MemPoolT< sizeof(XMLTextT<xchar>) >		 _textPool;
@@ -1966,11 +2533,22 @@ private:
 	static const char* _errorNames[XML_ERROR_COUNT];
 
     void Parse();
+    // Set XML_ERROR_INVALID_UTF8 and return false if 'p' isn't valid UTF-8.
+    bool CheckUTF8( const char* p, size_t size );
+    // Read 'size' bytes of 'fp', or of the descriptor 'fd' if fp is null,
+    // into the char buffer, ready to parse.
+    XMLError LoadBuffer( FILE* fp, int fd, size_t size );
+    // Check the size, then load and parse the file.
+    XMLError LoadBytes( FILE* fp, int fd, long long size );
 };
 template class TINYXML2_LIB XMLDocumentT<char>;
 template class TINYXML2_LIB XMLDocumentT<wchar_t>;
 typedef XMLDocumentT<char> XMLDocumentA;
 typedef XMLDocumentT<wchar_t> XMLDocumentW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLDocumentT<char16_t>;
+typedef XMLDocumentT<char16_t> XMLDocumentU16;
+#endif
 #ifdef _UNICODE
 typedef XMLDocumentW XMLDocument;
 #else
@@ -2116,6 +2694,10 @@ template class TINYXML2_LIB XMLHandleT<char>;
 template class TINYXML2_LIB XMLHandleT<wchar_t>;
 typedef XMLHandleT<char> XMLHandleA;
 typedef XMLHandleT<wchar_t> XMLHandleW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLHandleT<char16_t>;
+typedef XMLHandleT<char16_t> XMLHandleU16;
+#endif
 #ifdef _UNICODE
 typedef XMLHandleW XMLHandle;
 #else
@@ -2196,6 +2778,10 @@ template class TINYXML2_LIB XMLConstHandleT<char>;
 template class TINYXML2_LIB XMLConstHandleT<wchar_t>;
 typedef XMLConstHandleT<char> XMLConstHandleA;
 typedef XMLConstHandleT<wchar_t> XMLConstHandleW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLConstHandleT<char16_t>;
+typedef XMLConstHandleT<char16_t> XMLConstHandleU16;
+#endif
 #ifdef _UNICODE
 typedef XMLConstHandleW XMLConstHandle;
 #else
@@ -2203,6 +2789,433 @@ typedef XMLConstHandleA XMLConstHandle;
 #endif
 
 
+/**
+	A read-only, compact form of a document. Where the XMLDocument
+	allocates a polymorphic object per node, linked together by
+	pointers, the compact document stores every node in a single
+	contiguous array, in document order, and links nodes by 32-bit
+	index. The kind of a node is a type tag rather than a virtual
+	function, and strings are offset/length spans into one character
+	buffer owned by the compact document.
+
+	This makes large documents much smaller in memory and traversal
+	cache friendly, at the cost of being immutable. A node is referred
+	to by its index; the document itself is always index 0, and a
+	missing node is NONE.
+
+	@verbatim
+	XMLCompactDocument compact;
+	compact.Parse( xml );
+	for( unsigned i = compact.FirstChildElement( compact.RootElement(), "item" );
+	     i != XMLCompactDocument::NONE;
+	     i = compact.NextSiblingElement( i, "item" ) ) {
+		const char* id = compact.Attribute( i, "id" );
+	}
+	@endverbatim
+
+	Parse() reads the XML straight into the arrays: no XMLDocument
+	is built, and the strings are spans of a copy of the input, so
+	the peak memory of a parse is the text plus the arrays. A compact
+	document can also be built from an existing XMLDocument with
+	Build(). It does not reference the XMLDocument afterwards.
+*/
+template<typename xchar>
+class TINYXML2_LIB XMLCompactDocumentT
+{
+public:
+    /// The kind of a node, as returned by Type().
+    enum NodeType {
+        DOCUMENT,
+        ELEMENT,
+        TEXT,
+        COMMENT,
+        DECLARATION,
+        UNKNOWN
+    };
+
+    /// The index used for a node that does not exist.
+    static const unsigned NONE = 0xffffffffU;
+
+    /// constructor
+    XMLCompactDocumentT( bool processEntities = true, Whitespace = PRESERVE_WHITESPACE );
+    ~XMLCompactDocumentT() {}
+
+    /**
+    	Parse an XML string into compact form. The parse rules (entity
+    	processing and whitespace) are the ones given to the constructor,
+    	and the result and errors are the same as those of XMLDocument.
+    	Returns XML_NO_ERROR (0) on success, or an errorID.
+    */
+    XMLError Parse( const xchar* xml, size_t nBytes=(size_t)(-1) );
+
+    /**
+    	Copy a parsed XMLDocument into compact form, replacing the
+    	current contents. Returns XML_NO_ERROR (0) on success, or
+    	the error of 'doc' if it failed to parse.
+    */
+    XMLError Build( const XMLDocumentT<xchar>& doc );
+
+    /// Clear the document, resetting it to the initial (empty) state.
+    void Clear();
+
+    /// The number of nodes, including the document node.
+    unsigned NodeCount() const {
+        return (unsigned)_nodes.Size();
+    }
+    /// The number of attributes of all elements.
+    unsigned AttributeCount() const {
+        return (unsigned)_attributes.Size();
+    }
+
+    /// The index of the first element child of the document, or NONE.
+    unsigned RootElement() const {
+        return _nodes.Empty() ? NONE : FirstChildElement( 0 );
+    }
+
+    /// The NodeType of a node.
+    NodeType Type( unsigned node ) const {
+        return (NodeType)GetNode( node )._type;
+    }
+    /// Returns true if the node is a CDATA text node.
+    bool CData( unsigned node ) const {
+        return GetNode( node )._cdata != 0;
+    }
+    /**
+    	The value of a node, with the same meaning as XMLNode::Value().
+    	For the document node null is returned.
+    */
+    const xchar* Value( unsigned node ) const;
+    /// The length, in characters, of Value().
+    unsigned ValueLength( unsigned node ) const {
+        return GetNode( node )._valueLength;
+    }
+    /// The name of an element. Same as Value().
+    const xchar* Name( unsigned node ) const {
+        return Value( node );
+    }
+
+    /// The parent of a node, or NONE for the document.
+    unsigned Parent( unsigned node ) const {
+        return GetNode( node )._parent;
+    }
+    /// Returns true if the node has no children.
+    bool NoChildren( unsigned node ) const {
+        return FirstChild( node ) == NONE;
+    }
+    /**
+    	The first child of a node, or NONE. Nodes are stored in document
+    	order, so the first child always immediately follows its parent.
+    */
+    unsigned FirstChild( unsigned node ) const {
+        const unsigned next = node + 1;
+        if ( next < NodeCount() && _nodes[(int)next]._parent == node ) {
+            return next;
+        }
+        return NONE;
+    }
+    /// The next sibling of a node, or NONE.
+    unsigned NextSibling( unsigned node ) const {
+        return GetNode( node )._nextSibling;
+    }
+    /// The first child element of a node, optionally with the given name, or NONE.
+    unsigned FirstChildElement( unsigned node, const xchar* name = 0 ) const;
+    /// The next sibling element of a node, optionally with the given name, or NONE.
+    unsigned NextSiblingElement( unsigned node, const xchar* name = 0 ) const;
+
+    /// The number of attributes of an element.
+    unsigned AttributeCount( unsigned node ) const {
+        return GetNode( node )._attributeCount;
+    }
+    /// The name of the i'th attribute of an element.
+    const xchar* AttributeName( unsigned node, unsigned i ) const {
+        return _strings.Mem() + GetAttribute( node, i )._name;
+    }
+    /// The value of the i'th attribute of an element.
+    const xchar* AttributeValue( unsigned node, unsigned i ) const {
+        return _strings.Mem() + GetAttribute( node, i )._value;
+    }
+    /**
+    	Given an attribute name, returns the value for the attribute
+    	of that name, or null if none exists. See XMLElement::Attribute()
+    */
+    const xchar* Attribute( unsigned node, const xchar* name, const xchar* value=0 ) const;
+    /// The text of the first child of an element, if it is a text node, else null.
+    const xchar* GetText( unsigned node ) const;
+
+private:
+    XMLCompactDocumentT( const XMLCompactDocumentT<xchar>& );	// not supported
+    void operator=( const XMLCompactDocumentT<xchar>& );	// not supported
+
+    // Both records are plain data, so they can live in a DynArray.
+    struct CompactNode {
+        unsigned	_parent;
+        unsigned	_nextSibling;
+        unsigned	_value;				// offset into _strings
+        unsigned	_valueLength;
+        unsigned	_firstAttribute;	// attributes of an element are contiguous
+        unsigned	_attributeCount : 24;
+        unsigned	_type : 7;
+        unsigned	_cdata : 1;
+    };
+    struct CompactAttribute {
+        unsigned	_name;				// offset into _strings
+        unsigned	_value;				// offset into _strings
+    };
+
+    const CompactNode& GetNode( unsigned node ) const {
+        TIXMLASSERT( node < NodeCount() );
+        return _nodes[(int)node];
+    }
+    const CompactAttribute& GetAttribute( unsigned node, unsigned i ) const {
+        TIXMLASSERT( i < AttributeCount( node ) );
+        return _attributes[(int)(GetNode( node )._firstAttribute + i)];
+    }
+    unsigned AddNode( const XMLNodeT<xchar>* node, unsigned parent );
+    unsigned AddString( const xchar* str, unsigned* length );
+    // Parse() works in place on _strings, which holds the input.
+    XMLError ParseBuffer();
+    unsigned AppendNode( NodeType type, unsigned parent, DynArray< unsigned, 32 >* lastChild );
+    unsigned FlushString( StrPairT<xchar>* str, unsigned* length );
+
+    bool		_processEntities;
+    Whitespace	_whitespace;
+
+    DynArray< CompactNode, 16 >			_nodes;
+    DynArray< CompactAttribute, 16 >	_attributes;
+    DynArray< xchar, 256 >		_strings;
+};
+template class TINYXML2_LIB XMLCompactDocumentT<char>;
+template class TINYXML2_LIB XMLCompactDocumentT<wchar_t>;
+typedef XMLCompactDocumentT<char> XMLCompactDocumentA;
+typedef XMLCompactDocumentT<wchar_t> XMLCompactDocumentW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLCompactDocumentT<char16_t>;
+typedef XMLCompactDocumentT<char16_t> XMLCompactDocumentU16;
+#endif
+#ifdef _UNICODE
+typedef XMLCompactDocumentW XMLCompactDocument;
+#else
+typedef XMLCompactDocumentA XMLCompactDocument;
+#endif
+
+
+
+/**
+	Where an XMLPrinter sends its output, if it doesn't print to
+	memory. A printer created with a sink collects output in a
+	staging buffer, of a size given to the printer, and passes it
+	to Write() in large pieces.
+
+	Derive from this class to stream to a socket, a ring buffer,
+	or anything else. TinyXML-2 provides sinks for a FILE*, a
+	file descriptor, and a fixed block of memory.
+*/
+template<typename xchar>
+class TINYXML2_LIB XMLOutputSinkT
+{
+public:
+    virtual ~XMLOutputSinkT()	{}
+
+    /// Accept 'size' characters of output.
+    virtual void Write( const xchar* data, size_t size ) = 0;
+    /// Called by XMLPrinter::Flush(), after the staged output is written.
+    virtual void Flush()		{}
+};
+template class TINYXML2_LIB XMLOutputSinkT<char>;
+template class TINYXML2_LIB XMLOutputSinkT<wchar_t>;
+typedef XMLOutputSinkT<char> XMLOutputSinkA;
+typedef XMLOutputSinkT<wchar_t> XMLOutputSinkW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLOutputSinkT<char16_t>;
+typedef XMLOutputSinkT<char16_t> XMLOutputSinkU16;
+#endif
+#ifdef _UNICODE
+typedef XMLOutputSinkW XMLOutputSink;
+#else
+typedef XMLOutputSinkA XMLOutputSink;
+#endif
+
+
+/// A sink that writes to a FILE*. Flush() calls fflush().
+template<typename xchar>
+class TINYXML2_LIB XMLFileSinkT : public XMLOutputSinkT<xchar>
+{
+public:
+    XMLFileSinkT( FILE* fp=0 ) : _fp( fp )	{}
+
+    virtual void Write( const xchar* data, size_t size );
+    virtual void Flush();
+
+    FILE* File() const	{
+        return _fp;
+    }
+
+private:
+    FILE* _fp;
+};
+template class TINYXML2_LIB XMLFileSinkT<char>;
+template class TINYXML2_LIB XMLFileSinkT<wchar_t>;
+typedef XMLFileSinkT<char> XMLFileSinkA;
+typedef XMLFileSinkT<wchar_t> XMLFileSinkW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLFileSinkT<char16_t>;
+typedef XMLFileSinkT<char16_t> XMLFileSinkU16;
+#endif
+#ifdef _UNICODE
+typedef XMLFileSinkW XMLFileSink;
+#else
+typedef XMLFileSinkA XMLFileSink;
+#endif
+
+
+/**
+	A sink that writes to a file descriptor, such as a socket or
+	pipe, with write() (_write() on Windows). Wide characters are
+	written as they are in memory. The descriptor is not closed.
+*/
+template<typename xchar>
+class TINYXML2_LIB XMLFdSinkT : public XMLOutputSinkT<xchar>
+{
+public:
+    XMLFdSinkT( int fd ) : _fd( fd ), _error( false )	{}
+
+    virtual void Write( const xchar* data, size_t size );
+
+    /// True if a write failed. Output after a failure is dropped.
+    bool Error() const	{
+        return _error;
+    }
+
+private:
+    int  _fd;
+    bool _error;
+};
+template class TINYXML2_LIB XMLFdSinkT<char>;
+template class TINYXML2_LIB XMLFdSinkT<wchar_t>;
+typedef XMLFdSinkT<char> XMLFdSinkA;
+typedef XMLFdSinkT<wchar_t> XMLFdSinkW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLFdSinkT<char16_t>;
+typedef XMLFdSinkT<char16_t> XMLFdSinkU16;
+#endif
+#ifdef _UNICODE
+typedef XMLFdSinkW XMLFdSink;
+#else
+typedef XMLFdSinkA XMLFdSink;
+#endif
+
+
+/**
+	A sink that writes to a block of memory you provide. Output
+	that doesn't fit is dropped, and Overflow() is set. The output
+	is not null terminated.
+*/
+template<typename xchar>
+class TINYXML2_LIB XMLMemorySinkT : public XMLOutputSinkT<xchar>
+{
+public:
+    XMLMemorySinkT( xchar* mem, size_t capacity ) : _mem( mem ), _capacity( capacity ), _size( 0 ), _overflow( false )	{}
+
+    virtual void Write( const xchar* data, size_t size );
+
+    /// The number of characters written.
+    size_t Size() const	{
+        return _size;
+    }
+    /// True if some output didn't fit.
+    bool Overflow() const	{
+        return _overflow;
+    }
+
+private:
+    xchar*  _mem;
+    size_t  _capacity;
+    size_t  _size;
+    bool    _overflow;
+};
+template class TINYXML2_LIB XMLMemorySinkT<char>;
+template class TINYXML2_LIB XMLMemorySinkT<wchar_t>;
+typedef XMLMemorySinkT<char> XMLMemorySinkA;
+typedef XMLMemorySinkT<wchar_t> XMLMemorySinkW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLMemorySinkT<char16_t>;
+typedef XMLMemorySinkT<char16_t> XMLMemorySinkU16;
+#endif
+#ifdef _UNICODE
+typedef XMLMemorySinkW XMLMemorySink;
+#else
+typedef XMLMemorySinkA XMLMemorySink;
+#endif
+
+
+/// Byte encodings of XML output.
+enum XMLEncoding {
+    XML_ENCODING_UTF8,
+    XML_ENCODING_UTF16LE,
+    XML_ENCODING_UTF16BE
+};
+
+/**
+	A sink that encodes the printer output as UTF-8, UTF-16LE or
+	UTF-16BE bytes, and passes them on to a char sink, such as an
+	XMLFileSinkA. The input is UTF-8 for char, UTF-16 for char16_t
+	and 16 bit wchar_t, and UTF-32 for 32 bit wchar_t. Each Write()
+	is converted in blocks and passed on straight away; a character
+	split between two writes is completed by the next one. Invalid
+	input is written as U+FFFD.
+
+	@verbatim
+	XMLFileSinkA file( fp );
+	XMLEncodingSinkW encoder( file, XML_ENCODING_UTF16LE, true );
+	XMLPrinterW printer( encoder );
+	doc.Print( &printer );
+	printer.Flush();
+	@endverbatim
+*/
+template<typename xchar>
+class TINYXML2_LIB XMLEncodingSinkT : public XMLOutputSinkT<xchar>
+{
+public:
+    /** Write to 'target' in 'encoding'. With 'writeBOM', the output
+    	starts with a byte order mark, unless the printer writes one.
+    */
+    XMLEncodingSinkT( XMLOutputSinkT<char>& target, XMLEncoding encoding=XML_ENCODING_UTF8, bool writeBOM=false ) :
+        _target( &target ), _encoding( encoding ), _writeBOM( writeBOM ), _started( false ), _partial( 0 ), _remaining( 0 )	{}
+
+    virtual void Write( const xchar* data, size_t size );
+    /// Writes U+FFFD for an incomplete character, and flushes the target.
+    virtual void Flush();
+
+    XMLEncoding Encoding() const	{
+        return _encoding;
+    }
+
+private:
+    enum { BLOCK = 1024 };
+    unsigned char* Encode( unsigned long ch, unsigned char* out );
+
+    XMLOutputSinkT<char>* _target;
+    XMLEncoding _encoding;
+    bool _writeBOM;
+    bool _started;
+    // A character split between writes: the bits so far, and the units to come.
+    unsigned long _partial;
+    int _remaining;
+};
+template class TINYXML2_LIB XMLEncodingSinkT<char>;
+template class TINYXML2_LIB XMLEncodingSinkT<wchar_t>;
+typedef XMLEncodingSinkT<char> XMLEncodingSinkA;
+typedef XMLEncodingSinkT<wchar_t> XMLEncodingSinkW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLEncodingSinkT<char16_t>;
+typedef XMLEncodingSinkT<char16_t> XMLEncodingSinkU16;
+#endif
+#ifdef _UNICODE
+typedef XMLEncodingSinkW XMLEncodingSink;
+#else
+typedef XMLEncodingSinkA XMLEncodingSink;
+#endif
+
 
 /**
 	Printing functionality. The XMLPrinter gives you more
@@ -2211,6 +3224,7 @@ typedef XMLConstHandleA XMLConstHandle;
 	It can:
 	-# Print to memory.
 	-# Print to a file you provide.
+	-# Print to an XMLOutputSink, such as a socket.
 	-# Print XML without a XMLDocument.
 
 	Print to Memory
@@ -2229,6 +3243,18 @@ typedef XMLConstHandleA XMLConstHandle;
 	doc.Print( &printer );
 	@endverbatim
 
+	Print to a Sink
+
+	The output is collected in a staging buffer of the size
+	you choose, and written to the sink in pieces of about that
+	size. Call Flush() to write out what is left.
+	@verbatim
+	XMLFdSink sink( socket );
+	XMLPrinter printer( sink, false, 0, 16*1024 );
+	doc.Print( &printer );
+	printer.Flush();
+	@endverbatim
+
 	Print without a XMLDocument
 
 	When loading, an XML parser is very useful. However, sometimes
@@ -2249,6 +3275,7 @@ typedef XMLConstHandleA XMLConstHandle;
 template <typename xchar>
 class TINYXML2_LIB XMLPrinterT : public XMLVisitorT<xchar>
 {
+    friend class XMLDocumentT<xchar>;
 public:
     /** Construct the printer. If the FILE* is specified,
     	this will print to the FILE. Else it will print
@@ -2257,7 +3284,22 @@ public:
     	with only required whitespace and newlines.
     */
     XMLPrinterT( FILE* file=0, bool compact = false, int depth = 0 );
-    virtual ~XMLPrinterT()	{}
+    /** Construct a printer that writes to 'sink', through a
+    	staging buffer of 'bufferSize' characters. The sink must
+    	outlive the printer.
+    */
+    XMLPrinterT( XMLOutputSinkT<xchar>& sink, bool compact = false, int depth = 0, int bufferSize = 4096 );
+    /// Staged output, if any, is written to the sink.
+    virtual ~XMLPrinterT();
+
+#ifdef TINYXML2_RVALUE_REFERENCES
+    /// Move constructor. 'other' is left as a new printer to memory.
+    XMLPrinterT( XMLPrinterT<xchar>&& other );
+    /// Move assignment.
+    XMLPrinterT<xchar>& operator=( XMLPrinterT<xchar>&& other );
+#endif
+    /// Exchange the state and buffers of two printers.
+    void Swap( XMLPrinterT<xchar>& other );
 
     /** If streaming, write the BOM and declaration. */
     void PushHeader( bool writeBOM, bool writeDeclaration );
@@ -2329,15 +3371,35 @@ public:
         _buffer.Clear();
         _buffer.Push(0);
     }
+    /**
+    	If printing to a sink, write the staged output to it and
+    	call its Flush().
+    */
+    void Flush();
+
+    /**
+    	Set the indentation of pretty printed output: 'width'
+    	copies of 'ch' per level. The default is 4 spaces; use
+    	( 1, '\t' ) for tabs. Has no effect in compact mode.
+    */
+    void SetIndent( int width, xchar ch = ' ' );
 
 protected:
 	virtual bool CompactMode( const XMLElementT<xchar>& )	{ return _compactMode; }
 
 	/** Prints out the space before an element. You may override to change
-	    the space and tabs used. A PrintSpace() override should call Print().
+	    the space and tabs used. A PrintSpace() override should call Print()
+	    or Write().
 	*/
     virtual void PrintSpace( int depth );
+    /// Formatted output, for subclasses. The printer itself uses Write() and Putc().
     void Print( const xchar* format, ... );
+    /// Write 'size' characters from 'data', without formatting.
+    void Write( const xchar* data, size_t size );
+    /// Write a null terminated string, without formatting.
+    void Write( const xchar* data );
+    /// Write a single character.
+    void Putc( xchar ch );
 
     void SealElementIfJustOpened();
     bool _elementJustOpened;
@@ -2345,9 +3407,27 @@ protected:
 
 private:
     void PrintString( const xchar*, bool restrictedEntitySet );	// prints out, after detecting entities.
+    void WriteEntity( int index );
+    // The first character in [p, end) that needs escaping, or 'end'.
+    static const xchar* FindEscape( const xchar* p, const xchar* end, const unsigned char* escape );
+
+    XMLPrinterT( const XMLPrinterT<xchar>& );	// not supported
+    void operator=( const XMLPrinterT<xchar>& );	// not supported
+
+    void InitEscapes();
+    void FlushBuffer();
+    // Take over the layout of 'other', to print part of its output.
+    void CopyLayout( const XMLPrinterT<xchar>& other );
+    // Write the source text of 'element', laid out like a printed element.
+    void PushElementSource( const XMLElementT<xchar>& element, const xchar* source, size_t size );
 
     bool _firstElement;
-    FILE* _fp;
+    XMLFileSinkT<xchar> _fileSink;
+    XMLOutputSinkT<xchar>* _sink;	// null when printing to memory
+    int _bufferSize;				// staging size when printing to a sink
+    int _indentWidth;
+    xchar _indentChar;
+    DynArray< xchar, 64 > _indent;	// cached indentation, grown to the deepest level printed
     int _depth;
     int _textDepth;
     bool _processEntities;
@@ -2357,8 +3437,9 @@ private:
         ENTITY_RANGE = 64,
         BUF_SIZE = 200
     };
-    bool _entityFlag[ENTITY_RANGE];
-    bool _restrictedEntityFlag[ENTITY_RANGE];
+    // For each character, 1 + the index of the entity that escapes it, or 0.
+    unsigned char _escape[ENTITY_RANGE];
+    unsigned char _restrictedEscape[ENTITY_RANGE];
 
     DynArray< xchar, 20 > _buffer;
 };
@@ -2366,12 +3447,87 @@ template class TINYXML2_LIB XMLPrinterT<char>;
 template class TINYXML2_LIB XMLPrinterT<wchar_t>;
 typedef XMLPrinterT<char> XMLPrinterA;
 typedef XMLPrinterT<wchar_t> XMLPrinterW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLPrinterT<char16_t>;
+typedef XMLPrinterT<char16_t> XMLPrinterU16;
+#endif
 #ifdef _UNICODE
 typedef XMLPrinterW XMLPrinter;
 #else
 typedef XMLPrinterA XMLPrinter;
 #endif
 
+/**
+	Prints Canonical XML (http://www.w3.org/TR/xml-c14n), for computing
+	signatures and content hashes without post-processing:
+	- no XML declaration, DTD, or white space outside the root element
+	- attributes sorted, namespace declarations first, and redundant
+	  namespace declarations dropped
+	- empty elements written as start and end tag pairs
+	- CDATA sections written as escaped text
+	- canonical escaping of text and attribute values
+	- comments only if requested
+
+	Output is written directly as the document is visited, to memory,
+	a FILE or a sink, like XMLPrinter. Text and attribute values are
+	written as the document holds them, so the document must use
+	PEDANTIC_WHITESPACE (and the default entity processing): the other
+	modes drop white space between tags, and don't normalize white
+	space in attribute values.
+
+	@verbatim
+	XMLCanonicalPrinter printer;
+	doc.Accept( &printer );
+	Hash( printer.CStr(), printer.CStrSize() - 1 );
+	@endverbatim
+*/
+template <typename xchar>
+class TINYXML2_LIB XMLCanonicalPrinterT : public XMLPrinterT<xchar>
+{
+public:
+    /// Print to 'file', or to memory if null.
+    XMLCanonicalPrinterT( FILE* file=0, bool withComments=false );
+    /// Print to 'sink', through a staging buffer of 'bufferSize' characters.
+    XMLCanonicalPrinterT( XMLOutputSinkT<xchar>& sink, bool withComments=false, int bufferSize=4096 );
+    virtual ~XMLCanonicalPrinterT()	{}
+
+    virtual bool VisitEnter( const XMLDocumentT<xchar>& doc );
+    virtual bool VisitExit( const XMLDocumentT<xchar>& doc );
+
+    virtual bool VisitEnter( const XMLElementT<xchar>& element, const XMLAttributeT<xchar>* attribute );
+    virtual bool VisitExit( const XMLElementT<xchar>& element );
+
+    virtual bool Visit( const XMLTextT<xchar>& text );
+    virtual bool Visit( const XMLCommentT<xchar>& comment );
+    virtual bool Visit( const XMLDeclarationT<xchar>& declaration );
+    virtual bool Visit( const XMLUnknownT<xchar>& unknown );
+
+private:
+    // Comments and processing instructions outside the root element
+    // are separated from it by a line feed.
+    void BeginOutsideNode();
+    void EndOutsideNode( const XMLNodeT<xchar>& node );
+    void WriteEscaped( const xchar* p, bool attribute );
+    void WriteAscii( const char* p );
+
+    bool _withComments;
+    bool _afterRoot;
+    DynArray< const XMLAttributeT<xchar>*, 16 > _attributes;
+};
+template class TINYXML2_LIB XMLCanonicalPrinterT<char>;
+template class TINYXML2_LIB XMLCanonicalPrinterT<wchar_t>;
+typedef XMLCanonicalPrinterT<char> XMLCanonicalPrinterA;
+typedef XMLCanonicalPrinterT<wchar_t> XMLCanonicalPrinterW;
+#ifdef TINYXML2_CHAR16
+template class TINYXML2_LIB XMLCanonicalPrinterT<char16_t>;
+typedef XMLCanonicalPrinterT<char16_t> XMLCanonicalPrinterU16;
+#endif
+#ifdef _UNICODE
+typedef XMLCanonicalPrinterW XMLCanonicalPrinter;
+#else
+typedef XMLCanonicalPrinterA XMLCanonicalPrinter;
+#endif
+
 
 
 }	// tinyxml2
@@ -5,6 +5,7 @@
 #endif
 
 #include "tinyxml2.h"
+#include <cfloat>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
@@ -1453,6 +1454,16 @@ int main( int argc, const char ** argv )
 		doc.SaveFile( "./resources/out/compact.xml", true );
 		XMLTest( "Issue 302. Subsequent success in saving", "XML_SUCCESS", doc.ErrorName() );
 	}
+#if defined(__linux__)
+	{
+		// Writes that fail after the file is open are reported.
+		XMLDocument doc;
+		doc.Parse( "<r>text</r>" );
+		doc.SaveFile( "/dev/full" );
+		XMLTest( "Save to a full device", XML_ERROR_FILE_WRITE_ERROR, doc.ErrorID() );
+		XMLTest( "Save to a full device name", "XML_ERROR_FILE_WRITE_ERROR", doc.ErrorName() );
+	}
+#endif
 
 	{
 		// If a document fails to load then subsequent
@@ -1506,6 +1517,1079 @@ int main( int argc, const char ** argv )
 		}
 	}
 
+	{
+		// Compact, index based document.
+		const char* xml = "<?xml version=\"1.0\"?>"
+			"<root a='1' b='two'>"
+			"<item id='x'>text</item>"
+			"<!-- comment -->"
+			"<item id='y'><![CDATA[cdata]]></item>"
+			"<other/>"
+			"</root>";
+		XMLCompactDocument compact;
+		XMLTest( "Compact parse", XML_SUCCESS, compact.Parse( xml ) );
+		XMLTest( "Compact node count", 9, (int)compact.NodeCount() );
+		XMLTest( "Compact attribute count", 4, (int)compact.AttributeCount() );
+
+		unsigned root = compact.RootElement();
+		XMLTest( "Compact root", "root", compact.Name( root ) );
+		XMLTest( "Compact root parent", 0, (int)compact.Parent( root ) );
+		XMLTest( "Compact declaration", (int)XMLCompactDocument::DECLARATION, (int)compact.Type( compact.FirstChild( 0 ) ) );
+		XMLTest( "Compact attribute", "two", compact.Attribute( root, "b" ) );
+		XMLTest( "Compact missing attribute", (const char*)0, compact.Attribute( root, "c" ) );
+
+		unsigned item = compact.FirstChildElement( root, "item" );
+		XMLTest( "Compact first item", "x", compact.Attribute( item, "id" ) );
+		XMLTest( "Compact text", "text", compact.GetText( item ) );
+		item = compact.NextSiblingElement( item, "item" );
+		XMLTest( "Compact second item", "y", compact.Attribute( item, "id" ) );
+		XMLTest( "Compact cdata", true, compact.CData( compact.FirstChild( item ) ) );
+		XMLTest( "Compact no more items", XMLCompactDocument::NONE, compact.NextSiblingElement( item, "item" ) );
+		XMLTest( "Compact leaf", true, compact.NoChildren( compact.NextSiblingElement( item ) ) );
+
+		XMLDocument doc;
+		doc.Parse( xml );
+		XMLCompactDocument built;
+		built.Build( doc );
+		doc.Clear();
+		XMLTest( "Compact build outlives document", "cdata", built.GetText( built.NextSiblingElement( built.FirstChildElement( built.RootElement() ) ) ) );
+
+		XMLTest( "Compact parse error", XML_ERROR_MISMATCHED_ELEMENT, compact.Parse( "<a></b>" ) );
+		XMLTest( "Compact cleared on error", 0, (int)compact.NodeCount() );
+	}
+
+	{
+		// Compact() after heavy mutation.
+		XMLDocument doc;
+		XMLElement* root = doc.NewElement( "root" );
+		doc.InsertEndChild( root );
+		for( int i=0; i<1000; ++i ) {
+			XMLElement* ele = doc.NewElement( "item" );
+			ele->SetAttribute( "id", i );
+			ele->SetText( "text" );
+			root->InsertFirstChild( ele );
+		}
+		for( XMLElement* ele = root->FirstChildElement(); ele; ) {
+			XMLElement* next = ele->NextSiblingElement();
+			if ( ele->IntAttribute( "id" ) % 10 ) {
+				root->DeleteChild( ele );
+			}
+			ele = next;
+		}
+		XMLElement* orphan = doc.NewElement( "orphan" );
+
+		XMLPrinter before;
+		doc.Print( &before );
+		doc.Compact();
+		XMLPrinter after;
+		doc.Print( &after );
+		XMLTest( "Compact() keeps the document", before.CStr(), after.CStr(), false );
+
+		// Addresses in different blocks can't be compared, so only the
+		// links are checked here.
+		bool linked = true;
+		root = doc.RootElement();
+		for( const XMLElement* ele = root->FirstChildElement(); ele; ele = ele->NextSiblingElement() ) {
+			linked = linked && ele->Parent() == root && ele->FirstChild()->Parent() == ele;
+			linked = linked && ( !ele->NextSiblingElement() || ele->NextSiblingElement()->PreviousSiblingElement() == ele );
+		}
+		XMLTest( "Compact() keeps the links", true, linked );
+		XMLTest( "Compact() keeps attributes", 990, root->FirstChildElement()->IntAttribute( "id" ) );
+
+		root->InsertEndChild( orphan );
+		root->InsertEndChild( doc.NewElement( "new" ) );
+		XMLTest( "Insert after Compact()", "new", root->LastChildElement()->Name() );
+		XMLTest( "Unlinked node survives Compact()", "orphan", root->LastChildElement()->PreviousSiblingElement()->Name() );
+	}
+
+	{
+		// Packed string storage: spans, inline and heap strings.
+		XMLTest( "StrPair is 12 bytes", 12, (int)sizeof( StrPairA ) );
+
+		static const char* xml = "<a short='x' empty='' long='a value too long to be inline'>  collapse   me  </a>";
+		XMLDocument doc( true, COLLAPSE_WHITESPACE );
+		doc.Parse( xml );
+		XMLElement* ele = doc.RootElement();
+		XMLTest( "Span attribute", "x", ele->Attribute( "short" ) );
+		XMLTest( "Empty span attribute", "", ele->Attribute( "empty" ) );
+		XMLTest( "Collapsed span text", "collapse me", ele->GetText() );
+
+		ele->SetAttribute( "short", "y" );
+		ele->SetAttribute( "long", "another value too long to be inline" );
+		ele->SetAttribute( "empty", "" );
+		XMLTest( "Inline attribute", "y", ele->Attribute( "short" ) );
+		XMLTest( "Heap attribute", "another value too long to be inline", ele->Attribute( "long" ) );
+		XMLTest( "Empty inline attribute", "", ele->Attribute( "empty" ) );
+		ele->SetName( "b" );
+		XMLTest( "Inline name", "b", ele->Name() );
+		ele->SetName( "bb", true );
+		XMLTest( "Interned name", "bb", ele->Name() );
+
+		XMLPrinter printer;
+		doc.Print( &printer );
+		XMLTest( "Packed strings print", "<bb short=\"y\" empty=\"\" long=\"another value too long to be inline\">collapse me</bb>\n", printer.CStr(), false );
+	}
+
+	{
+		// Swap() and move for documents and printers.
+		XMLDocument doc;
+		doc.Parse( "<root a='1'><child>text</child><!--c--></root>" );
+		XMLElement* orphan = doc.NewElement( "orphan" );
+		orphan->InsertEndChild( doc.NewText( "inside" ) );
+		XMLElement* root = doc.RootElement();
+
+		XMLDocument other;
+		other.Parse( "<other/>" );
+		doc.Swap( other );
+		XMLTest( "Swap() moves the tree", "other", doc.RootElement()->Name() );
+		XMLTest( "Swap() keeps node pointers", true, root == other.RootElement() );
+		XMLTest( "Swapped node document", true, root->GetDocument() == &other );
+		XMLTest( "Swapped attribute", 1, root->IntAttribute( "a" ) );
+
+		root->InsertEndChild( orphan );
+		XMLTest( "Unlinked node follows Swap()", "inside", root->LastChildElement( "orphan" )->GetText() );
+		root->DeleteChild( root->FirstChildElement( "child" ) );
+		root->InsertFirstChild( other.NewElement( "first" ) );
+		XMLPrinter printer;
+		other.Print( &printer );
+		XMLTest( "Edit after Swap()", "<root a=\"1\">\n    <first/>\n    <!--c-->\n    <orphan>inside</orphan>\n</root>\n", printer.CStr(), false );
+
+#ifdef TINYXML2_RVALUE_REFERENCES
+		XMLDocument moved( static_cast<XMLDocument&&>( other ) );
+		XMLTest( "Move constructor", "root", moved.RootElement()->Name() );
+		XMLTest( "Moved-from document is empty", true, other.NoChildren() );
+		XMLTest( "Moved node document", true, root->GetDocument() == &moved );
+		doc = static_cast<XMLDocument&&>( moved );
+		XMLTest( "Move assignment", "first", doc.RootElement()->FirstChildElement()->Name() );
+		XMLTest( "Moved-from document is empty after assignment", true, moved.NoChildren() );
+
+		XMLPrinter movedPrinter( static_cast<XMLPrinter&&>( printer ) );
+		XMLTest( "Printer move", 0, (int)strncmp( movedPrinter.CStr(), "<root", 5 ) );
+		XMLTest( "Moved-from printer is empty", "", printer.CStr() );
+#endif
+		XMLPrinter a, b;
+		a.PushComment( "a" );
+		a.Swap( b );
+		XMLTest( "Printer Swap()", "<!--a-->", b.CStr() );
+		XMLTest( "Printer Swap() other", "", a.CStr() );
+	}
+
+	{
+		// DeepClone() and DeepCopy()
+		static const char* xml =
+			"<?xml version=\"1.0\"?>"
+			"<!DOCTYPE root>"
+			"<root a='1' b='two'>"
+			"<!--comment-->"
+			"<child><![CDATA[<data>]]></child>"
+			"<child c='&lt;3'>text &amp; more<leaf/></child>"
+			"</root>";
+		XMLDocument* source = new XMLDocument;
+		source->Parse( xml );
+		XMLPrinter original;
+		source->Print( &original );
+
+		XMLDocument copy;
+		source->DeepCopy( &copy );
+		XMLPrinter copied;
+		copy.Print( &copied );
+		XMLTest( "DeepCopy", original.CStr(), copied.CStr(), false );
+
+		XMLDocument target;
+		XMLNode* clone = source->RootElement()->LastChildElement()->DeepClone( &target );
+		XMLTest( "DeepClone is unlinked", true, clone->Parent() == 0 );
+		XMLTest( "DeepClone of a document", true, source->DeepClone( &target ) == 0 );
+		delete source;
+
+		target.InsertEndChild( clone );
+		XMLPrinter cloned;
+		target.Print( &cloned );
+		XMLTest( "DeepClone outlives source", "<child c=\"&lt;3\">text &amp; more    <leaf/></child>\n", cloned.CStr(), false );
+
+		XMLNode* again = target.RootElement()->DeepClone( 0 );
+		target.Clear();
+		target.InsertEndChild( again );
+		XMLTest( "Unlinked DeepClone survives Clear()", "<3", target.RootElement()->Attribute( "c" ) );
+		XMLTest( "DeepClone leaf", "leaf", target.RootElement()->FirstChildElement()->Name() );
+
+		XMLTest( "DeepCopy keeps CDATA", true, copy.RootElement()->FirstChildElement( "child" )->FirstChild()->ToText()->CData() );
+		copy.RootElement()->SetAttribute( "b", "changed" );
+		XMLTest( "Edit DeepCopy", "changed", copy.RootElement()->Attribute( "b" ) );
+	}
+
+	{
+		// Unformatted printer output: memory and FILE* agree.
+		XMLDocument doc;
+		doc.LoadFile( "resources/dream.xml" );
+		XMLPrinter memory;
+		doc.Print( &memory );
+
+		FILE* fp = fopen( "resources/out/printer_write.xml", "w" );
+		XMLPrinter file( fp );
+		doc.Print( &file );
+		fclose( fp );
+
+		XMLDocument reread;
+		reread.LoadFile( "resources/out/printer_write.xml" );
+		XMLPrinter rereadMemory;
+		reread.Print( &rereadMemory );
+		XMLTest( "Printer file and memory output", memory.CStr(), rereadMemory.CStr(), false );
+
+		XMLPrinter header;
+		header.PushHeader( true, true );
+		XMLTest( "Printer header", "\xef\xbb\xbf<?xml version=\"1.0\"?>", header.CStr() );
+	}
+
+	{
+		// Escaping: runs longer than a vector, quotes only escaped in attributes.
+		XMLPrinter printer;
+		printer.OpenElement( "e" );
+		printer.PushAttribute( "a", "0123456789abcdef\"quoted\" & 'apos' <0123456789abcdef>" );
+		printer.PushText( "0123456789abcdef\"quoted\" & 'apos' <0123456789abcdef>0123456789abcdef&" );
+		printer.CloseElement();
+		XMLTest( "Escaped output",
+				 "<e a=\"0123456789abcdef&quot;quoted&quot; &amp; &apos;apos&apos; &lt;0123456789abcdef&gt;\">"
+				 "0123456789abcdef\"quoted\" &amp; 'apos' &lt;0123456789abcdef&gt;0123456789abcdef&amp;</e>\n",
+				 printer.CStr(), false );
+	}
+
+	{
+		// Output sinks.
+		XMLDocument doc;
+		doc.LoadFile( "resources/dream.xml" );
+		XMLPrinter memory;
+		doc.Print( &memory );
+		const int length = memory.CStrSize() - 1;
+
+		char* mem = new char[length];
+		XMLMemorySink memorySink( mem, length );
+		{
+			XMLPrinter printer( memorySink, false, 0, 1024 );
+			doc.Print( &printer );
+		}
+		XMLTest( "Memory sink size", length, (int)memorySink.Size() );
+		XMLTest( "Memory sink output", true, memcmp( mem, memory.CStr(), length ) == 0 );
+		XMLTest( "Memory sink no overflow", false, memorySink.Overflow() );
+		delete [] mem;
+
+		char small[10];
+		XMLMemorySink smallSink( small, 10 );
+		XMLPrinter smallPrinter( smallSink );
+		doc.Print( &smallPrinter );
+		smallPrinter.Flush();
+		XMLTest( "Memory sink overflow", true, smallSink.Overflow() );
+		XMLTest( "Memory sink keeps what fits", 10, (int)smallSink.Size() );
+
+		struct CountingSink : public XMLOutputSink {
+			CountingSink() : writes( 0 ), largest( 0 ), flushed( false ) {}
+			virtual void Write( const char*, size_t size ) {
+				++writes;
+				if ( size > largest ) {
+					largest = size;
+				}
+			}
+			virtual void Flush() {
+				flushed = true;
+			}
+			int writes;
+			size_t largest;
+			bool flushed;
+		};
+		CountingSink counting;
+		XMLPrinter countingPrinter( counting, false, 0, 4096 );
+		doc.Print( &countingPrinter );
+		countingPrinter.Flush();
+		XMLTest( "Sink gets staged pieces", true, counting.writes > 1 && counting.writes < length / 1024 );
+		XMLTest( "Sink pieces are bounded", true, counting.largest < 8192 );
+		XMLTest( "Sink flushed", true, counting.flushed );
+
+		FILE* fp = fopen( "resources/out/printer_sink.xml", "w" );
+		XMLFileSink fileSink( fp );
+		{
+			XMLPrinter filePrinter( fileSink );
+			doc.Print( &filePrinter );
+		}
+		fclose( fp );
+		XMLDocument reread;
+		reread.LoadFile( "resources/out/printer_sink.xml" );
+		XMLPrinter rereadMemory;
+		reread.Print( &rereadMemory );
+		XMLTest( "File sink output", memory.CStr(), rereadMemory.CStr(), false );
+	}
+
+	{
+		// Indentation
+		XMLDocument doc;
+		doc.Parse( "<a><b><c/></b></a>" );
+		XMLPrinter twoSpaces;
+		twoSpaces.SetIndent( 2 );
+		doc.Print( &twoSpaces );
+		XMLTest( "Indent 2 spaces", "<a>\n  <b>\n    <c/>\n  </b>\n</a>\n", twoSpaces.CStr(), false );
+
+		XMLPrinter tabs;
+		tabs.SetIndent( 1, '\t' );
+		doc.Print( &tabs );
+		XMLTest( "Indent tabs", "<a>\n\t<b>\n\t\t<c/>\n\t</b>\n</a>\n", tabs.CStr(), false );
+
+		XMLPrinter none;
+		none.SetIndent( 0 );
+		doc.Print( &none );
+		XMLTest( "Indent none", "<a>\n<b>\n<c/>\n</b>\n</a>\n", none.CStr(), false );
+	}
+
+	{
+		// Shortest round-trip number formatting
+		char buf[200];
+		XMLUtil::ToStr( 0.1, buf, 200 );
+		XMLTest( "ToStr double shortest", "0.1", buf, false );
+		XMLUtil::ToStr( 1.0e-5, buf, 200 );
+		XMLTest( "ToStr double exponent", "1e-05", buf, false );
+		XMLUtil::ToStr( 5e-324, buf, 200 );
+		XMLTest( "ToStr double denormal", "5e-324", buf, false );
+		XMLUtil::ToStr( 0.1f, buf, 200 );
+		XMLTest( "ToStr float shortest", "0.1", buf, false );
+		XMLUtil::ToStr( -2147483647 - 1, buf, 200 );
+		XMLTest( "ToStr INT_MIN", "-2147483648", buf, false );
+		XMLUtil::ToStr( 4294967295U, buf, 200 );
+		XMLTest( "ToStr UINT_MAX", "4294967295", buf, false );
+
+		bool roundTrip = true;
+		double v = 1.0 / 3.0;
+		for( int i=0; i<2000; ++i ) {
+			v = v * -1.37 + 1.0 / ( i + 1 );
+			if ( v > 1e20 || v < -1e20 ) {
+				v *= 1e-37;
+			}
+			double read = 0;
+			XMLUtil::ToStr( v, buf, 200 );
+			if ( !XMLUtil::ToDouble( buf, &read ) || read != v ) {
+				roundTrip = false;
+			}
+		}
+		XMLTest( "ToStr double round trip", true, roundTrip );
+	}
+
+	{
+		// Numeric parsing without sscanf
+		int intValue = 0;
+		XMLTest( "ToInt INT_MIN", true, XMLUtil::ToInt( "-2147483648", &intValue ) );
+		XMLTest( "ToInt INT_MIN value", -2147483647 - 1, intValue );
+		XMLTest( "ToInt overflow", false, XMLUtil::ToInt( "2147483648", &intValue ) );
+		XMLTest( "ToInt leading space", true, XMLUtil::ToInt( " +42", &intValue ) );
+		XMLTest( "ToInt leading space value", 42, intValue );
+		unsigned unsignedValue = 0;
+		XMLTest( "ToUnsigned negative", false, XMLUtil::ToUnsigned( "-1", &unsignedValue ) );
+		unsigned long long u64 = 0;
+		XMLTest( "ToUnsigned64 max", true, XMLUtil::ToUnsigned64( "18446744073709551615", &u64 ) );
+		XMLTest( "ToUnsigned64 overflow", false, XMLUtil::ToUnsigned64( "18446744073709551616", &u64 ) );
+
+		double doubleValue = 0;
+		XMLTest( "ToDouble fast path", true, XMLUtil::ToDouble( "3.25e2", &doubleValue ) );
+		XMLTest( "ToDouble fast path value", 325.0, doubleValue );
+		XMLUtil::ToDouble( "2.2250738585072011e-308", &doubleValue );
+		XMLTest( "ToDouble slow path", true, doubleValue == 2.2250738585072011e-308 );
+		XMLUtil::ToDouble( "0.1000000000000000055511151231257827021181583404541015625", &doubleValue );
+		XMLTest( "ToDouble many digits", true, doubleValue == 0.1 );
+		XMLTest( "ToDouble no digits", false, XMLUtil::ToDouble( ".e5", &doubleValue ) );
+		float floatValue = 0;
+		XMLUtil::ToFloat( "16777217", &floatValue );
+		XMLTest( "ToFloat rounding", true, floatValue == 16777216.0f );
+
+		// Every decimal input is rounded without the C library.
+		XMLUtil::ToDouble( "0.30000000000000004", &doubleValue );
+		XMLTest( "ToDouble 17 digits", true, doubleValue == 0.30000000000000004 );
+		XMLUtil::ToDouble( "1.7976931348623157e308", &doubleValue );
+		XMLTest( "ToDouble largest", true, doubleValue == DBL_MAX );
+		XMLUtil::ToDouble( "1.7976931348623159e308", &doubleValue );
+		XMLTest( "ToDouble overflow", true, doubleValue > DBL_MAX );
+		XMLUtil::ToDouble( "4.9406564584124654e-324", &doubleValue );
+		XMLTest( "ToDouble smallest subnormal", true, doubleValue > 0 && doubleValue / 2 == 0 );
+		XMLUtil::ToDouble( "2.4703282292062327e-324", &doubleValue );
+		XMLTest( "ToDouble below half the smallest", true, doubleValue == 0 );
+		XMLUtil::ToDouble( "9007199254740993", &doubleValue );
+		XMLTest( "ToDouble tie to even", true, doubleValue == 9007199254740992.0 );
+		static char tieAndMore[900] = "9007199254740993.";
+		memset( tieAndMore + 17, '0', 850 );
+		tieAndMore[867] = '1';
+		XMLUtil::ToDouble( tieAndMore, &doubleValue );
+		XMLTest( "ToDouble past the kept digits", true, doubleValue == 9007199254740994.0 );
+		XMLUtil::ToFloat( "3.4028235677973366e38", &floatValue );
+		XMLTest( "ToFloat largest", true, floatValue == FLT_MAX );
+		XMLUtil::ToFloat( "1.00000005960464477539", &floatValue );
+		XMLTest( "ToFloat tie to even", true, floatValue == 1.0f );
+		XMLUtil::ToFloat( "1.00000005960464477540", &floatValue );
+		XMLTest( "ToFloat above the tie", true, floatValue == 1.00000011920928955078125f );
+		XMLTest( "ToDouble hexadecimal", true, XMLUtil::ToDouble( "0x1.8p1", &doubleValue ) && doubleValue == 3.0 );
+		XMLTest( "ToDouble infinity", true, XMLUtil::ToDouble( "-Infinity", &doubleValue ) && doubleValue < -DBL_MAX );
+		XMLTest( "ToDouble NaN", true, XMLUtil::ToDouble( "nan", &doubleValue ) && doubleValue != doubleValue );
+	}
+
+	{
+		// Parallel printing
+		XMLDocument doc( true, PEDANTIC_WHITESPACE );
+		doc.Parse( "<?xml version=\"1.0\"?><!--top--><root a=\"1\"></root>" );
+		XMLElement* root = doc.RootElement();
+		for( int i=0; i<100; ++i ) {
+			XMLElement* item = doc.NewElement( "item" );
+			item->SetAttribute( "id", i );
+			item->InsertEndChild( doc.NewElement( "child" ) )->InsertEndChild( doc.NewText( "a < b" ) );
+			root->InsertEndChild( item );
+			if ( i % 10 == 0 ) {
+				root->InsertEndChild( doc.NewComment( "mark" ) );
+			}
+		}
+		XMLPrinter serial;
+		doc.Print( &serial );
+		XMLPrinter parallel;
+		doc.PrintParallel( &parallel, 4 );
+		XMLTest( "PrintParallel", serial.CStr(), parallel.CStr(), false );
+
+		XMLPrinter serialCompact( 0, true );
+		serialCompact.SetIndent( 1, '\t' );
+		doc.Print( &serialCompact );
+		XMLPrinter parallelCompact( 0, true );
+		parallelCompact.SetIndent( 1, '\t' );
+		doc.PrintParallel( &parallelCompact, 3 );
+		XMLTest( "PrintParallel compact", serialCompact.CStr(), parallelCompact.CStr(), false );
+
+		root->InsertFirstChild( doc.NewText( "mixed" ) );
+		XMLPrinter serialMixed;
+		doc.Print( &serialMixed );
+		XMLPrinter parallelMixed;
+		doc.PrintParallel( &parallelMixed, 4 );
+		XMLTest( "PrintParallel mixed content", serialMixed.CStr(), parallelMixed.CStr(), false );
+
+		root->DeleteChild( root->FirstChild() );
+		XMLCanonicalPrinter serialCanonical;
+		doc.Print( &serialCanonical );
+		XMLCanonicalPrinter parallelCanonical;
+		doc.PrintParallel( &parallelCanonical, 4 );
+		XMLTest( "PrintParallel derived printer", serialCanonical.CStr(), parallelCanonical.CStr(), false );
+	}
+
+	{
+		// Incremental printing
+		XMLDocument doc;
+		doc.Parse( "<root><a x=\"1\"><b>text</b></a><a x=\"2\"><b>more</b><c/></a><!--note--><a x=\"3\"/></root>" );
+		XMLElement* root = doc.RootElement();
+		XMLElement* second = root->FirstChildElement()->NextSiblingElement();
+
+		XMLPrinter first;
+		doc.PrintIncremental( &first );
+		XMLPrinter expected;
+		doc.Print( &expected );
+		XMLTest( "PrintIncremental initial", expected.CStr(), first.CStr(), false );
+
+		XMLPrinter cached;
+		doc.PrintIncremental( &cached );
+		XMLTest( "PrintIncremental cached", expected.CStr(), cached.CStr(), false );
+
+		second->FirstChildElement( "b" )->SetText( "changed" );
+		second->SetAttribute( "y", 5 );
+		root->LastChildElement()->InsertEndChild( doc.NewElement( "d" ) );
+		root->DeleteChild( root->FirstChildElement() );
+		XMLPrinter afterEdit;
+		doc.PrintIncremental( &afterEdit );
+		XMLPrinter expectedEdit;
+		doc.Print( &expectedEdit );
+		XMLTest( "PrintIncremental after edit", expectedEdit.CStr(), afterEdit.CStr(), false );
+
+		second->FirstChildElement( "c" )->SetName( "renamed" );
+		root->InsertFirstChild( second->FirstChildElement( "b" ) );
+		XMLPrinter compact( 0, true );
+		doc.PrintIncremental( &compact );
+		XMLPrinter expectedCompact( 0, true );
+		doc.Print( &expectedCompact );
+		XMLTest( "PrintIncremental moved and compact", expectedCompact.CStr(), compact.CStr(), false );
+
+		for( int i=0; i<200; ++i ) {
+			second->SetAttribute( "y", i );
+			XMLPrinter again( 0, true );
+			doc.PrintIncremental( &again );
+		}
+		XMLPrinter deep;
+		doc.PrintIncremental( &deep, 3 );
+		XMLPrinter expectedDeep;
+		doc.Print( &expectedDeep );
+		XMLTest( "PrintIncremental depth 3", expectedDeep.CStr(), deep.CStr(), false );
+
+		// Compact() moves every node; the cache must follow them.
+		XMLPrinter beforeCompact;
+		doc.PrintIncremental( &beforeCompact );
+		doc.Compact();
+		for( int i=0; i<200; ++i ) {
+			doc.RootElement()->FirstChildElement( "a" )->SetAttribute( "z", i );
+			XMLPrinter again;
+			doc.PrintIncremental( &again );
+		}
+		XMLPrinter afterCompact;
+		doc.PrintIncremental( &afterCompact );
+		XMLPrinter expectedAfterCompact;
+		doc.Print( &expectedAfterCompact );
+		XMLTest( "PrintIncremental after Compact()", expectedAfterCompact.CStr(), afterCompact.CStr(), false );
+	}
+
+	{
+		// Deleting a subtree above the cache depth drops its entries
+		XMLDocument doc;
+		doc.Parse( "<root><g><a>1</a><a>2</a></g><g><a>3</a></g></root>" );
+		XMLPrinter first;
+		doc.PrintIncremental( &first, 3 );
+		doc.RootElement()->DeleteChild( doc.RootElement()->FirstChildElement() );
+		doc.RootElement()->InsertEndChild( doc.NewElement( "g" ) )->InsertEndChild( doc.NewElement( "a" ) );
+		// Entries left behind by the deleted nodes would point into the
+		// blocks Compact() frees, and be written when the cache is squeezed.
+		doc.Compact();
+		for( int i=0; i<200; ++i ) {
+			doc.RootElement()->FirstChildElement()->FirstChildElement()->SetAttribute( "long-enough-to-fill-the-cache", i );
+			XMLPrinter again;
+			doc.PrintIncremental( &again, 3 );
+		}
+		XMLPrinter printed;
+		doc.PrintIncremental( &printed, 3 );
+		XMLPrinter expected;
+		doc.Print( &expected );
+		XMLTest( "PrintIncremental after deleting a cached subtree", expected.CStr(), printed.CStr(), false );
+	}
+
+	{
+		// Verbatim output of unmodified elements
+		static const char* xml = "<root>\n  <a   x='1'  >t &amp; u</a>\n<b/></root>";
+		XMLDocument doc;
+		doc.SetPreserveSource( true );
+		doc.Parse( xml );
+		XMLPrinter unchanged;
+		doc.PrintVerbatim( &unchanged );
+		XMLTest( "PrintVerbatim unchanged", "<root>\n  <a   x='1'  >t &amp; u</a>\n<b/></root>\n", unchanged.CStr(), false );
+
+		doc.RootElement()->FirstChildElement( "b" )->SetAttribute( "y", 2 );
+		XMLPrinter edited;
+		doc.PrintVerbatim( &edited );
+		XMLTest( "PrintVerbatim edited", "<root>\n    <a   x='1'  >t &amp; u</a>\n    <b y=\"2\"/>\n</root>\n", edited.CStr(), false );
+
+		XMLDocument plain;
+		plain.Parse( xml );
+		XMLPrinter printed;
+		plain.Print( &printed );
+		XMLPrinter notPreserved;
+		plain.PrintVerbatim( &notPreserved );
+		XMLTest( "PrintVerbatim without source", printed.CStr(), notPreserved.CStr(), false );
+	}
+
+	{
+		// Canonical XML
+		static const char* xml =
+			"<?xml version=\"1.0\"?>\n"
+			"<!DOCTYPE doc>\n"
+			"<!-- Comment 1 -->\n"
+			"<doc xmlns=\"http://example\" xmlns:a=\"http://a\" a:attr=\"1\" b=\"2\" attr=\"3\">"
+			"<e1   /><e2 xmlns=\"\"/><e3 xmlns=\"http://example\" name = \"elem3\" id=\"elem3\" >x&#xD;&lt;y&gt;\"</e3>"
+			"<e4 xmlns=\"\" v=\"&#x9;tab &amp; &quot;\"/><![CDATA[<data>]]></doc>\n"
+			"<!-- Comment 2 -->\n";
+		XMLDocument doc( true, PEDANTIC_WHITESPACE );
+		doc.Parse( xml );
+		XMLTest( "Canonical parse", false, doc.Error() );
+
+		XMLCanonicalPrinter withComments( 0, true );
+		doc.Accept( &withComments );
+		XMLTest( "Canonical XML with comments",
+				 "<!-- Comment 1 -->\n"
+				 "<doc xmlns=\"http://example\" xmlns:a=\"http://a\" attr=\"3\" b=\"2\" a:attr=\"1\">"
+				 "<e1></e1><e2 xmlns=\"\"></e2><e3 id=\"elem3\" name=\"elem3\">x&#xD;&lt;y&gt;\"</e3>"
+				 "<e4 xmlns=\"\" v=\"&#x9;tab &amp; &quot;\"></e4>&lt;data&gt;</doc>\n"
+				 "<!-- Comment 2 -->",
+				 withComments.CStr(), false );
+
+		XMLCanonicalPrinter withoutComments;
+		doc.Accept( &withoutComments );
+		XMLTest( "Canonical XML without comments", true, strstr( withoutComments.CStr(), "Comment" ) == 0 );
+		XMLTest( "Canonical XML ends with root", true, strcmp( withoutComments.CStr() + withoutComments.CStrSize() - 7, "</doc>" ) == 0 );
+
+		XMLDocument pi( true, PEDANTIC_WHITESPACE );
+		pi.Parse( "<?xml-stylesheet   href=\"doc.xsl\"?><r/>" );
+		XMLCanonicalPrinter piPrinter;
+		pi.Accept( &piPrinter );
+		XMLTest( "Canonical processing instruction", "<?xml-stylesheet href=\"doc.xsl\"?>\n<r></r>", piPrinter.CStr(), false );
+
+		// Indentation is content, and literal white space in attribute
+		// values is normalized to spaces; referenced white space is kept.
+		XMLDocument indented( true, PEDANTIC_WHITESPACE );
+		indented.Parse( "<?xml version=\"1.0\"?>\n<a>\n  <b x=\"1\n\t2\r\n3\" y=\"&#xA;&#9;\"/>\n  <c>t</c>\n</a>\n" );
+		XMLCanonicalPrinter indentedPrinter;
+		indented.Accept( &indentedPrinter );
+		XMLTest( "Canonical indented input",
+				 "<a>\n  <b x=\"1  2 3\" y=\"&#xA;&#x9;\"></b>\n  <c>t</c>\n</a>",
+				 indentedPrinter.CStr(), false );
+
+		XMLDocument preserved;
+		preserved.Parse( "<a>\n  <b x=\"1\n2\"/>\n</a>" );
+		XMLTest( "Preserved white space only text is dropped", true, preserved.RootElement()->FirstChild()->ToElement() != 0 );
+		XMLTest( "Preserved attribute newline", "1\n2", preserved.RootElement()->FirstChildElement()->Attribute( "x" ) );
+	}
+
+	{
+		// Wide documents decode UTF-8, UTF-16 and declared ISO-8859-1 files
+		static const char* utf8 = "\xEF\xBB\xBF<r a='\xC3\xA9'>text for the vector path \xE2\x82\xAC\xF0\x9D\x84\x9E\xFF</r>";
+		static const char* latin1 = "<?xml version='1.0' encoding='ISO-8859-1'?><r a='\xE9'>text for the vector path \xE9</r>";
+		static const wchar_t* utf16 = L"<r a='\u00e9'>text for the vector path \u20ac</r>";
+		static const wchar_t* texts[4] = {
+			L"text for the vector path \u20ac\U0001D11E\uFFFD",
+			L"text for the vector path \u00e9",
+			L"text for the vector path \u20ac",
+			L"text for the vector path \u20ac"
+		};
+		static const char* names[4] = { "Wide load UTF-8", "Wide load ISO-8859-1", "Wide load UTF-16LE", "Wide load UTF-16BE" };
+
+		for( int i=0; i<4; ++i ) {
+			FILE* fp = fopen( "resources/out/wide.xml", "wb" );
+			if ( i < 2 ) {
+				fputs( i == 0 ? utf8 : latin1, fp );
+			}
+			else {
+				if ( i == 2 ) {
+					fputc( 0xFF, fp );
+					fputc( 0xFE, fp );
+				}
+				for( const wchar_t* p = utf16; *p; ++p ) {
+					const int hi = ( *p >> 8 ) & 0xFF;
+					const int lo = *p & 0xFF;
+					fputc( i == 2 ? lo : hi, fp );
+					fputc( i == 2 ? hi : lo, fp );
+				}
+			}
+			fclose( fp );
+
+			XMLDocumentW doc;
+			fp = fopen( "resources/out/wide.xml", "rb" );
+			doc.LoadFile( fp );
+			fclose( fp );
+			const XMLElementW* root = doc.RootElement();
+			const wchar_t* text = root ? root->GetText() : 0;
+			bool same = text && root->Attribute( L"a" ) && root->Attribute( L"a" )[0] == 0xE9;
+			for( int j=0; same && ( texts[i][j] || text[j] ); ++j ) {
+				same = texts[i][j] == text[j];
+			}
+			XMLTest( names[i], true, same );
+			XMLTest( "Wide load BOM", i == 0 || i == 2, doc.HasBOM() );
+		}
+	}
+
+	{
+		// A UTF-16 file that declares its encoding saves as UTF-8 declaring UTF-8
+		static const wchar_t* sources[2] = {
+			L"\uFEFF<?xml version='1.0' encoding='UTF-16'?><r a='\u00e9'/>",
+			L"\uFEFF<?xml version='1.0' encoding='UCS2'?><r a='\u00e9'/>"
+		};
+		static const wchar_t* declarations[2] = {
+			L"xml version='1.0' encoding='UTF-8'",
+			L"xml version='1.0'"
+		};
+		for( int i=0; i<2; ++i ) {
+			FILE* fp = fopen( "resources/out/utf16decl.xml", "wb" );
+			for( const wchar_t* p = sources[i]; *p; ++p ) {
+				fputc( *p & 0xFF, fp );
+				fputc( ( *p >> 8 ) & 0xFF, fp );
+			}
+			fclose( fp );
+
+			XMLDocumentW wide;
+			wide.LoadFile( L"resources/out/utf16decl.xml" );
+			XMLTest( "UTF-16 declaration load", false, wide.Error() );
+			XMLTest( "UTF-16 declaration renamed", true,
+					 wide.FirstChild() && wide.FirstChild()->ToDeclaration()
+					 && XMLUtilW::StringEqual( wide.FirstChild()->Value(), declarations[i] ) );
+			wide.SaveFile( L"resources/out/utf16decl.xml" );
+
+			XMLDocument narrow;
+			narrow.LoadFile( "resources/out/utf16decl.xml" );
+			XMLTest( "UTF-16 declaration round trip", false, narrow.Error() );
+			XMLTest( "UTF-16 declaration round trip declaration", i == 0 ? "xml version='1.0' encoding='UTF-8'" : "xml version='1.0'",
+					 narrow.FirstChild()->Value() );
+			XMLTest( "UTF-16 declaration round trip attribute", "\xC3\xA9", narrow.RootElement()->Attribute( "a" ) );
+		}
+	}
+
+#ifdef TINYXML2_CHAR16
+	{
+		// UTF-16 documents through char16_t
+		XMLDocumentU16 doc;
+		doc.Parse( u"<r n='-12' d='0.5'>\u4E2D &#x1D11E;&#20013;&amp;</r>" );
+		XMLTest( "char16_t parse", false, doc.Error() );
+		const XMLElementU16* root = doc.RootElement();
+		XMLTest( "char16_t int attribute", -12, root->IntAttribute( u"n" ) );
+		XMLTest( "char16_t double attribute", 0.5, root->DoubleAttribute( u"d" ) );
+
+		static const char16_t expected[] = u"\u4E2D \U0001D11E\u4E2D&";
+		const char16_t* text = root->GetText();
+		bool same = true;
+		for( int i=0; same && ( expected[i] || text[i] ); ++i ) {
+			same = expected[i] == text[i];
+		}
+		XMLTest( "char16_t character references", true, same );
+
+		doc.RootElement()->SetAttribute( u"u", 7u );
+		doc.SaveFile( u"resources/out/char16.xml" );
+		XMLDocumentU16 reread;
+		reread.LoadFile( u"resources/out/char16.xml" );
+		XMLTest( "char16_t save and load", false, reread.Error() );
+		XMLTest( "char16_t saved attribute", 7u, reread.RootElement()->UnsignedAttribute( u"u" ) );
+		text = reread.RootElement()->GetText();
+		same = true;
+		for( int i=0; same && ( expected[i] || text[i] ); ++i ) {
+			same = expected[i] == text[i];
+		}
+		XMLTest( "char16_t saved text", true, same );
+	}
+#endif
+
+	{
+		// UTF-8 validation
+		static const char* bad = "<root>caf\xC3\xA9 and a long enough ASCII run \xED\xA0\x80</root>";
+		XMLDocument doc;
+		doc.Parse( bad );
+		XMLTest( "Unvalidated UTF-8 parses", false, doc.Error() );
+
+		doc.SetValidateUTF8( true );
+		doc.Parse( bad );
+		XMLTest( "Invalid UTF-8", XML_ERROR_INVALID_UTF8, doc.ErrorID() );
+		XMLTest( "Invalid UTF-8 name", "XML_ERROR_INVALID_UTF8", doc.ErrorName() );
+		XMLTest( "Invalid UTF-8 offset", (int)( strstr( bad, "\xED" ) - bad ), (int)doc.ErrorOffset() );
+
+		doc.Parse( "<root>caf\xC3\xA9 \xF0\x9D\x84\x9E</root>" );
+		XMLTest( "Valid UTF-8", false, doc.Error() );
+		XMLTest( "Valid UTF-8 offset", 0, (int)doc.ErrorOffset() );
+
+		FILE* fp = fopen( "resources/out/invalid_utf8.xml", "wb" );
+		fputs( bad, fp );
+		fclose( fp );
+		XMLDocumentW wide;
+		wide.SetValidateUTF8( true );
+		fp = fopen( "resources/out/invalid_utf8.xml", "rb" );
+		wide.LoadFile( fp );
+		fclose( fp );
+		XMLTest( "Invalid UTF-8 wide load", XML_ERROR_INVALID_UTF8, wide.ErrorID() );
+		XMLTest( "Invalid UTF-8 wide load offset", (int)( strstr( bad, "\xED" ) - bad ), (int)wide.ErrorOffset() );
+
+		// Non-ASCII names in the error strings print as '?'.
+		wide.Parse( L"<\u00e9l></x>" );
+		XMLTest( "Wide mismatched element", XML_ERROR_MISMATCHED_ELEMENT, wide.ErrorID() );
+		wide.PrintError();
+	}
+
+	{
+		// Character references in the document encoding
+		XMLDocument doc;
+		doc.Parse( "<t>&#20013;&#x1d11E;&#65;&#xD800;&#x110000;&#;</t>" );
+		XMLTest( "Character references UTF-8", "\xE4\xB8\xAD\xF0\x9D\x84\x9E" "A&#xD800;&#x110000;&#;", doc.FirstChildElement()->GetText() );
+
+		XMLDocumentW wide;
+		wide.Parse( L"<t>&#20013;&#x1d11E;&#65;&#xD800;</t>" );
+		static const wchar_t expected[] = L"\u4E2D\U0001D11EA&#xD800;";
+		const wchar_t* text = wide.FirstChildElement()->GetText();
+		bool same = true;
+		for( int i=0; same && ( expected[i] || text[i] ); ++i ) {
+			same = expected[i] == text[i];
+		}
+		XMLTest( "Character references wchar_t", true, same );
+	}
+
+	{
+		// Encoding output of wide documents
+		XMLDocumentW doc;
+		doc.Parse( L"<r a='\u00e9'>text long enough for the vector path \u4E2D\U0001D11E</r>" );
+		FILE* fp = fopen( "resources/out/wide_save.xml", "wb" );
+		doc.SaveFile( fp );
+		fclose( fp );
+		fp = fopen( "resources/out/wide_save.xml", "rb" );
+		char saved[128] = { 0 };
+		fread( saved, 1, sizeof( saved ) - 1, fp );
+		fclose( fp );
+		XMLTest( "Wide SaveFile as UTF-8",
+				 "<r a=\"\xC3\xA9\">text long enough for the vector path \xE4\xB8\xAD\xF0\x9D\x84\x9E</r>\n", saved, false );
+
+		char bytes[64];
+		XMLMemorySinkA memory( bytes, sizeof( bytes ) );
+		XMLEncodingSinkW encoder( memory, XML_ENCODING_UTF16BE, true );
+		static const wchar_t text[] = L"a\u00e9\U0001D11E";
+		encoder.Write( text, sizeof( text ) / sizeof( wchar_t ) - 1 );
+		encoder.Flush();
+		static const unsigned char utf16be[] = { 0xFE, 0xFF, 0, 'a', 0, 0xE9, 0xD8, 0x34, 0xDD, 0x1E };
+		XMLTest( "Encoding sink UTF-16BE", true, memory.Size() == sizeof( utf16be ) && memcmp( bytes, utf16be, sizeof( utf16be ) ) == 0 );
+
+		// A character split between writes.
+		XMLMemorySinkA memory8( bytes, sizeof( bytes ) );
+		XMLEncodingSinkA utf8to16( memory8, XML_ENCODING_UTF16LE );
+		utf8to16.Write( "\xF0\x9D", 2 );
+		utf8to16.Write( "\x84\x9E\xC3", 3 );
+		utf8to16.Flush();
+		static const unsigned char utf16le[] = { 0x34, 0xD8, 0x1E, 0xDD, 0xFD, 0xFF };
+		XMLTest( "Encoding sink split character", true, memory8.Size() == sizeof( utf16le ) && memcmp( bytes, utf16le, sizeof( utf16le ) ) == 0 );
+	}
+
+	{
+		// Wide access to a narrow document
+		XMLDocument doc;
+		doc.Parse( "<caf\xC3\xA9 a='\xE4\xB8\xAD'>x\xF0\x9D\x84\x9E</caf\xC3\xA9>" );
+		XMLElement* root = doc.RootElement();
+		static const wchar_t name[] = L"caf\u00e9";
+		static const wchar_t text[] = L"x\U0001D11E";
+		const wchar_t* wideName = root->ValueW();
+		XMLTest( "ValueW", true, memcmp( wideName, name, sizeof( name ) ) == 0 );
+		XMLTest( "ValueW cached", true, wideName == root->ValueW() );
+		XMLTest( "GetTextW", true, memcmp( root->GetTextW(), text, sizeof( text ) ) == 0 );
+		XMLTest( "AttributeW", true, root->AttributeW( "a" )[0] == 0x4E2D && root->AttributeW( "a" )[1] == 0 );
+		XMLTest( "AttributeW missing", true, root->AttributeW( "b" ) == 0 );
+
+		root->SetAttribute( "a", "new" );
+		XMLTest( "AttributeW after change", true, memcmp( root->FirstAttribute()->ValueW(), L"new", 4 * sizeof( wchar_t ) ) == 0 );
+		XMLTest( "ValueW after change", true, memcmp( root->ValueW(), name, sizeof( name ) ) == 0 );
+
+		// Each change reclaims the copies made before it.
+		root->SetAttribute( "b", 1 );
+		const wchar_t* first = root->ValueW();
+		root->SetAttribute( "b", 2 );
+		XMLTest( "ValueW reuses storage after a change", true, root->ValueW() == first && memcmp( first, name, sizeof( name ) ) == 0 );
+		static char longText[5001];
+		memset( longText, 'y', 5000 );
+		bool same = true;
+		for( int i=0; i<100; ++i ) {
+			root->SetAttribute( "b", i );
+			const wchar_t* wideText = root->GetTextW();
+			same = same && root->ValueW()[0] == 'c' && wideText[0] == ( i ? 'y' : 'x' );
+			root->SetText( longText );
+			same = same && root->GetTextW()[4999] == 'y' && root->GetTextW()[5000] == 0;
+		}
+		XMLTest( "Wide copies across changes", true, same );
+
+		XMLDocumentW wide;
+		wide.Parse( L"<r/>" );
+		XMLTest( "ValueW of wide document", true, wide.RootElement()->ValueW() == wide.RootElement()->Value() );
+	}
+
+	{
+		// XML 1.0 name characters
+		XMLDocument doc;
+		doc.Parse( "<\xC3\xA9l\xC3\xA9ment a\xC2\xB7" "b='1' \xE4\xB8\xAD-\xCC\x80='2'/>" );
+		XMLTest( "Unicode names", false, doc.Error() );
+		XMLTest( "Unicode name character in attribute", "1", doc.RootElement()->Attribute( "a\xC2\xB7" "b" ) );
+		XMLTest( "Combining mark in attribute name", "2", doc.RootElement()->Attribute( "\xE4\xB8\xAD-\xCC\x80" ) );
+
+		doc.Parse( "<\xC3\x97/>" );		// U+00D7 multiplication sign
+		XMLTest( "Symbol can't start a name", true, doc.Error() );
+		doc.Parse( "<\xC2\xB7x/>" );		// U+00B7 middle dot
+		XMLTest( "Name character can't start a name", true, doc.Error() );
+		doc.Parse( "<a\xE2\x80\xA8/>" );	// U+2028 line separator
+		XMLTest( "Separator can't continue a name", true, doc.Error() );
+		doc.Parse( "<\xC1\x81/>" );		// overlong 'A'
+		XMLTest( "Overlong UTF-8 in a name", true, doc.Error() );
+		doc.Parse( "<r \xEF\xBF\xBE='1'/>" );	// U+FFFE
+		XMLTest( "Noncharacter attribute name", true, doc.Error() );
+
+		XMLDocumentW wide;
+		wide.Parse( L"<\u4E2D\u6587 \u03AC='1'/>" );
+		XMLTest( "Unicode names in a wide document", false, wide.Error() );
+		wide.Parse( L"<a\u037E/>" );	// Greek question mark
+		XMLTest( "Wide name stops at punctuation", true, wide.Error() );
+#ifdef TINYXML2_CHAR16
+		XMLDocumentU16 utf16;
+		utf16.Parse( u"<\U00010000 \U000EFFFF='1'/>" );
+		XMLTest( "Surrogate pairs in names", false, utf16.Error() );
+		utf16.Parse( u"<\U000F0000/>" );
+		XMLTest( "Private use plane can't start a name", true, utf16.Error() );
+#endif
+	}
+
+	{
+		// Wide file names
+		XMLDocumentW doc;
+		doc.Parse( L"<r a='\u00e9'>\u4E2D</r>" );
+		doc.SaveFile( L"resources/out/wide-\u00e9t\u00e9.xml" );
+		XMLTest( "SaveFile with a wide name", false, doc.Error() );
+
+		XMLDocumentW wide;
+		wide.LoadFile( L"resources/out/wide-\u00e9t\u00e9.xml" );
+		XMLTest( "LoadFile with a wide name", false, wide.Error() );
+		XMLTest( "Wide name round trip", true, wide.RootElement()->GetText()[0] == 0x4E2D && wide.RootElement()->Attribute( L"a" )[0] == 0xE9 );
+#if !defined(_WIN32)
+		// Elsewhere the name is UTF-8 bytes, so a narrow document sees the same file.
+		XMLDocument narrow;
+		narrow.LoadFile( "resources/out/wide-\xC3\xA9t\xC3\xA9.xml" );
+		XMLTest( "Wide name stored as UTF-8", "\xE4\xB8\xAD", narrow.RootElement()->GetText() );
+#endif
+		wide.LoadFile( L"resources/out/no-such-file.xml" );
+		XMLTest( "LoadFile with a missing wide name", XML_ERROR_FILE_NOT_FOUND, wide.ErrorID() );
+	}
+
+	{
+		// Declared single byte encodings are transcoded to UTF-8
+		XMLDocument doc;
+		doc.SetValidateUTF8( true );
+		doc.Parse( "<?xml version='1.0' encoding='ISO-8859-1'?><r a='\xE9'>a text long enough for the vector path: caf\xE9 \xA9\x80</r>" );
+		XMLTest( "Parse ISO-8859-1", false, doc.Error() );
+		XMLTest( "ISO-8859-1 text", "a text long enough for the vector path: caf\xC3\xA9 \xC2\xA9\xC2\x80", doc.RootElement()->GetText() );
+		XMLTest( "ISO-8859-1 attribute", "\xC3\xA9", doc.RootElement()->Attribute( "a" ) );
+		XMLTest( "Declaration names UTF-8", "xml version='1.0' encoding='UTF-8'", doc.FirstChild()->Value() );
+
+		doc.Parse( "<?xml version=\"1.0\" encoding=\"windows-1252\"?>\n<r>\x80\x93x\x81\xFF</r>" );
+		XMLTest( "Windows-1252 text", "\xE2\x82\xAC\xE2\x80\x9Cx\xC2\x81\xC3\xBF", doc.RootElement()->GetText() );
+
+		XMLPrinter printer;
+		doc.Print( &printer );
+		XMLDocument reread;
+		reread.Parse( printer.CStr() );
+		XMLTest( "Windows-1252 round trip", "\xE2\x82\xAC\xE2\x80\x9Cx\xC2\x81\xC3\xBF", reread.RootElement()->GetText() );
+
+		FILE* fp = fopen( "resources/out/cp1252.xml", "wb" );
+		fputs( "<?xml version='1.0' encoding='CP1252'?><r>\x80 and a text long enough for the vector path \x99</r>", fp );
+		fclose( fp );
+		doc.LoadFile( "resources/out/cp1252.xml" );
+		XMLTest( "Load Windows-1252", "\xE2\x82\xAC and a text long enough for the vector path \xE2\x84\xA2", doc.RootElement()->GetText() );
+
+		XMLDocumentW wide;
+		fp = fopen( "resources/out/cp1252.xml", "rb" );
+		wide.LoadFile( fp );
+		fclose( fp );
+		const wchar_t* text = wide.RootElement()->GetText();
+		XMLTest( "Wide load Windows-1252", true, text[0] == 0x20AC && text[45] == 0x2122 && text[46] == 0 );
+		XMLTest( "Wide declaration names UTF-8", true, wide.FirstChild()->Value()[28] == 'U' && wide.FirstChild()->Value()[33] == '\'' );
+	}
+
+	{
+		// Whitespace is collapsed in the normalization pass
+		XMLDocument doc( true, COLLAPSE_WHITESPACE );
+		doc.Parse( "<r>\r\n  one &#x20;\ttwo\r\n&#10;  &amp; three  &#32;</r>" );
+		XMLTest( "Collapse text with references", "one two & three", doc.RootElement()->GetText() );
+
+		doc.Parse( "<r>a  \r\n  &unknown; b</r>" );
+		XMLTest( "Collapse before an unknown entity", "a &unknown; b", doc.RootElement()->GetText() );
+	}
+
+#ifdef TINYXML2_CHAR16
+	{
+		// UTF-32 files load into 16 bit units, with pairs past U+FFFF
+		static const unsigned long chars[] = { '<', 'r', '>', 0x1D11E, 0x1D11E, 0x4E2D, 'x', 0x10400, '<', '/', 'r', '>' };
+		const int count = sizeof( chars ) / sizeof( chars[0] );
+		static const char16_t expected[] = u"\U0001D11E\U0001D11E\u4E2Dx\U00010400";
+		for( int bigEndian=0; bigEndian<2; ++bigEndian ) {
+			FILE* fp = fopen( "resources/out/utf32.xml", "wb" );
+			for( int i=0; i<count; ++i ) {
+				for( int b=0; b<4; ++b ) {
+					fputc( (int)( ( chars[i] >> ( 8 * ( bigEndian ? 3 - b : b ) ) ) & 0xFF ), fp );
+				}
+			}
+			fclose( fp );
+
+			XMLDocumentU16 doc;
+			doc.LoadFile( u"resources/out/utf32.xml" );
+			XMLTest( bigEndian ? "char16_t load UTF-32BE" : "char16_t load UTF-32LE", false, doc.Error() );
+			const char16_t* text = doc.Error() ? u"" : doc.RootElement()->GetText();
+			bool same = true;
+			for( int i=0; same && ( expected[i] || text[i] ); ++i ) {
+				same = expected[i] == text[i];
+			}
+			XMLTest( "char16_t UTF-32 text", true, same );
+		}
+	}
+#endif
+
+	{
+		// Unlinked nodes are found by index, in any order.
+		XMLDocument doc;
+		XMLElement* root = doc.NewElement( "root" );
+		doc.InsertEndChild( root );
+		XMLElement* a = doc.NewElement( "a" );
+		XMLElement* b = doc.NewElement( "b" );
+		XMLElement* c = doc.NewElement( "c" );
+		root->InsertEndChild( a );
+		doc.DeleteNode( c );
+		root->InsertEndChild( b );
+
+		static const int count = 20000;
+		XMLElement** nodes = new XMLElement*[count];
+		for( int i=0; i<count; ++i ) {
+			nodes[i] = doc.NewElement( "n" );
+		}
+		for( int i=0; i<count; ++i ) {
+			root->InsertEndChild( nodes[i] );
+		}
+		delete [] nodes;
+		int children = 0;
+		for( const XMLElement* ele = root->FirstChildElement(); ele; ele = ele->NextSiblingElement() ) {
+			++children;
+		}
+		XMLTest( "Insert unlinked nodes oldest first", count + 2, children );
+		XMLTest( "Unlinked nodes in order", "b", root->FirstChildElement()->NextSiblingElement()->Name() );
+	}
+
+	{
+		// Clone strings are freed with the nodes that use them.
+		XMLDocument source;
+		source.Parse( "<root><item name='a name longer than inline' v='x'>some longer text value</item></root>" );
+		XMLDocument target;
+		XMLElement* keep = 0;
+		for( int i=0; i<100; ++i ) {
+			XMLNode* clone = source.RootElement()->DeepClone( &target );
+			if ( i == 50 ) {
+				keep = clone->ToElement();
+				continue;
+			}
+			target.DeleteNode( clone );
+		}
+		XMLTest( "Clone survives deleted siblings", "a name longer than inline", keep->FirstChildElement()->Attribute( "name" ) );
+		keep->FirstChildElement()->SetAttribute( "name", "changed" );
+		keep->FirstChildElement()->FirstChild()->SetValue( "new" );
+		XMLTest( "Clone keeps the rest of its block", "item", keep->FirstChildElement()->Name() );
+		target.InsertEndChild( keep );
+		XMLPrinter printer;
+		target.Print( &printer );
+		XMLTest( "Edited clone prints", "<root>\n    <item name=\"changed\" v=\"x\">new</item>\n</root>\n", printer.CStr(), false );
+	}
+
+	{
+		// The compact parse reads the XML directly, with XMLDocument's results.
+		static const char* inputs[] = {
+			"<?xml version='1.0'?><!--c--><root a='1' b=\"x&amp;y\">  text &lt; more\r\n <item id='1'/>"
+				"<![CDATA[cd\r\nata]]><!DOCTYPE foo><x>a&#x41;b</x>\n</root>\n",
+			"<a>  several   spaces\n\n and &unknown; entity </a>",
+			"<a></a></b><c/>", "</a/>", "<a>", "<a> ", "<a>text", "<a><b></a>", "<a x='1' x='2'/>",
+			"<!--x--><?xml?><a/>", "<a><?xml?></a>", "text<a/>", "<a/>text", "<a/>text<", "< a/>", "<a b/>",
+			"\n<a>\n  <b x='1\n\t2\r\n3' y='&#xA;'/>\n  <!--c-->\r\n\t<c>t</c> \n</a>\n"
+		};
+		static const Whitespace modes[3] = { PRESERVE_WHITESPACE, COLLAPSE_WHITESPACE, PEDANTIC_WHITESPACE };
+		bool same = true;
+		for( int i=0; i<(int)( sizeof( inputs ) / sizeof( inputs[0] ) ); ++i ) {
+			for( int mode=0; mode<3; ++mode ) {
+				const Whitespace whitespace = modes[mode];
+				XMLCompactDocument parsed( true, whitespace );
+				XMLCompactDocument built( true, whitespace );
+				XMLDocument doc( true, whitespace );
+				doc.Parse( inputs[i] );
+				if ( parsed.Parse( inputs[i] ) != built.Build( doc ) || parsed.NodeCount() != built.NodeCount() ) {
+					same = false;
+					continue;
+				}
+				for( unsigned n=1; n<parsed.NodeCount(); ++n ) {
+					same = same && parsed.Type( n ) == built.Type( n ) && parsed.Parent( n ) == built.Parent( n )
+						&& parsed.NextSibling( n ) == built.NextSibling( n ) && parsed.ValueLength( n ) == built.ValueLength( n )
+						&& strcmp( parsed.Value( n ), built.Value( n ) ) == 0 && parsed.AttributeCount( n ) == built.AttributeCount( n );
+					for( unsigned a=0; same && a<parsed.AttributeCount( n ); ++a ) {
+						same = strcmp( parsed.AttributeName( n, a ), built.AttributeName( n, a ) ) == 0
+							&& strcmp( parsed.AttributeValue( n, a ), built.AttributeValue( n, a ) ) == 0;
+					}
+				}
+			}
+		}
+		XMLTest( "Compact parse matches XMLDocument", true, same );
+
+		XMLCompactDocument compact;
+		XMLTest( "Compact parse entities", XML_SUCCESS, compact.Parse( "<r a='&lt;&#65;'>x &amp; y</r>" ) );
+		XMLTest( "Compact parse attribute entity", "<A", compact.Attribute( compact.RootElement(), "a" ) );
+		XMLTest( "Compact parse text entity", "x & y", compact.GetText( compact.RootElement() ) );
+		XMLTest( "Compact parse text length", 5, (int)compact.ValueLength( compact.FirstChild( compact.RootElement() ) ) );
+		XMLTest( "Compact parse unclosed", XML_ERROR_PARSING, compact.Parse( "<a><b/>" ) );
+		XMLTest( "Compact parse empty", XML_ERROR_EMPTY_DOCUMENT, compact.Parse( "  " ) );
+	}
+
     // ----------- Performance tracking --------------
 	{
 #if defined( _MSC_VER )